@@ -81,8 +81,15 @@ LatentCrfAligner::LatentCrfAligner(const string &textFilename,
   assert(srcSents.size() > 0);
   examplesCount = srcSents.size();
 
-  if(learningInfo.mpiWorld->rank() == 0 && wordPairFeaturesFilename.size() > 0) {
-    lambda->LoadPrecomputedFeaturesWith2Inputs(wordPairFeaturesFilename);
+  if(wordPairFeaturesFilename.size() > 0 && WordPairFeatureFile::IsBinary(wordPairFeaturesFilename)) {
+    // binary features files are mapped by all processes (see convert-wordpair-feats)
+    lambda->MapPrecomputedFeaturesWith2Inputs(wordPairFeaturesFilename);
+  } else {
+    if(learningInfo.mpiWorld->rank() == 0 && wordPairFeaturesFilename.size() > 0) {
+      lambda->LoadPrecomputedFeaturesWith2Inputs(wordPairFeaturesFilename);
+    }
+    // other processes map the word pair features table the first time they fire features, so it must exist by then
+    learningInfo.mpiWorld->barrier();
   }
 
   // load the mapping from each target word to its word class (e.g. brown clusters)
@@ -112,8 +119,7 @@ LatentCrfAligner::LatentCrfAligner(const string &textFilename,
   InitLambda();
 
   assert(lambda->paramWeightsTemp.size() == 0 && lambda->paramIdsTemp.size() == 0);
-  assert(lambda->paramWeightsPtr->size() == lambda->paramIndexes.size());
-  assert(lambda->paramIdsPtr->size() == lambda->paramIndexes.size());
+  assert(lambda->IsHashed() || lambda->paramWeightsPtr->size() == lambda->paramIdsPtr->size());
 
   if(learningInfo.mpiWorld->rank() == 0) {
     vocabEncoder.PersistVocab(outputPrefix + string(".vocab"));
@@ -172,6 +178,17 @@ void LatentCrfAligner::PrepareExample(unsigned exampleId) {
   }
 }
 
+// the same labels PrepareExample() puts in yDomain, without modifying yDomain (so that sentences can be processed
+// concurrently)
+void LatentCrfAligner::GetLatticeLabels(unsigned sentId, vector<int> &labels) {
+  labels.clear();
+  unsigned srcSentLength = GetObservableContext(sentId).size();
+  unsigned firstPossibleYValue = learningInfo.allowNullAlignments? NULL_POSITION : NULL_POSITION + 1;
+  for(unsigned i = firstPossibleYValue; i < firstPossibleYValue + srcSentLength; ++i) {
+    labels.push_back(i);
+  }
+}
+
 vector<int64_t>& LatentCrfAligner::GetReconstructedObservableSequence(int exampleId) {
   if(testingMode) {
     if(testClassTgtSents.size() > 0) {
@@ -180,9 +197,6 @@ vector<int64_t>& LatentCrfAligner::GetReconstructedObservableSequence(int exampl
       return testTgtSents[exampleId];
     }
   } else {
-    // refactor: this following line does not logically belong here
-    lambda->learningInfo->currentSentId = exampleId;
-
     if(exampleId >= tgtSents.size()) {
       cerr << exampleId << " < " << tgtSents.size() << endl;
     }
@@ -200,7 +214,6 @@ vector<int64_t>& LatentCrfAligner::GetObservableSequence(int exampleId) {
     assert(exampleId < testTgtSents.size());
     return testTgtSents[exampleId];
   } else {
-    lambda->learningInfo->currentSentId = exampleId;
     if(exampleId >= tgtSents.size()) {
       cerr << exampleId << " < " << tgtSents.size() << endl;
     }
@@ -239,22 +252,18 @@ void LatentCrfAligner::Label(vector<int64_t> &tokens, vector<int64_t> &context,
   testingMode = true;
   SetTestExample(tokens, context);
 
-  // build an fst in which each path is a complete word alignment of the target sentence, weighted according to the model
+  // build a lattice in which each path is a complete word alignment of the target sentence, weighted according to the model
   unsigned sentId = 0;
-  fst::VectorFst<FstUtils::LogArc> fst;
-  std::vector<FstUtils::LogWeight> alphas, betas;
+  BuildArcFeatureTable(sentId, workspace.arcFeatureTable);
+  DenseLattice &lattice = learningInfo.testWithCrfOnly? workspace.lambdaLattice : workspace.thetaLambdaLattice;
   if(learningInfo.testWithCrfOnly) {
-    BuildLambdaFst(sentId, fst, alphas, betas);
+    BuildLambdaLattice(workspace.arcFeatureTable, lattice, false);
   } else {
-    BuildThetaLambdaFst(sentId, GetReconstructedObservableSequence(sentId), fst, alphas, betas);
+    BuildThetaLambdaLattice(sentId, GetReconstructedObservableSequence(sentId), workspace.arcFeatureTable, lattice, false);
   }
 
-  // map to the tropical semiring which enjoys the path property (in order to find the best alignment)
-  fst::VectorFst<FstUtils::StdArc> pathFst, shortestPathFst;
-  fst::ArcMap(fst, &pathFst, FstUtils::LogToTropicalMapper());
-  fst::ShortestPath(pathFst, &shortestPathFst);
-  std::vector<int> dummy;
-  FstUtils::LinearFstToVector(shortestPathFst, dummy, labels);
+  // find the best alignment
+  lattice.Viterbi(labels);
 
   // set down ;)
   testingMode = false;
@@ -264,18 +273,13 @@ void LatentCrfAligner::Label(vector<int64_t> &tokens, vector<int64_t> &context,
 
 void LatentCrfAligner::Label(const string &labelsFilename) {
   // run viterbi (and write alignments in giza format)
-  ofstream labelsFile(labelsFilename.c_str());
   assert(learningInfo.firstKExamplesToLabel <= examplesCount);
-  for(unsigned exampleId = 0; exampleId < learningInfo.firstKExamplesToLabel; ++exampleId) {
+  // each process aligns a contiguous block of examples into its own shard
+  unsigned firstExampleId, lastExampleId;
+  GetLabelingBlock(learningInfo.firstKExamplesToLabel, firstExampleId, lastExampleId);
+  stringstream shard;
+  for(unsigned exampleId = firstExampleId; exampleId < lastExampleId; ++exampleId) {
     lambda->learningInfo->currentSentId = exampleId;
-    if(exampleId % learningInfo.mpiWorld->size() != learningInfo.mpiWorld->rank()) {
-      if(learningInfo.mpiWorld->rank() == 0){
-        string labelSequence;
-        learningInfo.mpiWorld->recv(exampleId % learningInfo.mpiWorld->size(), 0, labelSequence);
-        labelsFile << labelSequence;
-      }
-      continue;
-    }
 
     std::vector<int64_t> &srcSent = GetObservableContext(exampleId);
     std::vector<int64_t> &tgtSent = GetObservableSequence(exampleId);
@@ -300,16 +304,21 @@ void LatentCrfAligner::Label(const string &labelsFilename) {
       
     }
     ss << endl;
-    if(learningInfo.mpiWorld->rank() == 0){
-      labelsFile << ss.str();
-    }else{
-      //cerr << "rank" << learningInfo.mpiWorld->rank() << " will send exampleId " << exampleId << " to master" << endl; 
-      learningInfo.mpiWorld->send(0, 0, ss.str());
-      //cerr << "rank" << learningInfo.mpiWorld->rank() << " sending done." << endl;
+    shard << ss.str();
+  }
+
+  // blocks are contiguous and in rank order, so the master only needs to concatenate the shards
+  if(learningInfo.mpiWorld->rank() == 0) {
+    vector<string> shards;
+    mpi::gather<string>(*learningInfo.mpiWorld, shard.str(), shards, 0);
+    ofstream labelsFile(labelsFilename.c_str());
+    for(unsigned proc = 0; proc < shards.size(); ++proc) {
+      labelsFile << shards[proc];
     }
-    
+    labelsFile.close();
+  } else {
+    mpi::gather<string>(*learningInfo.mpiWorld, shard.str(), 0);
   }
-  labelsFile.close();
 }
 
 int64_t LatentCrfAligner::GetContextOfTheta(unsigned sentId, int y) {
@@ -325,6 +334,10 @@ int64_t LatentCrfAligner::GetContextOfTheta(unsigned sentId, int y) {
 
 void LatentCrfAligner::FireFeatures(int yI, int yIM1, unsigned sentId, int i, 
 				  FastSparseVector<double> &activeFeatures) { 
+    // the features of other aligners' output are looked up by currentSentId (which labeling sets itself)
+    if(!testingMode) {
+      lambda->learningInfo->currentSentId = sentId;
+    }
     // fire the word aligner features
     int firstPos = learningInfo.allowNullAlignments? NULL_POSITION : NULL_POSITION + 1;
     lambda->FireFeatures(yI, yIM1, GetObservableSequence(sentId), GetObservableContext(sentId), i, 
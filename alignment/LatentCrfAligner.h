@@ -36,6 +36,8 @@ class LatentCrfAligner : public LatentCrfModel {
 
   void PrepareExample(unsigned exampleId);
 
+  void GetLatticeLabels(unsigned sentId, std::vector<int> &labels);
+
   int64_t GetContextOfTheta(unsigned sentId, int y);
 
  public:
@@ -89,6 +89,19 @@ bool ParseParameters(int argc, char **argv, string &textFilename,
     MAX_MODEL1_ITER_COUNT = "max-model1-iter-count",
     NO_DIRECT_DEP_BTW_HIDDEN_LABELS = "no-direct-dep-btw-hidden-labels",
     CACHE_FEATS = "cache-feats",
+    FEATURE_CACHE_SIZE = "feature-cache-size",
+    DENSE_LATTICES = "dense-lattices",
+    SCALED_LATTICES = "scaled-lattices",
+    PRUNING_BEAM = "pruning-beam",
+    PRUNING_THRESHOLD = "pruning-threshold",
+    LAMBDA_CACHE_MB = "lambda-cache-mb",
+    COMPILE_FEATURES = "compile-features",
+    FEATURE_HASH_BITS = "feature-hash-bits",
+    SIGNED_FEATURE_HASH = "signed-feature-hash",
+    NODE_LOCAL_REDUCE = "node-local-reduce",
+    THREADS_PER_RANK = "threads-per-rank",
+    BALANCE_SENTENCES = "balance-sentences",
+    LOGSUMEXP_KERNELS = "logsumexp-kernels",
     LAMBDA_OPTIMIZER = "lambda-optimizer",
     THETA_OPTIMIZER = "theta-optimizer",
     LAMBDA_OPTIMIZER_LEARNING_RATE = "lambda-learning-rate",
@@ -111,7 +124,7 @@ bool ParseParameters(int argc, char **argv, string &textFilename,
     (VOCAB.c_str(), po::value<string>(&learningInfo.vocabFilename), "(filename) optional -- the vocabulary used in the parallel data. It speeds up initialization.")
     (INIT_LAMBDA.c_str(), po::value<string>(&initialLambdaParamsFilename), "(filename) initial weights of lambda parameters")
     (INIT_THETA.c_str(), po::value<string>(&initialThetaParamsFilename), "(filename) initial weights of theta parameters")
-    (WORDPAIR_FEATS.c_str(), po::value<string>(&wordPairFeaturesFilename), "(filename) features defined for pairs of source-target word pairs")
+    (WORDPAIR_FEATS.c_str(), po::value<string>(&wordPairFeaturesFilename), "(filename) features defined for pairs of source-target word pairs, either in the text format or in the binary format written by convert-wordpair-feats")
     (OUTPUT_PREFIX.c_str(), po::value<string>(&outputFilenamePrefix), "(filename prefix) all filenames written by this program will have this prefix")
      // deen=150 // czen=515 // fren=447;
     (TEST_SIZE.c_str(), po::value<unsigned int>(&learningInfo.firstKExamplesToLabel), "(int) specifies the number of sentence pairs in train-data to eventually generate alignments for") 
@@ -126,6 +139,19 @@ bool ParseParameters(int argc, char **argv, string &textFilename,
     (MAX_EM_ITER_COUNT.c_str(), po::value<unsigned int>(&learningInfo.emIterationsCount)->default_value(3), "(int) quit EM optimization after this many iterations")
     (NO_DIRECT_DEP_BTW_HIDDEN_LABELS.c_str(), "(flag) consecutive labels are independent given observation sequence")
     (CACHE_FEATS.c_str(), po::value<bool>(&learningInfo.cacheActiveFeatures)->default_value(false), "(flag) (set by default) maintains and uses a map from a factor to its active features to speed up training, at the expense of higher memory requirements.")
+    (FEATURE_CACHE_SIZE.c_str(), po::value<unsigned>(&learningInfo.featureCacheSize)->default_value(1000000), "(int) with --cache-feats, the maximum number of factors whose active features are cached per process. the least recently used factors are evicted first.")
+    (DENSE_LATTICES.c_str(), po::value<bool>(&learningInfo.useDenseLattices)->default_value(false), "(flag) (clear by default) use a native forward-backward implementation over dense score arrays instead of building openfst lattices. when consecutive labels are independent, dense lattices only cost O(T.K) per sentence.")
+    (SCALED_LATTICES.c_str(), po::value<bool>(&learningInfo.useScaledLattices)->default_value(false), "(flag) (clear by default) with --dense-lattices, run forward-backward in probability space with per-timestep scaling factors instead of the log semiring. sentences which would underflow fall back to the log semiring.")
+    (PRUNING_BEAM.c_str(), po::value<unsigned>(&learningInfo.pruningBeamSize)->default_value(0), "(int) with dense lattices, only consider the top N source positions for each target position, according to the ibm model 1 posterior given by the current theta parameters. the same positions are pruned in the lattices used to compute Z and C. pruning only applies to training; decoding considers all positions. (0 = no pruning)")
+    (PRUNING_THRESHOLD.c_str(), po::value<double>(&learningInfo.pruningPosteriorThreshold)->default_value(0.0), "(double) with dense lattices, only consider source positions whose ibm model 1 posterior (according to the current theta parameters) is at least this value. the best position is always kept. (0 = no pruning)")
+    (LAMBDA_CACHE_MB.c_str(), po::value<unsigned>(&learningInfo.lambdaCacheMegabytes)->default_value(0), "(int) lambda is fixed during the EM iterations which update theta, so Z(x) is only computed once per sentence and lambda update. with dense lattices, the arc weights of each (pruned) lambda lattice are also cached, using at most this many megabytes in each MPI rank (the memory used by a node is this budget times the ranks running on it). when labels are pruned, the cached sentences keep the pruning of the first EM iteration. (0 = only cache Z(x))")
+    (COMPILE_FEATURES.c_str(), po::value<bool>(&learningInfo.compileFeatures)->default_value(false), "(flag) (clear by default) with dense lattices, fire the features of each training sentence once after lambda parameters are initialized, and keep their parameter indexes in memory. later iterations only compute dot products, at the cost of memory proportional to the number of arcs times the number of active features per arc.")
+    (FEATURE_HASH_BITS.c_str(), po::value<unsigned>(&learningInfo.featureHashBits)->default_value(0), "(int) when non-zero, hash each feature into one of 2^N shared weights instead of discovering the features of the training data before training starts. saves the startup time and the memory of the feature index, at the cost of collisions. initial lambda params cannot be loaded in this mode. (0 = no hashing)")
+    (SIGNED_FEATURE_HASH.c_str(), po::value<bool>(&learningInfo.signedFeatureHash)->default_value(false), "(flag) (clear by default) with --feature-hash-bits, also hash each feature to a +1/-1 sign so that colliding features cancel out in expectation.")
+    (NODE_LOCAL_REDUCE.c_str(), po::value<bool>(&learningInfo.nodeLocalReduce)->default_value(false), "(flag) (clear by default) processes on the same node add up their gradients in shared memory, and only one process per node takes part in the MPI reduction of gradients and objectives.")
+    (THREADS_PER_RANK.c_str(), po::value<unsigned>(&learningInfo.threadsPerRank)->default_value(1), "(int) number of threads which compute the objective, gradient and soft counts of the training sentences of each MPI process, each with its own accumulators. sentences are only processed concurrently with --dense-lattices and --compile-features. (1 = no threads)")
+    (BALANCE_SENTENCES.c_str(), po::value<bool>(&learningInfo.balanceSentencesByCost)->default_value(true), "(flag) (set by default) assign training sentences to MPI processes by the estimated cost of their lattices (target length times the number of label pairs), longest first, each to the least loaded process. when cleared, sentences are assigned round-robin.")
+    (LOGSUMEXP_KERNELS.c_str(), po::value<string>(&learningInfo.logSumExpKernels)->default_value("auto"), "(string) log-sum-exp kernels used by dense lattices. 'auto' picks the widest vectors supported by the cpu which the number of labels fills (avx512 from 8 labels, avx2 from 4). 'scalar', 'avx2' or 'avx512' forces the same kernels for all sentences.")
     (LAMBDA_OPTIMIZER.c_str(), po::value<string>()->default_value("sgd"), "(string) optimization algorithm to use for optimizing the CRF parameters. Supported values are: 'lbfgs', 'sgd', 'adagrad'. L-BFGS is a popular quasi-Newton optimization algorithm, SGD is stochastic gradient descent, and ADAGRAD is the adaptive gradient algorithm described at http://www.magicbroom.info/Papers/DuchiHaSi10.pdf")
     (THETA_OPTIMIZER.c_str(), po::value<string>()->default_value("em"), "(string) optimization algorithm to use for optimizing the reconstruction parameters. Supported values are: 'em' and 'online_em'. 'em' is the standard batch expectation maximization algorithm. 'online_em' is the the stepwise EM algorithm described in Liang and Klein (2009)'s paper titled ``Online EM for Unsupervised Models''.")
     (LAMBDA_OPTIMIZER_LEARNING_RATE.c_str(), po::value<float>(&learningInfo.optimizationMethod.subOptMethod->learningRate)->default_value(1.0), "(float) If the optimizer used for CRF parameters uses a learning rate (e.g., stochastic gradient descent), specify the initial learning rate using htis argument. Note that the learning rate decays in subsequent iterations of SGD.")
@@ -232,6 +258,12 @@ bool ParseParameters(int argc, char **argv, string &textFilename,
     }
   }
 
+  if(!LogSumExp::Force(learningInfo.logSumExpKernels)) {
+    cerr << "option --" << LOGSUMEXP_KERNELS << " cannot take the value " << learningInfo.logSumExpKernels 
+         << " (unknown, or not supported by this cpu)" << endl;
+    return false;
+  }
+
   if (vm.count(THETA_OPTIMIZER.c_str())) {
     if (vm[THETA_OPTIMIZER.c_str()].as<string>() == "em") {
       learningInfo.thetaOptMethod->algorithm = OptAlgorithm::EXPECTATION_MAXIMIZATION;
@@ -298,6 +330,19 @@ bool ParseParameters(int argc, char **argv, string &textFilename,
     cerr << MAX_EM_ITER_COUNT << "=" << learningInfo.emIterationsCount << endl;
     cerr << NO_DIRECT_DEP_BTW_HIDDEN_LABELS << "=" << !learningInfo.hiddenSequenceIsMarkovian << endl;
     cerr << CACHE_FEATS << "=" << learningInfo.cacheActiveFeatures << endl;
+    cerr << FEATURE_CACHE_SIZE << "=" << learningInfo.featureCacheSize << endl;
+    cerr << DENSE_LATTICES << "=" << learningInfo.useDenseLattices << endl;
+    cerr << SCALED_LATTICES << "=" << learningInfo.useScaledLattices << endl;
+    cerr << PRUNING_BEAM << "=" << learningInfo.pruningBeamSize << endl;
+    cerr << PRUNING_THRESHOLD << "=" << learningInfo.pruningPosteriorThreshold << endl;
+    cerr << LAMBDA_CACHE_MB << "=" << learningInfo.lambdaCacheMegabytes << endl;
+    cerr << COMPILE_FEATURES << "=" << learningInfo.compileFeatures << endl;
+    cerr << FEATURE_HASH_BITS << "=" << learningInfo.featureHashBits << endl;
+    cerr << SIGNED_FEATURE_HASH << "=" << learningInfo.signedFeatureHash << endl;
+    cerr << NODE_LOCAL_REDUCE << "=" << learningInfo.nodeLocalReduce << endl;
+    cerr << THREADS_PER_RANK << "=" << learningInfo.threadsPerRank << endl;
+    cerr << BALANCE_SENTENCES << "=" << learningInfo.balanceSentencesByCost << endl;
+    cerr << LOGSUMEXP_KERNELS << "=" << learningInfo.logSumExpKernels << endl;
     if(vm.count(LAMBDA_OPTIMIZER.c_str())) {
       cerr << LAMBDA_OPTIMIZER << "=" << vm[LAMBDA_OPTIMIZER.c_str()].as<string>() << endl;
     }
@@ -334,7 +379,14 @@ bool ParseParameters(int argc, char **argv, string &textFilename,
     cerr << desc << endl;
     return false;
   }
-  
+
+  // lambda params are indexed by unsigned ints, so there can be at most 2^31 hashed weights
+  if(learningInfo.featureHashBits >= 32) {
+    cerr << "option --" << FEATURE_HASH_BITS << " cannot take the value " << learningInfo.featureHashBits
+         << " (use 0 to disable hashing, or at most 31 bits)" << endl;
+    return false;
+  }
+
   return true;
 }
 
@@ -0,0 +1,135 @@
+#ifndef _ARC_FEATURE_TABLE_H_
+#define _ARC_FEATURE_TABLE_H_
+
+#include <vector>
+#include <assert.h>
+
+#include "../cdec-utils/fast_sparse_vector.h"
+
+// the active features and the \lambda h score of each arc in a dense lattice of one sentence.
+// arcs are indexed the same way as DenseLattice: (i * K + yIM1Index) * K + yIIndex.
+// features are fired once per arc when the table is built, and then consumed by
+// all computations which need them (Z, C, F/Z, D/C).
+// features which do not depend on y_{i-1} are stored once per state (i, y_i) instead of
+// once per arc, i.e. the arc score is the sum of an emission score (T x K) and a transition score.
+class ArcFeatureTable {
+
+ public:
+
+  ArcFeatureTable() : timesteps(0), labelsCount(0), arcsPerTimestep(0), hasArcFeatures(false) {}
+
+  // clears the table and prepares it for a sequence of length T.
+  // with independentPositions, there is only one arc (yIM1Index = 0) per label at each timestep (see DenseLattice)
+  void Resize(unsigned T, const std::vector<int> &labels, bool independentPositions = false) {
+    timesteps = T;
+    labelsCount = labels.size();
+    yValues = labels;
+    arcsPerTimestep = independentPositions? labelsCount : labelsCount * labelsCount;
+    unsigned arcsCount = timesteps * arcsPerTimestep;
+    lambdaH.assign(arcsCount, 0.0);
+    arcBegin.assign(arcsCount, 0);
+    arcEnd.assign(arcsCount, 0);
+    unsigned statesCount = timesteps * labelsCount;
+    stateLambdaH.assign(statesCount, 0.0);
+    stateBegin.assign(statesCount, 0);
+    stateEnd.assign(statesCount, 0);
+    allowedStates.assign(statesCount, true);
+    featureIndexes.clear();
+    featureValues.clear();
+    hasArcFeatures = false;
+  }
+
+  inline unsigned ArcId(unsigned i, unsigned yIM1Index, unsigned yIIndex) const {
+    return i * arcsPerTimestep + yIM1Index * labelsCount + yIIndex;
+  }
+
+  inline unsigned StateId(unsigned i, unsigned yIIndex) const {
+    return i * labelsCount + yIIndex;
+  }
+
+  // the total \lambda h(y_i, y_{i-1}, x, i) of an arc
+  inline double Score(unsigned i, unsigned yIM1Index, unsigned yIIndex) const {
+    return lambdaH[ArcId(i, yIM1Index, yIIndex)] + stateLambdaH[StateId(i, yIIndex)];
+  }
+
+  // copy the active features of an arc, and its score \lambda h
+  void SetArc(unsigned arcId, const FastSparseVector<double> &h, double score) {
+    arcBegin[arcId] = featureIndexes.size();
+    for(FastSparseVector<double>::const_iterator h_k = h.begin(); h_k != h.end(); ++h_k) {
+      featureIndexes.push_back(h_k->first);
+      featureValues.push_back(h_k->second);
+    }
+    arcEnd[arcId] = featureIndexes.size();
+    lambdaH[arcId] = score;
+    hasArcFeatures = true;
+  }
+
+  // copy the active features of a state, and its score \lambda h
+  void SetState(unsigned stateId, const FastSparseVector<double> &h, double score) {
+    stateBegin[stateId] = featureIndexes.size();
+    for(FastSparseVector<double>::const_iterator h_k = h.begin(); h_k != h.end(); ++h_k) {
+      featureIndexes.push_back(h_k->first);
+      featureValues.push_back(h_k->second);
+    }
+    stateEnd[stateId] = featureIndexes.size();
+    stateLambdaH[stateId] = score;
+  }
+
+  // same as above, with the features given as count parallel indexes and values (e.g. from a CompiledFeatureIndex)
+  void SetArc(unsigned arcId, const int *indexes, const double *values, unsigned count, double score) {
+    arcBegin[arcId] = featureIndexes.size();
+    featureIndexes.insert(featureIndexes.end(), indexes, indexes + count);
+    featureValues.insert(featureValues.end(), values, values + count);
+    arcEnd[arcId] = featureIndexes.size();
+    lambdaH[arcId] = score;
+    hasArcFeatures = true;
+  }
+
+  void SetState(unsigned stateId, const int *indexes, const double *values, unsigned count, double score) {
+    stateBegin[stateId] = featureIndexes.size();
+    featureIndexes.insert(featureIndexes.end(), indexes, indexes + count);
+    featureValues.insert(featureValues.end(), values, values + count);
+    stateEnd[stateId] = featureIndexes.size();
+    stateLambdaH[stateId] = score;
+  }
+
+  // make the arcs of timestep toI share the features and scores of the arcs of timestep fromI
+  // (used when the arc features do not depend on the position)
+  void ShareArcs(unsigned fromI, unsigned toI) {
+    unsigned from = ArcId(fromI, 0, 0), to = ArcId(toI, 0, 0);
+    for(unsigned k = 0; k < arcsPerTimestep; ++k) {
+      arcBegin[to + k] = arcBegin[from + k];
+      arcEnd[to + k] = arcEnd[from + k];
+      lambdaH[to + k] = lambdaH[from + k];
+    }
+  }
+
+ public:
+  unsigned timesteps, labelsCount, arcsPerTimestep;
+
+  // values of y_i which correspond to label indexes 0..K-1
+  std::vector<int> yValues;
+
+  // \lambda h for the features which depend on y_{i-1}, for each arc
+  std::vector<double> lambdaH;
+
+  // \lambda h for the features which only depend on y_i, for each state
+  std::vector<double> stateLambdaH;
+
+  // features of arc a are featureIndexes[arcBegin[a]..arcEnd[a]) with values featureValues[arcBegin[a]..arcEnd[a])
+  std::vector<unsigned> arcBegin, arcEnd;
+
+  // features of state s are featureIndexes[stateBegin[s]..stateEnd[s]) with values featureValues[stateBegin[s]..stateEnd[s])
+  std::vector<unsigned> stateBegin, stateEnd;
+  std::vector<int> featureIndexes;
+  std::vector<double> featureValues;
+
+  // false when no arc was set, i.e. all features only depend on y_i
+  bool hasArcFeatures;
+
+  // allowedStates[StateId(i, yIIndex)] is false if the label was pruned at timestep i.
+  // pruned states have no features, and are left out of all lattices built from this table
+  std::vector<bool> allowedStates;
+};
+
+#endif
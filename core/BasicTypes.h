@@ -79,6 +79,13 @@ namespace DebugLevel {
   enum DebugLevel {NONE=0, ESSENTIAL=1, CORPUS=2, MINI_BATCH=3, SENTENCE=4, TOKEN=5, REDICULOUS=6, TEMP = 4};
 }
 
+// subsets of the enabled feature templates, according to the labels they look at.
+// LABEL: templates which only depend on y_i (and the observations)
+// LABEL_PAIR: templates which also depend on y_{i-1}
+namespace FeatureTemplateSubset {
+  enum FeatureTemplateSubset {ALL, LABEL, LABEL_PAIR};
+}
+
 // one rich observation (e.g. token, its brown cluster, its POS tag, its morphological analysis ...etc)
 struct ObservationDetails {
   ObservationDetails() {}
@@ -166,10 +173,11 @@ struct PosFactorId
 {
 public:
   int64_t yI, yIM1, xI, xIM1, xIM2, xIP1, xIP2;
-  int sentId;
+  // -1 unless the fired templates depend on the sentence (e.g. OTHER_POS)
+  int sentId, position;
 
   inline void Print() const {
-    std::cerr << "(yI=" << yI << ", yIM1=" << yIM1 << ", xI=" << xI << ", xIM1=" << xIM1 << ", xIM2=" << xIM2 << ", xIP1=" << xIP1 << ", xIP2=" << xIP2 << ", sentId=" << sentId << ")" << std::endl;
+    std::cerr << "(yI=" << yI << ", yIM1=" << yIM1 << ", xI=" << xI << ", xIM1=" << xIM1 << ", xIM2=" << xIM2 << ", xIP1=" << xIP1 << ", xIP2=" << xIP2 << ", sentId=" << sentId << ", position=" << position << ")" << std::endl;
   }
 
   inline bool operator < (const PosFactorId &other) const {
@@ -189,6 +197,8 @@ public:
       return xIP2 < other.xIP2;
     } else if(sentId != other.sentId) {
       return sentId < other.sentId;
+    } else if(position != other.position) {
+      return position < other.position;
     } else {
       return false;
     }
@@ -206,6 +216,7 @@ public:
       boost::hash_combine(seed, x.xIP1);
       boost::hash_combine(seed, x.xIP2);
       boost::hash_combine(seed, x.sentId);
+      boost::hash_combine(seed, x.position);
       return seed;
     }
   };
@@ -215,7 +226,7 @@ public:
       return left.yI == right.yI && left.yIM1 == right.yIM1 &&
         left.xIM2 == right.xIM2 && left.xIM1 == right.xIM1 &&
         left.xI == right.xI && left.xIP1 == right.xIP1 &&
-        left.xIP2 == right.xIP2 && left.sentId == right.sentId;
+        left.xIP2 == right.xIP2 && left.sentId == right.sentId && left.position == right.position;
     }
   };
 };
@@ -0,0 +1,86 @@
+#include "CompiledFeatureIndex.h"
+
+using namespace std;
+
+void CompiledFeatureIndex::Clear() {
+  sentences.clear();
+  factorBegin.assign(1, 0);
+  featureIndexes.clear();
+  featureValues.clear();
+}
+
+void CompiledFeatureIndex::AddFactor(const ArcFeatureTable &arcFeatures, unsigned begin, unsigned end) {
+  featureIndexes.insert(featureIndexes.end(), arcFeatures.featureIndexes.begin() + begin, arcFeatures.featureIndexes.begin() + end);
+  featureValues.insert(featureValues.end(), arcFeatures.featureValues.begin() + begin, arcFeatures.featureValues.begin() + end);
+  factorBegin.push_back(featureIndexes.size());
+}
+
+void CompiledFeatureIndex::Add(unsigned sentId, const ArcFeatureTable &arcFeatures, bool sharedTransitions) {
+  assert(!Has(sentId));
+  Sentence &sentence = sentences[sentId];
+  sentence.firstFactor = factorBegin.size() - 1;
+  sentence.timesteps = arcFeatures.timesteps;
+  sentence.labelsCount = arcFeatures.labelsCount;
+  sentence.arcsPerTimestep = arcFeatures.arcsPerTimestep;
+  sentence.sharedTransitions = sharedTransitions;
+  // shared transitions are only stored for timesteps 0 and 1
+  sentence.arcTimesteps = !arcFeatures.hasArcFeatures? 0 :
+    sharedTransitions? min(arcFeatures.timesteps, 2u) : arcFeatures.timesteps;
+
+  unsigned statesCount = arcFeatures.timesteps * arcFeatures.labelsCount;
+  for(unsigned stateId = 0; stateId < statesCount; ++stateId) {
+    AddFactor(arcFeatures, arcFeatures.stateBegin[stateId], arcFeatures.stateEnd[stateId]);
+  }
+  unsigned arcsCount = sentence.arcTimesteps * arcFeatures.arcsPerTimestep;
+  for(unsigned arcId = 0; arcId < arcsCount; ++arcId) {
+    AddFactor(arcFeatures, arcFeatures.arcBegin[arcId], arcFeatures.arcEnd[arcId]);
+  }
+}
+
+void CompiledFeatureIndex::Fill(unsigned sentId, LogLinearParams &lambda, ArcFeatureTable &arcFeatures) const {
+  auto sentenceIter = sentences.find(sentId);
+  assert(sentenceIter != sentences.end());
+  const Sentence &sentence = sentenceIter->second;
+  assert(sentence.timesteps == arcFeatures.timesteps && sentence.labelsCount == arcFeatures.labelsCount);
+  assert(sentence.arcsPerTimestep == arcFeatures.arcsPerTimestep);
+  const vector<bool> &allowed = arcFeatures.allowedStates;
+
+  // emissions
+  size_t factor = sentence.firstFactor;
+  unsigned statesCount = sentence.timesteps * sentence.labelsCount;
+  for(unsigned stateId = 0; stateId < statesCount; ++stateId, ++factor) {
+    if(!allowed[stateId]) { continue; }
+    size_t begin = factorBegin[factor], count = factorBegin[factor + 1] - begin;
+    double lambdaH = lambda.DotProduct(featureIndexes.data() + begin, featureValues.data() + begin, count);
+    arcFeatures.SetState(stateId, featureIndexes.data() + begin, featureValues.data() + begin, count, lambdaH);
+  }
+
+  // transitions
+  if(sentence.arcTimesteps == 0) {
+    return;
+  }
+  for(unsigned i = 0; i < sentence.timesteps; ++i) {
+    if(sentence.sharedTransitions && i > 1) {
+      arcFeatures.ShareArcs(1, i);
+      continue;
+    }
+    bool skipPrunedArcs = !sentence.sharedTransitions || i == 0;
+    unsigned prevLabelsCount = i == 0? 1 : sentence.labelsCount;
+    for(unsigned yIM1Index = 0; yIM1Index < prevLabelsCount; ++yIM1Index) {
+      if(skipPrunedArcs && i > 0 && !allowed[arcFeatures.StateId(i-1, yIM1Index)]) { continue; }
+      for(unsigned yIIndex = 0; yIIndex < sentence.labelsCount; ++yIIndex) {
+        if(skipPrunedArcs && !allowed[arcFeatures.StateId(i, yIIndex)]) { continue; }
+        unsigned arcId = arcFeatures.ArcId(i, yIM1Index, yIIndex);
+        size_t begin = factorBegin[sentence.firstFactor + statesCount + arcId],
+          count = factorBegin[sentence.firstFactor + statesCount + arcId + 1] - begin;
+        double lambdaH = lambda.DotProduct(featureIndexes.data() + begin, featureValues.data() + begin, count);
+        arcFeatures.SetArc(arcId, featureIndexes.data() + begin, featureValues.data() + begin, count, lambdaH);
+      }
+    }
+  }
+}
+
+size_t CompiledFeatureIndex::Bytes() const {
+  return factorBegin.capacity() * sizeof(size_t) + featureIndexes.capacity() * sizeof(int) +
+    featureValues.capacity() * sizeof(double);
+}
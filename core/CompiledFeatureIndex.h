@@ -0,0 +1,54 @@
+#ifndef _COMPILED_FEATURE_INDEX_H_
+#define _COMPILED_FEATURE_INDEX_H_
+
+#include <vector>
+#include <cstddef>
+#include <boost/unordered_map.hpp>
+
+#include "ArcFeatureTable.h"
+#include "LogLinearParams.h"
+
+// the active features of every factor (state or arc) in the dense lattices of all sentences processed
+// by this process, resolved to parameter indexes once lambda is sealed, in one compressed sparse row layout.
+// the features of factor f are featureIndexes[factorBegin[f]..factorBegin[f+1]) with values featureValues[..].
+// filling an ArcFeatureTable from this index does not build FeatureIds nor look them up in paramIndexes.
+class CompiledFeatureIndex {
+
+ public:
+
+  CompiledFeatureIndex() { Clear(); }
+
+  void Clear();
+
+  bool Has(unsigned sentId) const {
+    return sentences.find(sentId) != sentences.end();
+  }
+
+  // append the features of an (unpruned) table populated by LatentCrfModel::BuildArcFeatureTable().
+  // with sharedTransitions, the arcs of timesteps > 1 are the same as the arcs of timestep 1 (see ArcFeatureTable::ShareArcs)
+  void Add(unsigned sentId, const ArcFeatureTable &arcFeatures, bool sharedTransitions);
+
+  // copy the features of the allowed factors of sentId into arcFeatures (already resized and pruned),
+  // and compute their \lambda h. pruned factors are skipped the same way BuildArcFeatureTable() skips them
+  void Fill(unsigned sentId, LogLinearParams &lambda, ArcFeatureTable &arcFeatures) const;
+
+  size_t Bytes() const;
+
+ private:
+
+  // the factors of one sentence: timesteps x labelsCount states, followed by arcTimesteps x arcsPerTimestep arcs
+  struct Sentence {
+    size_t firstFactor;
+    unsigned timesteps, labelsCount, arcsPerTimestep, arcTimesteps;
+    bool sharedTransitions;
+  };
+
+  void AddFactor(const ArcFeatureTable &arcFeatures, unsigned begin, unsigned end);
+
+  boost::unordered_map<unsigned, Sentence> sentences;
+  std::vector<size_t> factorBegin;
+  std::vector<int> featureIndexes;
+  std::vector<double> featureValues;
+};
+
+#endif
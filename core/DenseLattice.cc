@@ -0,0 +1,372 @@
+#include <boost/thread/thread.hpp>
+
+#include "DenseLattice.h"
+
+using namespace std;
+
+void DenseLattice::Resize(unsigned T, const vector<int> &labels) {
+  timesteps = T;
+  labelsCount = labels.size();
+  yValues = labels;
+  // vector::resize does not release capacity, so no heap allocations after the longest sentence is seen
+  keptLabels.resize(timesteps * labelsCount);
+  stateOffsets.resize(timesteps + 1);
+  for(unsigned i = 0; i <= timesteps; ++i) {
+    stateOffsets[i] = i * labelsCount;
+  }
+  for(unsigned i = 0; i < timesteps; ++i) {
+    for(unsigned k = 0; k < labelsCount; ++k) {
+      keptLabels[i * labelsCount + k] = k;
+    }
+  }
+  Layout();
+}
+
+void DenseLattice::Resize(unsigned T, const vector<int> &labels, const vector<bool> &allowedStates) {
+  assert(allowedStates.size() == T * labels.size());
+  timesteps = T;
+  labelsCount = labels.size();
+  yValues = labels;
+  keptLabels.clear();
+  stateOffsets.resize(timesteps + 1);
+  stateOffsets[0] = 0;
+  for(unsigned i = 0; i < timesteps; ++i) {
+    for(unsigned k = 0; k < labelsCount; ++k) {
+      if(allowedStates[i * labelsCount + k]) {
+        keptLabels.push_back(k);
+      }
+    }
+    stateOffsets[i+1] = keptLabels.size();
+    assert(labelsCount == 0 || stateOffsets[i+1] > stateOffsets[i]);
+  }
+  Layout();
+}
+
+void DenseLattice::Layout() {
+  arcOffsets.resize(timesteps + 1);
+  arcOffsets[0] = 0;
+  for(unsigned i = 0; i < timesteps; ++i) {
+    arcOffsets[i+1] = arcOffsets[i] + PrevLabelsCount(i) * LabelsCount(i);
+  }
+  arcWeights.resize(arcOffsets[timesteps]);
+  alphas.resize(stateOffsets[timesteps]);
+  betas.resize(stateOffsets[timesteps]);
+  // the kernels work on rows of about as many values as labels are kept per timestep
+  kernels = &LogSumExp::Best(timesteps == 0? labelsCount : keptLabels.size() / timesteps);
+  nLogZ = numeric_limits<double>::infinity();
+  scaled = false;
+}
+
+void DenseLattice::CopyArcWeights(const DenseLattice &other) {
+  timesteps = other.timesteps;
+  labelsCount = other.labelsCount;
+  yValues = other.yValues;
+  independentPositions = other.independentPositions;
+  keptLabels = other.keptLabels;
+  stateOffsets = other.stateOffsets;
+  arcOffsets = other.arcOffsets;
+  arcWeights = other.arcWeights;
+  alphas.resize(keptLabels.size());
+  betas.resize(keptLabels.size());
+  kernels = other.kernels;
+  nLogZ = numeric_limits<double>::infinity();
+  scaled = false;
+}
+
+void DenseLattice::ComputePotentials() {
+  if(independentPositions) {
+    // already O(T.K); there is nothing to gain from scaling
+    scaled = false;
+    ComputeIndependentPotentials();
+    return;
+  }
+  scaled = useScaling && ComputeScaledPotentials();
+  if(!scaled) {
+    ComputeLogPotentials();
+  }
+}
+
+void DenseLattice::ComputeLogPotentials() {
+  const double INF = numeric_limits<double>::infinity();
+  if(timesteps == 0 || labelsCount == 0) {
+    nLogZ = INF;
+    return;
+  }
+
+  // forward pass
+  for(unsigned yI = 0; yI < LabelsCount(0); ++yI) {
+    alphas[yI] = ArcWeight(0, 0, yI);
+  }
+  for(unsigned i = 1; i < timesteps; ++i) {
+    // alpha_i[yI] = -log \sum_{yIM1} exp(-(alpha_{i-1}[yIM1] + w(i, yIM1, yI)))
+    kernels->NLogSumColumns(&alphas[stateOffsets[i-1]], &ArcWeight(i, 0, 0), LabelsCount(i-1), LabelsCount(i), 
+                            &alphas[stateOffsets[i]]);
+  }
+
+  // backward pass
+  for(unsigned yI = 0; yI < LabelsCount(timesteps-1); ++yI) {
+    betas[stateOffsets[timesteps-1] + yI] = 0.0;
+  }
+  for(int i = timesteps - 2; i >= 0; --i) {
+    const double *nextBetas = &betas[stateOffsets[i+1]];
+    double *currentBetas = &betas[stateOffsets[i]];
+    for(unsigned yI = 0; yI < LabelsCount(i); ++yI) {
+      // beta_i[yI] = -log \sum_{yIP1} exp(-(w(i+1, yI, yIP1) + beta_{i+1}[yIP1]))
+      currentBetas[yI] = kernels->NLogSumRow(&ArcWeight(i+1, yI, 0), nextBetas, LabelsCount(i+1));
+    }
+  }
+
+  // partition function
+  nLogZ = INF;
+  for(unsigned yI = 0; yI < LabelsCount(timesteps-1); ++yI) {
+    nLogZ = NLogPlus(nLogZ, alphas[stateOffsets[timesteps-1] + yI]);
+  }
+}
+
+void DenseLattice::ComputeIndependentPotentials() {
+  const double INF = numeric_limits<double>::infinity();
+  nLogZ = INF;
+  if(timesteps == 0 || labelsCount == 0) {
+    return;
+  }
+
+  // the normalizer of each position (one log-sum-exp over the labels kept at that position)
+  vector<double> nLogZs(timesteps), nLogPrefixes(timesteps), zeros(labelsCount, 0.0);
+  ForEachPositionRange([this, &nLogZs, &zeros] (unsigned first, unsigned last) {
+      for(unsigned i = first; i < last; ++i) {
+        nLogZs[i] = kernels->NLogSumRow(&ArcWeight(i, 0, 0), &zeros[0], LabelsCount(i));
+      }
+    });
+  nLogZ = 0.0;
+  for(unsigned i = 0; i < timesteps; ++i) {
+    nLogPrefixes[i] = nLogZ;
+    nLogZ += nLogZs[i];
+  }
+  if(std::isinf(nLogZ)) {
+    fill(alphas.begin(), alphas.end(), INF);
+    fill(betas.begin(), betas.end(), INF);
+    return;
+  }
+
+  // alpha_i[yI] = \sum_{j<i} nLogZ_j + w(i, yI), beta_i[yI] = \sum_{j>i} nLogZ_j,
+  // so that alpha_i + beta_i - nLogZ = w(i, yI) - nLogZ_i
+  ForEachPositionRange([this, &nLogZs, &nLogPrefixes] (unsigned first, unsigned last) {
+      for(unsigned i = first; i < last; ++i) {
+        for(unsigned yI = 0; yI < LabelsCount(i); ++yI) {
+          alphas[stateOffsets[i] + yI] = nLogPrefixes[i] + ArcWeight(i, 0, yI);
+          betas[stateOffsets[i] + yI] = nLogZ - nLogPrefixes[i] - nLogZs[i];
+        }
+      }
+    });
+}
+
+void DenseLattice::ForEachPositionRange(const function<void (unsigned first, unsigned last)> &process) const {
+  // starting a thread costs about as much as a few thousand log-sum-exp terms, so each thread 
+  // should get at least this many arcs
+  const unsigned MIN_ARCS_PER_THREAD = 16384;
+  unsigned threadsCount = min<unsigned>(positionThreads, arcOffsets[timesteps] / MIN_ARCS_PER_THREAD);
+  threadsCount = min(threadsCount, timesteps);
+  if(threadsCount <= 1) {
+    process(0, timesteps);
+    return;
+  }
+  boost::thread_group threads;
+  for(unsigned t = 1; t < threadsCount; ++t) {
+    unsigned first = timesteps * t / threadsCount, last = timesteps * (t + 1) / threadsCount;
+    threads.create_thread([&process, first, last] () { process(first, last); });
+  }
+  // the calling thread takes the first range
+  process(0, timesteps / threadsCount);
+  threads.join_all();
+}
+
+bool DenseLattice::ComputeScaledPotentials() {
+  // arc weights at the same timestep which differ by more than this would underflow
+  // (or lose all precision) when exponentiated
+  const double MAX_WEIGHTS_RANGE = 600.0;
+  if(timesteps == 0 || labelsCount == 0) {
+    return false;
+  }
+  arcProbs.resize(arcWeights.size());
+  scaledAlphas.resize(alphas.size());
+  scaledBetas.resize(betas.size());
+  scales.resize(timesteps);
+
+  // forward pass. nLogScales[i] = -log of the factor which normalizes alpha_i
+  vector<double> nLogScales(timesteps);
+  for(unsigned i = 0; i < timesteps; ++i) {
+    const unsigned K = LabelsCount(i), arcsCount = PrevLabelsCount(i) * K;
+    const double *weights = &ArcWeight(i, 0, 0);
+    double minWeight = numeric_limits<double>::infinity(), maxWeight = -numeric_limits<double>::infinity();
+    for(unsigned k = 0; k < arcsCount; ++k) {
+      if(std::isinf(weights[k])) { continue; }
+      minWeight = min(minWeight, weights[k]);
+      maxWeight = max(maxWeight, weights[k]);
+    }
+    if(std::isinf(minWeight) || maxWeight - minWeight > MAX_WEIGHTS_RANGE) {
+      return false;
+    }
+    double *probs = &arcProbs[arcOffsets[i]];
+    kernels->NExp(weights, minWeight, arcsCount, probs);
+
+    double *currentAlphas = &scaledAlphas[stateOffsets[i]];
+    if(i == 0) {
+      copy(probs, probs + K, currentAlphas);
+    } else {
+      const double *prevAlphas = &scaledAlphas[stateOffsets[i-1]];
+      fill(currentAlphas, currentAlphas + K, 0.0);
+      for(unsigned yIM1 = 0; yIM1 < PrevLabelsCount(i); ++yIM1) {
+        const double *row = probs + yIM1 * K;
+        for(unsigned yI = 0; yI < K; ++yI) {
+          currentAlphas[yI] += prevAlphas[yIM1] * row[yI];
+        }
+      }
+    }
+    double scale = 0.0;
+    for(unsigned yI = 0; yI < K; ++yI) {
+      scale += currentAlphas[yI];
+    }
+    if(!(scale >= numeric_limits<double>::min()) || std::isinf(scale)) {
+      return false;
+    }
+    for(unsigned yI = 0; yI < K; ++yI) {
+      currentAlphas[yI] /= scale;
+    }
+    scales[i] = scale;
+    nLogScales[i] = minWeight - log(scale);
+  }
+
+  // backward pass, normalized by the same factors
+  for(unsigned yI = 0; yI < LabelsCount(timesteps-1); ++yI) {
+    scaledBetas[stateOffsets[timesteps-1] + yI] = 1.0;
+  }
+  for(int i = timesteps - 2; i >= 0; --i) {
+    const unsigned nextK = LabelsCount(i+1);
+    const double *nextBetas = &scaledBetas[stateOffsets[i+1]];
+    const double *probs = &arcProbs[arcOffsets[i+1]];
+    double *currentBetas = &scaledBetas[stateOffsets[i]];
+    for(unsigned yI = 0; yI < LabelsCount(i); ++yI) {
+      const double *row = probs + yI * nextK;
+      double sum = 0.0;
+      for(unsigned yIP1 = 0; yIP1 < nextK; ++yIP1) {
+        sum += row[yIP1] * nextBetas[yIP1];
+      }
+      currentBetas[yI] = sum / scales[i+1];
+      if(std::isinf(currentBetas[yI])) {
+        return false;
+      }
+    }
+  }
+
+  // Z = \prod_i scale_i * exp(-minWeight_i)
+  nLogZ = 0.0;
+  for(unsigned i = 0; i < timesteps; ++i) {
+    nLogZ += nLogScales[i];
+  }
+
+  // -log alphas and betas, for the callers which need unnormalized marginals
+  double nLogPrefix = 0.0;
+  for(unsigned i = 0; i < timesteps; ++i) {
+    nLogPrefix += nLogScales[i];
+    for(unsigned k = stateOffsets[i]; k < stateOffsets[i+1]; ++k) {
+      alphas[k] = nLogPrefix - log(scaledAlphas[k]);
+      betas[k] = nLogZ - nLogPrefix - log(scaledBetas[k]);
+    }
+  }
+  return true;
+}
+
+double DenseLattice::Viterbi(vector<int> &labels) const {
+  const double INF = numeric_limits<double>::infinity();
+  labels.clear();
+  if(timesteps == 0 || labelsCount == 0) {
+    return INF;
+  }
+
+  // positions are decoded separately
+  if(independentPositions) {
+    double nLogBest = 0.0;
+    for(unsigned i = 0; i < timesteps; ++i) {
+      const double *weights = &ArcWeight(i, 0, 0);
+      unsigned bestYI = min_element(weights, weights + LabelsCount(i)) - weights;
+      labels.push_back(yValues[LabelIndex(i, bestYI)]);
+      nLogBest += weights[bestYI];
+    }
+    return nLogBest;
+  }
+
+  // deltas[stateOffsets[i]+yI] = -log weight of the best path prefix which ends with the yI-th label kept at i,
+  // backpointers[stateOffsets[i]+yI] = the (kept) label index of y_{i-1} on that prefix
+  vector<double> deltas(keptLabels.size());
+  vector<unsigned> backpointers(keptLabels.size(), 0);
+  for(unsigned yI = 0; yI < LabelsCount(0); ++yI) {
+    deltas[yI] = ArcWeight(0, 0, yI);
+  }
+  for(unsigned i = 1; i < timesteps; ++i) {
+    const unsigned K = LabelsCount(i);
+    const double *prevDeltas = &deltas[stateOffsets[i-1]];
+    double *currentDeltas = &deltas[stateOffsets[i]];
+    unsigned *currentBackpointers = &backpointers[stateOffsets[i]];
+    fill(currentDeltas, currentDeltas + K, INF);
+    // rows of the transition matrix are contiguous, so y_{i-1} is the outer loop
+    for(unsigned yIM1 = 0; yIM1 < PrevLabelsCount(i); ++yIM1) {
+      const double *row = &ArcWeight(i, yIM1, 0);
+      for(unsigned yI = 0; yI < K; ++yI) {
+        double candidate = prevDeltas[yIM1] + row[yI];
+        if(candidate < currentDeltas[yI]) {
+          currentDeltas[yI] = candidate;
+          currentBackpointers[yI] = yIM1;
+        }
+      }
+    }
+  }
+
+  // follow the backpointers from the best final label
+  const double *finalDeltas = &deltas[stateOffsets[timesteps-1]];
+  unsigned yI = min_element(finalDeltas, finalDeltas + LabelsCount(timesteps-1)) - finalDeltas;
+  double nLogBest = finalDeltas[yI];
+  labels.resize(timesteps);
+  for(int i = timesteps - 1; i >= 0; --i) {
+    labels[i] = yValues[LabelIndex(i, yI)];
+    yI = backpointers[stateOffsets[i] + yI];
+  }
+  return nLogBest;
+}
+
+void DenseLattice::ArcPosteriors(unsigned i, double *probs) const {
+  const unsigned K = LabelsCount(i);
+  if(scaled) {
+    // alpha_{i-1}[yIM1] * p(yIM1, yI) * beta_i[yI] / scale_i
+    const double *arcs = &arcProbs[arcOffsets[i]];
+    const double *currentBetas = &scaledBetas[stateOffsets[i]];
+    for(unsigned yIM1 = 0; yIM1 < PrevLabelsCount(i); ++yIM1) {
+      double prevAlpha = (i == 0? 1.0 : scaledAlphas[stateOffsets[i-1] + yIM1]) / scales[i];
+      for(unsigned yI = 0; yI < K; ++yI) {
+        probs[yIM1 * K + yI] = prevAlpha * arcs[yIM1 * K + yI] * currentBetas[yI];
+      }
+    }
+    return;
+  }
+  for(unsigned yIM1 = 0; yIM1 < PrevLabelsCount(i); ++yIM1) {
+    double *row = probs + yIM1 * K;
+    // -log marginals first, then exponentiate the whole row at once
+    for(unsigned yI = 0; yI < K; ++yI) {
+      row[yI] = NLogArcMarginal(i, yIM1, yI);
+    }
+    kernels->NExp(row, nLogZ, K, row);
+  }
+}
+
+void DenseLattice::StatePosteriors(unsigned i, double *probs) const {
+  const unsigned K = LabelsCount(i);
+  if(scaled) {
+    for(unsigned yI = 0; yI < K; ++yI) {
+      probs[yI] = scaledAlphas[stateOffsets[i] + yI] * scaledBetas[stateOffsets[i] + yI];
+    }
+    return;
+  }
+  for(unsigned yI = 0; yI < K; ++yI) {
+    probs[yI] = NLogStateMarginal(i, yI);
+  }
+  kernels->NExp(probs, nLogZ, K, probs);
+}
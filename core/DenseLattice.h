@@ -0,0 +1,177 @@
+#ifndef _DENSE_LATTICE_H_
+#define _DENSE_LATTICE_H_
+
+#include <vector>
+#include <cstddef>
+#include <assert.h>
+#include <math.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#include "LogSumExp.h"
+
+// a linear-chain lattice with T timesteps and K labels stored in contiguous arrays,
+// used as a replacement of fst::VectorFst<LogArc> + ShortestDistance() for computing
+// the forward/backward potentials of a LatentCrfModel.
+// all weights are -log values (i.e. the same representation used with FstUtils::LogWeight).
+// the lattice is meant to be reused across sentences; buffers only grow.
+// when independentPositions is set (i.e., consecutive labels are independent given x), each timestep
+// only has K arcs (from the start of sentence) and the lattice factorizes into T independent distributions.
+class DenseLattice {
+
+ public:
+
+  DenseLattice() : timesteps(0), labelsCount(0), independentPositions(false), 
+    useScaling(false), scaled(false), positionThreads(1), kernels(&LogSumExp::Best()) {}
+
+  // prepares the lattice for a sequence of length T. labels lists the values y_i may take
+  // (y_{-1} is implicitly the start of sentence). independentPositions must be set before calling Resize().
+  void Resize(unsigned T, const std::vector<int> &labels);
+
+  // same, but only keeps label k at timestep i if allowedStates[i*K+k] is set (see ArcFeatureTable::allowedStates).
+  // the lattice is compacted: label indexes passed to (and returned by) all other methods are positions among the
+  // labels kept at that timestep (see LabelIndex()), so the work is proportional to the number of kept arcs.
+  // at least one label must be kept at each timestep
+  void Resize(unsigned T, const std::vector<int> &labels, const std::vector<bool> &allowedStates);
+
+  // copies the arc weights and the kept labels of another lattice, but not its potentials
+  void CopyArcWeights(const DenseLattice &other);
+
+  // memory used by the arc weights and the kept labels
+  size_t ArcWeightsBytes() const {
+    return arcWeights.capacity() * sizeof(double) + 
+      (keptLabels.capacity() + stateOffsets.capacity() + arcOffsets.capacity()) * sizeof(unsigned);
+  }
+
+  // number of labels kept at timestep i
+  inline unsigned LabelsCount(unsigned i) const {
+    return stateOffsets[i+1] - stateOffsets[i];
+  }
+
+  // the index (in yValues) of the k-th label kept at timestep i
+  inline unsigned LabelIndex(unsigned i, unsigned k) const {
+    return keptLabels[stateOffsets[i] + k];
+  }
+
+  // the index (in yValues) of the k-th label y_{i-1} considered at timestep i (zero for the start of sentence)
+  inline unsigned PrevLabelIndex(unsigned i, unsigned k) const {
+    return i == 0 || independentPositions? 0 : LabelIndex(i-1, k);
+  }
+
+  // -log of the weight of the arc (y_{i-1}, y_i) at timestep i.
+  // at timestep 0 (and at all timesteps with independentPositions), yIM1Index must be zero.
+  inline double& ArcWeight(unsigned i, unsigned yIM1Index, unsigned yIIndex) {
+    return arcWeights[arcOffsets[i] + yIM1Index * LabelsCount(i) + yIIndex];
+  }
+  inline const double& ArcWeight(unsigned i, unsigned yIM1Index, unsigned yIIndex) const {
+    return arcWeights[arcOffsets[i] + yIM1Index * LabelsCount(i) + yIIndex];
+  }
+
+  // number of y_{i-1} values to consider at timestep i
+  inline unsigned PrevLabelsCount(unsigned i) const {
+    return i == 0 || independentPositions? 1 : LabelsCount(i-1);
+  }
+
+  // computes alphas and betas. must be called after all arc weights are set.
+  // when useScaling is set, the potentials are computed in probability space with per-timestep
+  // scaling factors, falling back to the log semiring if the sentence would underflow.
+  void ComputePotentials();
+
+  // -log \sum_{paths} \prod_{arcs} weight
+  // this is Z(x) for lambda lattices and C(x,z) for theta-lambda lattices
+  inline double NLogZ() const { return nLogZ; }
+
+  // -log of the total weight of paths which go through arc (y_{i-1}, y_i) at timestep i
+  inline double NLogArcMarginal(unsigned i, unsigned yIM1Index, unsigned yIIndex) const {
+    if(independentPositions) { return NLogStateMarginal(i, yIIndex); }
+    double nLogAlphaIM1 = i == 0? 0.0 : alphas[stateOffsets[i-1] + yIM1Index];
+    return nLogAlphaIM1 + ArcWeight(i, yIM1Index, yIIndex) + betas[stateOffsets[i] + yIIndex];
+  }
+
+  // -log of the total weight of paths which go through label y_i at timestep i
+  inline double NLogStateMarginal(unsigned i, unsigned yIIndex) const {
+    return alphas[stateOffsets[i] + yIIndex] + betas[stateOffsets[i] + yIIndex];
+  }
+
+  // max-product (min-sum over -log weights) decoding. labels gets the values of y_i along the best path,
+  // and its -log weight is returned. does not require ComputePotentials()
+  double Viterbi(std::vector<int> &labels) const;
+
+  // probabilities of the arcs at timestep i (given the lattice), indexed as yIM1Index * LabelsCount(i) + yIIndex.
+  // probs must have room for PrevLabelsCount(i) * LabelsCount(i) values
+  void ArcPosteriors(unsigned i, double *probs) const;
+
+  // probabilities of the labels at timestep i (given the lattice). probs must have room for LabelsCount(i) values
+  void StatePosteriors(unsigned i, double *probs) const;
+
+  // -log(exp(-a) + exp(-b)), i.e. fst::Plus() in the log semiring
+  static inline double NLogPlus(double a, double b) {
+    if(a > b) { std::swap(a, b); }
+    if(std::isinf(b)) { return a; }
+    return a - log1p(exp(a - b));
+  }
+
+ private:
+  void ComputeLogPotentials();
+
+  // O(T.K) potentials of a lattice with independentPositions
+  void ComputeIndependentPotentials();
+
+  // calls process(first, last) on consecutive ranges of timesteps which cover [0, T), from up to 
+  // positionThreads threads (fewer for small lattices)
+  void ForEachPositionRange(const std::function<void (unsigned first, unsigned last)> &process) const;
+
+  // returns false (without computing nLogZ) if some probability would underflow
+  bool ComputeScaledPotentials();
+
+  // sets arcOffsets and sizes the buffers, once stateOffsets and keptLabels are set
+  void Layout();
+
+ public:
+  unsigned timesteps, labelsCount;
+
+  // values of y_i which correspond to label indexes 0..K-1
+  std::vector<int> yValues;
+
+  // the labels kept at timestep i are yValues[keptLabels[stateOffsets[i]..stateOffsets[i+1])] (T + 1 offsets)
+  std::vector<unsigned> keptLabels, stateOffsets;
+
+  // the arcs of timestep i are arcWeights[arcOffsets[i]..arcOffsets[i+1]), i.e. PrevLabelsCount(i) x LabelsCount(i)
+  // (T x K x K, or T x K with independentPositions, when nothing is pruned)
+  std::vector<double> arcWeights;
+  std::vector<unsigned> arcOffsets;
+
+  // y_i does not depend on y_{i-1}
+  bool independentPositions;
+
+  // alphas[stateOffsets[i]+k] = -log of the total weight of path prefixes which end with y_i = yValues[LabelIndex(i, k)]
+  std::vector<double> alphas;
+
+  // betas[stateOffsets[i]+k] = -log of the total weight of path suffixes which start after y_i = yValues[LabelIndex(i, k)]
+  std::vector<double> betas;
+
+  double nLogZ;
+
+  // compute the potentials in probability space (see ComputePotentials())
+  bool useScaling;
+
+  // true if the last ComputePotentials() actually used scaling
+  bool scaled;
+
+  // when scaled: arcProbs (indexed as arcWeights) = exp(-arcWeight + min_{arcs at i} arcWeight),
+  // scaledAlphas/scaledBetas are the forward/backward probabilities normalized at each timestep
+  // by scales[i], following Rabiner (1989)
+  std::vector<double> arcProbs, scaledAlphas, scaledBetas, scales;
+
+  // with independentPositions, ComputePotentials() may split the timesteps of a large lattice among this many
+  // threads. only set it above 1 when the caller isn't already running one sentence per thread
+  unsigned positionThreads;
+
+  // log-sum-exp implementation used for the forward/backward passes and the posteriors. Resize() picks it 
+  // according to the number of labels kept per timestep (see LogSumExp::Best(K))
+  const LogSumExp::Kernels *kernels;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _FACTOR_FEATURES_CACHE_H_
+#define _FACTOR_FEATURES_CACHE_H_
+
+#include <list>
+#include <utility>
+#include <iostream>
+#include <boost/unordered_map.hpp>
+
+#include "../cdec-utils/fast_sparse_vector.h"
+
+// a bounded map from factor ids to the active features they fire. when full, the least recently used
+// factor is evicted. counts hits and misses so that the capacity can be tuned
+template <class FactorId, class Hash, class Equal>
+class FactorFeaturesCache {
+
+ public:
+  typedef std::pair<FactorId, FastSparseVector<double> > Entry;
+  typedef typename std::list<Entry>::iterator iterator;
+
+  FactorFeaturesCache() : capacity(0), hits(0), misses(0), evictions(0) {}
+
+  void SetCapacity(size_t capacity) {
+    this->capacity = capacity;
+    while(entries.size() > capacity) { Evict(); }
+  }
+
+  // returns 0 if factorId is not cached
+  const FastSparseVector<double>* Find(const FactorId &factorId) {
+    auto indexIter = index.find(factorId);
+    if(indexIter == index.end()) {
+      ++misses;
+      return 0;
+    }
+    ++hits;
+    // move to the front of the recency list
+    entries.splice(entries.begin(), entries, indexIter->second);
+    return &indexIter->second->second;
+  }
+
+  void Insert(const FactorId &factorId, const FastSparseVector<double> &activeFeatures) {
+    if(capacity == 0 || index.find(factorId) != index.end()) {
+      return;
+    }
+    if(entries.size() >= capacity) {
+      Evict();
+    }
+    entries.push_front(Entry(factorId, activeFeatures));
+    index[factorId] = entries.begin();
+  }
+
+  void Clear() {
+    entries.clear();
+    index.clear();
+  }
+
+  size_t size() const { return entries.size(); }
+  iterator begin() { return entries.begin(); }
+  iterator end() { return entries.end(); }
+
+  void PrintStats(std::ostream &os) const {
+    size_t lookups = hits + misses;
+    os << "factor features cache: " << entries.size() << "/" << capacity << " factors, " << hits << " hits out of " <<
+      lookups << " lookups (" << (lookups? 100.0 * hits / lookups : 0.0) << "%), " << evictions << " evictions" << std::endl;
+  }
+
+ private:
+  void Evict() {
+    index.erase(entries.back().first);
+    entries.pop_back();
+    ++evictions;
+  }
+
+  size_t capacity;
+  // most recently used first
+  std::list<Entry> entries;
+  boost::unordered_map<FactorId, iterator, Hash, Equal> index;
+  size_t hits, misses, evictions;
+};
+
+#endif
@@ -23,6 +23,7 @@ HmmModel2::HmmModel2(const string &textFilename,
   yDomain.insert(START_OF_SENTENCE_Y_VALUE); // the conceptual yValue of word at position -1 in a sentence
   for(unsigned labelId = START_OF_SENTENCE_Y_VALUE + 1; labelId < START_OF_SENTENCE_Y_VALUE + numberOfLabels + 1 ; labelId++) {
     yDomain.insert(labelId);
+    yLabels.push_back(labelId);
   }
 
   // populate the X domain with all types in the vocabEncoder
@@ -80,137 +81,74 @@ void HmmModel2::PersistParams(string &prefix) {
   MultinomialParams::PersistParams(gammaFilename, nlogGamma, vocabEncoder, false, false);
 }
 
-// builds the lattice of all possible label sequences
-void HmmModel2::BuildThetaGammaFst(vector<int64_t> &x, VectorFst<FstUtils::LogArc> &fst) {
-  // arcs represent a particular choice of y_i at time step i
-  // arc weights are - log \theta_{x_i|y_i} - log \gamma_{y_i|y_{i-1}}
-  assert(fst.NumStates() == 0);
-  int startState = fst.AddState();
-  fst.SetStart(startState);
-  
-  // map values of y_{i-1} and y_i to fst states
-  map<int, int> yIM1ToState, yIToState;
-
-  yIM1ToState[START_OF_SENTENCE_Y_VALUE] = startState;
-
-  // for each timestep
-  for(int i = 0; i < x.size(); i++){
-
-    // timestep i hasn't reached any states yet
-    yIToState.clear();
-    // from each state reached in the previous timestep
-    for(map<int, int>::const_iterator prevStateIter = yIM1ToState.begin();
-	prevStateIter != yIM1ToState.end();
-	prevStateIter++) {
-      
-      int fromState = prevStateIter->second;
-      int yIM1 = prevStateIter->first;
-      // to each possible value of y_i
-      for(set<int>::const_iterator yDomainIter = yDomain.begin();
-	  yDomainIter != yDomain.end();
-	  yDomainIter++) {
-
-	int yI = *yDomainIter;
-
-	// START_OF_SENTENCE_Y_VALUE can only be used for the hypothetical y_{i-1}, so skip it.
-	if(yI == START_OF_SENTENCE_Y_VALUE) {
-	  continue;
-	}
+// same as params[context][event], but does not insert missing entries (they are zero)
+double HmmModel2::Lookup(const MultinomialParams::ConditionalMultinomialParam<int64_t> &params, int64_t context, int64_t event) {
+  auto contextIter = params.params.find(context);
+  if(contextIter == params.params.end()) {
+    return 0.0;
+  }
+  auto eventIter = contextIter->second.find(event);
+  return eventIter == contextIter->second.end()? 0.0 : eventIter->second;
+}
 
-	// compute arc weight
-	double arcWeight = nlogGamma[yIM1][yI] + nlogTheta[yI][x[i]];
-	if(arcWeight < 0 || std::isinf(arcWeight) || std::isnan(arcWeight)) {
-	  cerr << "FATAL ERROR: arcWeight = " << arcWeight << endl << "will terminate." << endl;
-	}
-	
-	// determine whether to add a new state or reuse an existing state which also represent label y_i and timestep i
-	int toState;	
-	if(yIToState.count(yI) == 0) {
-	  toState = fst.AddState();
-	  yIToState[yI] = toState;
-	  // is it a final state?
-	  if(i == x.size() - 1) {
-	    fst.SetFinal(toState, FstUtils::LogWeight::One());
-	  }
-	} else {
-	  toState = yIToState[yI];
-	}
-	// now add the arc
-	fst.AddArc(fromState, FstUtils::LogArc(yIM1, yI, arcWeight, toState));	
+// fills the arc weights of a dense lattice of all possible label sequences (no potentials).
+// parameters are only read, so this may be called from several threads
+void HmmModel2::BuildThetaGammaLattice(const vector<int64_t> &x, DenseLattice &lattice) {
+  lattice.Resize(x.size(), yLabels);
+  for(unsigned i = 0; i < x.size(); i++) {
+    for(unsigned yIM1Index = 0; yIM1Index < lattice.PrevLabelsCount(i); yIM1Index++) {
+      int yIM1 = i == 0? START_OF_SENTENCE_Y_VALUE : yLabels[yIM1Index];
+      for(unsigned yIIndex = 0; yIIndex < yLabels.size(); yIIndex++) {
+        int yI = yLabels[yIIndex];
+        // - log \theta_{x_i|y_i} - log \gamma_{y_i|y_{i-1}}
+        double arcWeight = Lookup(nlogGamma, yIM1, yI) + Lookup(nlogTheta, yI, x[i]);
+        if(arcWeight < 0 || std::isinf(arcWeight) || std::isnan(arcWeight)) {
+          cerr << "FATAL ERROR: arcWeight = " << arcWeight << endl << "will terminate." << endl;
+        }
+        lattice.ArcWeight(i, yIM1Index, yIIndex) = arcWeight;
       }
     }
-    // now, that all states reached in step i have already been created, yIM1ToState has become out-of-date. update it
-    yIM1ToState = yIToState;
   }
 }
 
-// builds the lattice of all possible label sequences, also computes potentials
-void HmmModel2::BuildThetaGammaFst(unsigned sentId, VectorFst<FstUtils::LogArc> &fst, vector<FstUtils::LogWeight> &alphas, vector<FstUtils::LogWeight> &betas) {
-
-  // first, build the lattice
-  BuildThetaGammaFst(observations[sentId], fst);
-
-  // then compute forward/backward state potentials
-  assert(alphas.size() == 0);
-  assert(betas.size() == 0);
-  ShortestDistance(fst, &alphas, false);
-  ShortestDistance(fst, &betas, true);
-}
-
+// assumptions:
+// - lattice is populated using BuildThetaGammaLattice(observations[sentId], lattice)
+// - lattice.ComputePotentials() has been called
 void HmmModel2::UpdateMle(const unsigned sentId,
-			  const VectorFst<FstUtils::LogArc> &fst, 
-			  const vector<FstUtils::LogWeight> &alphas, 
-			  const vector<FstUtils::LogWeight> &betas, 
+			  const DenseLattice &lattice,
 			  ConditionalMultinomialParam<int64_t> &thetaMle, 
 			  ConditionalMultinomialParam<int64_t> &gammaMle){
-  vector<int64_t> &x = observations[sentId];
+  const vector<int64_t> &x = observations[sentId];
+  vector<double> stateProbs, arcProbs;
  
-  // schedule for visiting states such that we know the timestep for each arc
-  set<int> iStates, iP1States;
-  iStates.insert(fst.Start());
-
   // for each timestep
-  for(int i = 0; i < x.size(); i++) {
-    int xI = x[i];
-    
-    // from each state at timestep i
-    for(set<int>::const_iterator iStatesIter = iStates.begin(); 
-	iStatesIter != iStates.end(); 
-	iStatesIter++) {
-      int fromState = *iStatesIter;
-
-      // for each arc leaving this state
-      for(ArcIterator< VectorFst<FstUtils::LogArc> > aiter(fst, fromState); !aiter.Done(); aiter.Next()) {
-	const FstUtils::LogArc &arc = aiter.Value();
-	int yIM1 = arc.ilabel;
-	int yI = arc.olabel;
-	const FstUtils::LogWeight &arcWeight = arc.weight;
-	int toState = arc.nextstate;
+  for(unsigned i = 0; i < x.size(); i++) {
+    int64_t xI = x[i];
+    const unsigned labelsCount = lattice.LabelsCount(i);
+
+    // emissions are weighted by the label marginals
+    stateProbs.resize(labelsCount);
+    lattice.StatePosteriors(i, &stateProbs[0]);
+    for(unsigned yIIndex = 0; yIIndex < labelsCount; yIIndex++) {
+      double prob = stateProbs[yIIndex];
+      if(std::isinf(prob) || std::isnan(prob)) {
+	cerr << "FATAL ERROR: prob = " << prob << " at timestep " << i << " of sent #" << sentId << endl << "will terminate." << endl;
+	assert(false);
+      }
+      thetaMle[yLabels[lattice.LabelIndex(i, yIIndex)]][xI] += prob;
+    }
 
-	// compute marginal weight of passing on this arc
-	const FstUtils::LogWeight nlogWeight(fst::Times(arcWeight , fst::Times(betas[toState], alphas[fromState])));
-	double nlogProb = fst::Divide(nlogWeight, betas[0]).Value();
-	if(nlogProb < -1.0 || std::isinf(nlogProb) || std::isnan(nlogProb)) {
-	  cerr << "FATAL ERROR: nlogProb = " << nlogProb << " = alpha + arcWeight + beta - betas[0] = " << alphas[fromState].Value() << " + " << arcWeight.Value() << " + " << betas[toState].Value() << " - " << betas[0].Value() << endl << "will terminate." << endl;
-	  assert(false);
-	}
-	// fix precision problems
-	if(nlogProb < 0) {
-	  nlogProb = 0;
-	}
-	double prob = MultinomialParams::nExp(nlogProb);
+    // transitions are weighted by the arc marginals
+    arcProbs.resize(lattice.PrevLabelsCount(i) * labelsCount);
+    lattice.ArcPosteriors(i, &arcProbs[0]);
+    for(unsigned yIM1Index = 0; yIM1Index < lattice.PrevLabelsCount(i); yIM1Index++) {
+      int yIM1 = i == 0? START_OF_SENTENCE_Y_VALUE : yLabels[lattice.PrevLabelIndex(i, yIM1Index)];
+      for(unsigned yIIndex = 0; yIIndex < labelsCount; yIIndex++) {
+	double prob = arcProbs[yIM1Index * labelsCount + yIIndex];
 	assert( !std::isinf(prob) && !std::isnan(prob) );
-	thetaMle[yI][xI] += prob;
-	gammaMle[yIM1][yI] += prob;
-	
-	// prepare the schedule for visiting states in the next timestep
-	iP1States.insert(toState);
-      } 
+	gammaMle[yIM1][yLabels[lattice.LabelIndex(i, yIIndex)]] += prob;
+      }
     }
-    
-    // prepare for next timestep
-    iStates = iP1States;
-    iP1States.clear();
   }
 }
 
@@ -222,16 +160,13 @@ void HmmModel2::Train(){
     double nloglikelihood = 0;
     ConditionalMultinomialParam<int64_t> thetaMle, gammaMle;
     for(unsigned sentId = 0; sentId < observations.size(); sentId++) {
-      VectorFst<FstUtils::LogArc> fst;
-      vector<FstUtils::LogWeight> alphas, betas; 
-      BuildThetaGammaFst(sentId, fst, alphas, betas);
-      UpdateMle(sentId, fst, alphas, betas, thetaMle, gammaMle);
-      double sentNlogProb = betas[0].Value();
+      DenseLattice lattice;
+      BuildThetaGammaLattice(observations[sentId], lattice);
+      lattice.ComputePotentials();
+      UpdateMle(sentId, lattice, thetaMle, gammaMle);
+      double sentNlogProb = lattice.NLogZ();
       if(sentNlogProb < -0.01) {
 	cerr << "FATAL ERROR: sentNlogProb = " << sentNlogProb << " in sent #" << sentId << endl << "will terminate." << endl;
-	for(unsigned stateId = 0; stateId < betas.size(); stateId++) {
-	  cerr << "statedId = " << stateId << ", alpha = " << alphas[stateId] << ", beta = " << betas[stateId] << endl;
-	}
 	assert(false);
       }
       if(learningInfo->debugLevel >= DebugLevel::SENTENCE) {
@@ -263,13 +198,8 @@ void HmmModel2::Train(){
 
 void HmmModel2::Label(vector<int64_t> &tokens, vector<int> &labels) {
   //cerr << "inside HmmModel2::Label(vector<int64_t> &tokens, vector<int> &labels)" << endl;
-  VectorFst<FstUtils::LogArc> fst;
-  BuildThetaGammaFst(tokens, fst);
-
-  VectorFst<FstUtils::StdArc> fst2, shortestPath;
-  fst::ArcMap(fst, &fst2, FstUtils::LogToTropicalMapper());
-  fst::ShortestPath(fst2, &shortestPath);
-  std::vector<int> dummy;
-  FstUtils::LinearFstToVector(shortestPath, dummy, labels);
+  DenseLattice lattice;
+  BuildThetaGammaLattice(tokens, lattice);
+  lattice.Viterbi(labels);
   assert(labels.size() == tokens.size());
 }
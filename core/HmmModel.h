@@ -24,6 +24,7 @@
 #include "../wammar-utils/Samplers.h"
 #include "MultinomialParams.h"
 #include "UnsupervisedSequenceTaggingModel.h"
+#include "DenseLattice.h"
 
 class HmmModel2 : public UnsupervisedSequenceTaggingModel {
 
@@ -33,17 +34,15 @@ class HmmModel2 : public UnsupervisedSequenceTaggingModel {
   // zero all parameters
   void ClearFractionalCounts();
 
-  // builds the lattice of all possible label sequences
-  void BuildThetaGammaFst(vector<int64_t> &x, fst::VectorFst<FstUtils::LogArc> &fst);
-  
-  // builds the lattice of all possible label sequences, also computes potentials
-  void BuildThetaGammaFst(unsigned sentId, fst::VectorFst<FstUtils::LogArc> &fst, vector<FstUtils::LogWeight> &alphas, vector<FstUtils::LogWeight> &betas);
+  // fills the arc weights of a dense lattice of all possible label sequences (no potentials)
+  void BuildThetaGammaLattice(const vector<int64_t> &x, DenseLattice &lattice);
+
+  // read-only params[context][event]
+  static double Lookup(const MultinomialParams::ConditionalMultinomialParam<int64_t> &params, int64_t context, int64_t event);
   
-  // traverse each transition on the fst and accumulate the mle counts of theta and gamma
+  // visit each label and transition on the lattice and accumulate the mle counts of theta and gamma
   void UpdateMle(const unsigned sentId,
-		 const fst::VectorFst<FstUtils::LogArc> &fst, 
-		 const vector<FstUtils::LogWeight> &alphas, 
-		 const vector<FstUtils::LogWeight> &betas, 
+		 const DenseLattice &lattice,
 		 MultinomialParams::ConditionalMultinomialParam<int64_t> &thetaMle, 
 		 MultinomialParams::ConditionalMultinomialParam<int64_t> &gammaMle);
  
@@ -63,6 +62,9 @@ class HmmModel2 : public UnsupervisedSequenceTaggingModel {
   
   using UnsupervisedSequenceTaggingModel::Label;
   void Label(vector<int64_t> &tokens, vector<int> &labels);
+
+  // Label() only reads the parameters
+  bool LabelIsThreadSafe() { return true; }
   
   // configurations
   LearningInfo *learningInfo;
@@ -85,6 +87,9 @@ class HmmModel2 : public UnsupervisedSequenceTaggingModel {
   set<int64_t> xDomain;
   set<int> yDomain;
 
+  // the values y_i may take (i.e. yDomain without START_OF_SENTENCE_Y_VALUE), in the order of the lattice labels
+  vector<int> yLabels;
+
  public:
   // model parameters theta = emission probabilities, alpha = transition prbailibities
   MultinomialParams::ConditionalMultinomialParam<int64_t> nlogTheta, nlogGamma;
@@ -98,6 +98,11 @@ LatentCrfModel::LatentCrfModel(const string &textFilename,
     // by default, we are operating in the training (not testing) mode
     testingMode = false;
 
+    // nothing is cached yet
+    lambdaVersion = 1;
+    lambdaCacheBytes = 0;
+    sentencesSeconds = 0.0;
+
     // what task is this core being used for? pos tagging? word alignment?
     this->task = task;
   }
@@ -572,8 +577,11 @@ double LatentCrfModel::GetNLogTheta(int yi, int64_t zi, unsigned exampleId) {
         cerr << " " << contextIter->first << endl;
       }
     }
-    assert(nLogThetaGivenOneLabel.params.count( srcSent[yi] ) > 0);
-    return nLogThetaGivenOneLabel[ srcSent[yi] ][zi];
+    // look up without operator[], which inserts missing entries, so that sentences can be processed concurrently
+    auto contextIter = nLogThetaGivenOneLabel.params.find( srcSent[yi] );
+    assert(contextIter != nLogThetaGivenOneLabel.params.end());
+    auto eventIter = contextIter->second.find(zi);
+    return eventIter == contextIter->second.end()? 0.0 : eventIter->second;
   } else {
     exit(1);
   }
@@ -693,6 +701,431 @@ void LatentCrfModel::BuildThetaLambdaFst(unsigned sentId, const vector<int64_t>
 
 }
 
+// with dense lattices, the non-markovian model reduces to T independent distributions (see 
+// DenseLattice::independentPositions)
+bool LatentCrfModel::UseDenseLattices() const {
+  return learningInfo.useDenseLattices;
+}
+
+void LatentCrfModel::PartitionSentences() {
+  unsigned ranksCount = learningInfo.mpiWorld->size();
+  // forward-backward visits T x K x K arcs (T x K states when consecutive labels are independent)
+  vector<double> costs(examplesCount);
+  vector<int> labels;
+  for(unsigned sentId = 0; sentId < examplesCount; ++sentId) {
+    GetLatticeLabels(sentId, labels);
+    double labelsCount = labels.size();
+    costs[sentId] = GetObservableSequence(sentId).size() * labelsCount * 
+      (learningInfo.hiddenSequenceIsMarkovian? labelsCount : 1.0);
+  }
+  if(learningInfo.balanceSentencesByCost) {
+    sentencePartition.Build(costs, ranksCount);
+  } else {
+    sentencePartition.BuildRoundRobin(examplesCount, ranksCount);
+  }
+
+  // debug info
+  if(learningInfo.mpiWorld->rank() == 0) {
+    SentencePartition roundRobin;
+    roundRobin.BuildRoundRobin(examplesCount, ranksCount);
+    vector<double> loads = sentencePartition.Loads(costs);
+    cerr << "master" << learningInfo.mpiWorld->rank() << ": estimated load imbalance (max/mean lattice cost) = " 
+         << SentencePartition::Imbalance(loads) << ", vs. " << SentencePartition::Imbalance(roundRobin.Loads(costs)) 
+         << " with round-robin" << endl;
+    if(learningInfo.debugLevel >= DebugLevel::MINI_BATCH) {
+      for(unsigned rank = 0; rank < ranksCount; ++rank) {
+        cerr << "rank #" << rank << ": estimated lattice cost = " << loads[rank] << endl;
+      }
+    }
+  }
+}
+
+bool LatentCrfModel::IsMySentence(unsigned sentId) const {
+  return sentencePartition.Rank(sentId) == (unsigned)learningInfo.mpiWorld->rank();
+}
+
+void LatentCrfModel::ReportSentenceLoads() {
+  int ranksCount = learningInfo.mpiWorld->size();
+  vector<double> seconds(ranksCount, 0.0);
+  MPI_Gather(&sentencesSeconds, 1, MPI_DOUBLE, &seconds[0], 1, MPI_DOUBLE, 0, *learningInfo.mpiWorld);
+  sentencesSeconds = 0.0;
+  if(learningInfo.mpiWorld->rank() == 0) {
+    cerr << "master" << learningInfo.mpiWorld->rank() << ": load imbalance (max/mean seconds spent on sentences) = " 
+         << SentencePartition::Imbalance(seconds) << endl;
+    if(learningInfo.debugLevel >= DebugLevel::MINI_BATCH) {
+      for(int rank = 0; rank < ranksCount; ++rank) {
+        cerr << "rank #" << rank << ": " << seconds[rank] << " seconds spent on sentences" << endl;
+      }
+    }
+  }
+}
+
+unsigned LatentCrfModel::SentenceThreadsCount() const {
+  if(learningInfo.threadsPerRank <= 1 || testingMode || !UseDenseLattices() || 
+     !learningInfo.compileFeatures || !lambda->IsSealed()) {
+    return 1;
+  }
+  return learningInfo.threadsPerRank;
+}
+
+unsigned LatentCrfModel::PositionThreadsCount() const {
+  return SentenceThreadsCount() > 1? 1 : max(1u, learningInfo.threadsPerRank);
+}
+
+LatentCrfModel::SentenceWorkspace& LatentCrfModel::GetWorkspace(unsigned threadId) {
+  return threadId == 0? workspace : threadWorkspaces[threadId - 1];
+}
+
+void LatentCrfModel::ProcessSentences(const vector<unsigned> &sentIds, unsigned threadsCount, 
+                                      const std::function<void (unsigned sentId, unsigned threadId)> &process) {
+  auto startTime = std::chrono::steady_clock::now();
+  threadsCount = min<unsigned>(threadsCount, sentIds.size());
+  if(threadsCount <= 1) {
+    for(auto sentId = sentIds.begin(); sentId != sentIds.end(); ++sentId) {
+      process(*sentId, 0);
+    }
+    sentencesSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return;
+  }
+  if(threadWorkspaces.size() < threadsCount - 1) {
+    threadWorkspaces.resize(threadsCount - 1);
+  }
+  // each thread keeps taking the next unprocessed sentence
+  std::atomic<unsigned> next(0);
+  boost::thread_group threads;
+  for(unsigned threadId = 0; threadId < threadsCount; ++threadId) {
+    threads.create_thread([&sentIds, &process, &next, threadId] () {
+        for(unsigned i = next++; i < sentIds.size(); i = next++) {
+          process(sentIds[i], threadId);
+        }
+      });
+  }
+  threads.join_all();
+  sentencesSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void LatentCrfModel::CompileFeatures() {
+  assert(lambda->IsSealed() && UseDenseLattices());
+  compiledFeatures.Clear();
+  bool sharedTransitions = learningInfo.hiddenSequenceIsMarkovian && 
+    lambda->HasEnabledTemplates(FeatureTemplateSubset::LABEL_PAIR) && 
+    lambda->LabelPairTemplatesArePositionIndependent();
+  ArcFeatureTable unprunedArcFeatures;
+  for(unsigned sentId = 0; sentId < examplesCount; ++sentId) {
+    // skip sentences not assigned to this process
+    if(!IsMySentence(sentId)) {
+      continue;
+    }
+    lambda->learningInfo->currentSentId = sentId;
+    // all labels are compiled, since different labels may be pruned in later iterations
+    BuildArcFeatureTable(sentId, unprunedArcFeatures, false);
+    compiledFeatures.Add(sentId, unprunedArcFeatures, sharedTransitions);
+  }
+  if(learningInfo.mpiWorld->rank() == 0) {
+    cerr << "master" << learningInfo.mpiWorld->rank() << ": compiled features use " << 
+      compiledFeatures.Bytes() / 1024 / 1024 << " MB" << endl;
+  }
+}
+
+void LatentCrfModel::LambdaChanged() {
+  ++lambdaVersion;
+}
+
+void LatentCrfModel::CacheLambdaQuantities(unsigned sentId, const DenseLattice *lambdaLattice, double nLogZ) {
+  boost::mutex::scoped_lock lock(lambdaCacheMutex);
+  LambdaCacheEntry &cached = lambdaCache[sentId];
+  cached.lambdaVersion = lambdaVersion;
+  cached.nLogZ = nLogZ;
+  // stale arc weights are overwritten (or released, if the new ones do not fit)
+  if(cached.hasLattice) {
+    lambdaCacheBytes -= cached.lattice.ArcWeightsBytes();
+    cached.hasLattice = false;
+  }
+  cached.lattice = DenseLattice();
+  if(lambdaLattice == 0) {
+    return;
+  }
+  size_t budget = (size_t)learningInfo.lambdaCacheMegabytes * 1024 * 1024;
+  if(lambdaCacheBytes + lambdaLattice->ArcWeightsBytes() > budget) {
+    return;
+  }
+  cached.lattice.CopyArcWeights(*lambdaLattice);
+  cached.hasLattice = true;
+  lambdaCacheBytes += cached.lattice.ArcWeightsBytes();
+}
+
+void LatentCrfModel::GetLatticeLabels(unsigned sentId, vector<int> &labels) {
+  PrepareExample(sentId);
+  labels.clear();
+  for(auto yDomainIter = yDomain.begin(); yDomainIter != yDomain.end(); ++yDomainIter) {
+    // skip special classes
+    if(*yDomainIter == LatentCrfModel::START_OF_SENTENCE_Y_VALUE || *yDomainIter == END_OF_SENTENCE_Y_VALUE) {
+      continue;
+    }
+    labels.push_back(*yDomainIter);
+  }
+}
+
+// fires the features of each arc in the dense lattice of this sentence exactly once,
+// and stores them along with the arc score \lambda h(y_i, y_{i-1}, x, i).
+// the potentials are decomposed into emissions and transitions: features which only depend
+// on y_i are fired once per state (T x K) rather than once per arc (T x K x K), and features
+// which depend on y_{i-1} but not on the position are fired once per sentence (K x K).
+void LatentCrfModel::BuildArcFeatureTable(unsigned sentId, ArcFeatureTable &arcFeatures, bool prune) {
+  const vector<int64_t> &x = GetObservableSequence(sentId);
+  vector<int> labels;
+  GetLatticeLabels(sentId, labels);
+  arcFeatures.Resize(x.size(), labels, !learningInfo.hiddenSequenceIsMarkovian);
+  if(prune) {
+    PruneLatticeLabels(sentId, arcFeatures);
+  }
+  const vector<bool> &allowed = arcFeatures.allowedStates;
+
+  // the features of training sentences may have been resolved to parameter indexes already
+  if(!testingMode && compiledFeatures.Has(sentId)) {
+    compiledFeatures.Fill(sentId, *lambda, arcFeatures);
+    return;
+  }
+
+  PrepareExample(sentId);
+  FastSparseVector<double> h;
+
+  // consecutive labels are independent: all features are emissions h(y_i, x, i), and every position
+  // is treated as the beginning of a sentence
+  if(!learningInfo.hiddenSequenceIsMarkovian) {
+    for(unsigned i = 0; i < x.size(); ++i) {
+      for(unsigned yIIndex = 0; yIIndex < labels.size(); ++yIIndex) {
+        if(!allowed[arcFeatures.StateId(i, yIIndex)]) { continue; }
+        h.clear();
+        FireFeatures(labels[yIIndex], LatentCrfModel::START_OF_SENTENCE_Y_VALUE, sentId, i, h);
+        double lambdaH = lambda->DotProduct(h);
+        assert(!std::isnan(lambdaH) && !std::isinf(lambdaH));
+        arcFeatures.SetState(arcFeatures.StateId(i, yIIndex), h, lambdaH);
+      }
+    }
+    return;
+  }
+
+  // emissions: h(y_i, x, i)
+  lambda->firedTemplates = FeatureTemplateSubset::LABEL;
+  for(unsigned i = 0; i < x.size(); ++i) {
+    for(unsigned yIIndex = 0; yIIndex < labels.size(); ++yIIndex) {
+      if(!allowed[arcFeatures.StateId(i, yIIndex)]) { continue; }
+      h.clear();
+      FireFeatures(labels[yIIndex], LatentCrfModel::START_OF_SENTENCE_Y_VALUE, sentId, i, h);
+      double lambdaH = lambda->DotProduct(h);
+      assert(!std::isnan(lambdaH) && !std::isinf(lambdaH));
+      arcFeatures.SetState(arcFeatures.StateId(i, yIIndex), h, lambdaH);
+    }
+  }
+
+  // transitions: h(y_i, y_{i-1}, x, i)
+  if(lambda->HasEnabledTemplates(FeatureTemplateSubset::LABEL_PAIR)) {
+    lambda->firedTemplates = FeatureTemplateSubset::LABEL_PAIR;
+    bool shareTransitions = lambda->LabelPairTemplatesArePositionIndependent();
+    for(unsigned i = 0; i < x.size(); ++i) {
+      // the transition table of the first non-initial timestep is valid for all the following ones
+      // (so it is built for all label pairs, even when some of them are pruned at timestep 1)
+      if(shareTransitions && i > 1) {
+        arcFeatures.ShareArcs(1, i);
+        continue;
+      }
+      bool skipPrunedArcs = !shareTransitions || i == 0;
+      unsigned prevLabelsCount = i == 0? 1 : labels.size();
+      for(unsigned yIM1Index = 0; yIM1Index < prevLabelsCount; ++yIM1Index) {
+        int yIM1 = i == 0? LatentCrfModel::START_OF_SENTENCE_Y_VALUE : labels[yIM1Index];
+        if(skipPrunedArcs && i > 0 && !allowed[arcFeatures.StateId(i-1, yIM1Index)]) { continue; }
+        for(unsigned yIIndex = 0; yIIndex < labels.size(); ++yIIndex) {
+          if(skipPrunedArcs && !allowed[arcFeatures.StateId(i, yIIndex)]) { continue; }
+          h.clear();
+          FireFeatures(labels[yIIndex], yIM1, sentId, i, h);
+          double lambdaH = lambda->DotProduct(h);
+          assert(!std::isnan(lambdaH) && !std::isinf(lambdaH));
+          arcFeatures.SetArc(arcFeatures.ArcId(i, yIM1Index, yIIndex), h, lambdaH);
+        }
+      }
+    }
+  }
+  lambda->firedTemplates = FeatureTemplateSubset::ALL;
+}
+
+// the posterior p(y_i|z_i) \propto \theta_{z_i|y_i} is the ibm model 1 posterior in word alignment
+void LatentCrfModel::PruneLatticeLabels(unsigned sentId, ArcFeatureTable &arcFeatures) {
+  if(learningInfo.pruningBeamSize == 0 && learningInfo.pruningPosteriorThreshold <= 0.0) {
+    return;
+  }
+  const vector<int64_t> &z = GetReconstructedObservableSequence(sentId);
+  const unsigned K = arcFeatures.labelsCount;
+  vector< pair<double, unsigned> > nLogThetas(K);
+  for(unsigned i = 0; i < arcFeatures.timesteps; ++i) {
+    for(unsigned yIIndex = 0; yIIndex < K; ++yIIndex) {
+      nLogThetas[yIIndex] = make_pair(GetNLogTheta(arcFeatures.yValues[yIIndex], z[i], sentId), yIIndex);
+    }
+    // most likely labels first
+    sort(nLogThetas.begin(), nLogThetas.end());
+    double nLogSum = nLogThetas[0].first;
+    for(unsigned k = 1; k < K; ++k) {
+      nLogSum = DenseLattice::NLogPlus(nLogSum, nLogThetas[k].first);
+    }
+    // the best label is always kept
+    for(unsigned k = 1; k < K; ++k) {
+      bool outOfBeam = learningInfo.pruningBeamSize > 0 && k >= learningInfo.pruningBeamSize;
+      bool belowThreshold = MultinomialParams::nExp(nLogThetas[k].first - nLogSum) < learningInfo.pruningPosteriorThreshold;
+      if(outOfBeam || belowThreshold) {
+        arcFeatures.allowedStates[arcFeatures.StateId(i, nLogThetas[k].second)] = false;
+      }
+    }
+  }
+}
+
+// the dense counterpart of BuildLambdaFst(sentId, fst, alphas, betas)
+// assumptions:
+// - arcFeatures is populated using BuildArcFeatureTable()
+// - pruned labels are left out of the lattice
+void LatentCrfModel::BuildLambdaLattice(const ArcFeatureTable &arcFeatures, DenseLattice &lattice, bool computePotentials) {
+  lattice.independentPositions = !learningInfo.hiddenSequenceIsMarkovian;
+  lattice.Resize(arcFeatures.timesteps, arcFeatures.yValues, arcFeatures.allowedStates);
+  lattice.useScaling = learningInfo.useScaledLattices;
+  lattice.positionThreads = PositionThreadsCount();
+  for(unsigned i = 0; i < lattice.timesteps; ++i) {
+    for(unsigned yIM1 = 0; yIM1 < lattice.PrevLabelsCount(i); ++yIM1) {
+      unsigned yIM1Index = lattice.PrevLabelIndex(i, yIM1);
+      double *weights = &lattice.ArcWeight(i, yIM1, 0);
+      for(unsigned yI = 0; yI < lattice.LabelsCount(i); ++yI) {
+        // -\lambda h(y_i, y_{i-1}, x, i)
+        weights[yI] = -1.0 * arcFeatures.Score(i, yIM1Index, lattice.LabelIndex(i, yI));
+      }
+    }
+  }
+  if(computePotentials) {
+    lattice.ComputePotentials();
+  }
+}
+
+// the dense counterpart of BuildThetaLambdaFst()
+// assumptions:
+// - arcFeatures is populated using BuildArcFeatureTable()
+void LatentCrfModel::BuildThetaLambdaLattice(unsigned sentId, const vector<int64_t> &z, 
+                                             const ArcFeatureTable &arcFeatures, DenseLattice &lattice, bool computePotentials) {
+  BuildLambdaLattice(arcFeatures, lattice, false);
+  AddNLogThetas(sentId, z, lattice);
+  if(computePotentials) {
+    lattice.ComputePotentials();
+  }
+}
+
+// same, starting from the arc weights of a lattice built with BuildLambdaLattice() (e.g. one in lambdaCache)
+void LatentCrfModel::BuildThetaLambdaLattice(unsigned sentId, const vector<int64_t> &z, 
+                                             const DenseLattice &lambdaLattice, DenseLattice &lattice, bool computePotentials) {
+  lattice.CopyArcWeights(lambdaLattice);
+  lattice.useScaling = learningInfo.useScaledLattices;
+  lattice.positionThreads = PositionThreadsCount();
+  AddNLogThetas(sentId, z, lattice);
+  if(computePotentials) {
+    lattice.ComputePotentials();
+  }
+}
+
+void LatentCrfModel::AddNLogThetas(unsigned sentId, const vector<int64_t> &z, DenseLattice &lattice) {
+  for(unsigned i = 0; i < lattice.timesteps; ++i) {
+    int64_t zI = z[i];
+    for(unsigned yI = 0; yI < lattice.LabelsCount(i); ++yI) {
+      // -log \theta_{z_i|y_i} does not depend on y_{i-1}
+      double nLogTheta_zI_y = GetNLogTheta(lattice.yValues[lattice.LabelIndex(i, yI)], zI, sentId);
+      assert(!std::isnan(nLogTheta_zI_y) && !std::isinf(nLogTheta_zI_y));
+      for(unsigned yIM1 = 0; yIM1 < lattice.PrevLabelsCount(i); ++yIM1) {
+        lattice.ArcWeight(i, yIM1, yI) += nLogTheta_zI_y;
+      }
+    }
+  }
+}
+
+void LatentCrfModel::ComputeFeatureExpectations(const ArcFeatureTable &arcFeatures, const DenseLattice &lattice,
+                                                FastSparseVector<double> &expectations) {
+  assert(expectations.size() == 0);
+  assert(arcFeatures.timesteps == lattice.timesteps && arcFeatures.labelsCount == lattice.labelsCount);
+  const unsigned K = lattice.labelsCount;
+  vector<double> stateProbs(K), arcProbs(K * K);
+  for(unsigned i = 0; i < lattice.timesteps; ++i) {
+    // only the labels kept in the lattice have features
+    const unsigned labelsCount = lattice.LabelsCount(i);
+    // emission features are weighted by the state marginals
+    lattice.StatePosteriors(i, &stateProbs[0]);
+    for(unsigned yI = 0; yI < labelsCount; ++yI) {
+      unsigned stateId = arcFeatures.StateId(i, lattice.LabelIndex(i, yI));
+      for(unsigned k = arcFeatures.stateBegin[stateId]; k < arcFeatures.stateEnd[stateId]; ++k) {
+        expectations[arcFeatures.featureIndexes[k]] += arcFeatures.featureValues[k] * stateProbs[yI];
+      }
+    }
+    // transition features are weighted by the arc marginals
+    if(!arcFeatures.hasArcFeatures) { continue; }
+    lattice.ArcPosteriors(i, &arcProbs[0]);
+    for(unsigned yIM1 = 0; yIM1 < lattice.PrevLabelsCount(i); ++yIM1) {
+      for(unsigned yI = 0; yI < labelsCount; ++yI) {
+        unsigned arcId = arcFeatures.ArcId(i, lattice.PrevLabelIndex(i, yIM1), lattice.LabelIndex(i, yI));
+        double arcProb = arcProbs[yIM1 * labelsCount + yI];
+        // for each feature that fires on this arc
+        for(unsigned k = arcFeatures.arcBegin[arcId]; k < arcFeatures.arcEnd[arcId]; ++k) {
+          expectations[arcFeatures.featureIndexes[k]] += arcFeatures.featureValues[k] * arcProb;
+        }
+      }
+    }
+  }
+}
+
+// assumptions:
+// - lattice is populated using BuildLambdaLattice(arcFeatures, lattice)
+// - FOverZk is cleared
+void LatentCrfModel::ComputeFOverZ(const ArcFeatureTable &arcFeatures, const DenseLattice &lattice,
+                                   FastSparseVector<double> &FOverZk) {
+  ComputeFeatureExpectations(arcFeatures, lattice, FOverZk);
+}
+
+// assumptions:
+// - lattice is populated using BuildThetaLambdaLattice(sentId, z, arcFeatures, lattice)
+// - DOverCk is cleared
+void LatentCrfModel::ComputeDOverC(const ArcFeatureTable &arcFeatures, const DenseLattice &lattice,
+                                   FastSparseVector<double> &DOverCk) {
+  ComputeFeatureExpectations(arcFeatures, lattice, DOverCk);
+}
+
+// assumptions:
+// - BOverC is cleared
+// - lattice is populated using BuildThetaLambdaLattice()
+void LatentCrfModel::ComputeBOverC(unsigned sentId, const vector<int64_t> &z,
+                                   const DenseLattice &lattice,
+                                   boost::unordered_map< int64_t, boost::unordered_map< int64_t, double > > &BOverC) {
+  assert(BOverC.size() == 0);
+  vector<double> stateProbs(lattice.labelsCount);
+  for(unsigned i = 0; i < lattice.timesteps; ++i) {
+    int64_t zI = z[i];
+    // summing the marginals of all arcs which end in y_i gives the marginal of the state
+    lattice.StatePosteriors(i, &stateProbs[0]);
+    for(unsigned yI = 0; yI < lattice.LabelsCount(i); ++yI) {
+      BOverC[lattice.yValues[lattice.LabelIndex(i, yI)]][zI] += stateProbs[yI];
+    }
+  }
+}
+
+// assumptions:
+// - BXZ is cleared
+// - lattice is populated using BuildThetaLambdaLattice()
+void LatentCrfModel::ComputeB(unsigned sentId, const vector<int64_t> &z,
+                              const DenseLattice &lattice,
+                              boost::unordered_map< std::pair<int64_t, int64_t>, boost::unordered_map< int64_t, LogVal<double> > > &BXZ) {
+  assert(BXZ.size() == 0);
+  for(unsigned i = 0; i < lattice.timesteps; ++i) {
+    int64_t zI = z[i];
+    for(unsigned yIM1Index = 0; yIM1Index < lattice.PrevLabelsCount(i); ++yIM1Index) {
+      int yIM1 = i == 0? LatentCrfModel::START_OF_SENTENCE_Y_VALUE : lattice.yValues[lattice.PrevLabelIndex(i, yIM1Index)];
+      for(unsigned yIIndex = 0; yIIndex < lattice.LabelsCount(i); ++yIIndex) {
+        std::pair<int64_t, int64_t> yIM1AndyI(yIM1, lattice.yValues[lattice.LabelIndex(i, yIIndex)]);
+        BXZ[yIM1AndyI][zI] += LogVal<double>(-lattice.NLogArcMarginal(i, yIM1Index, yIIndex), init_lnx());
+      }
+    }
+  }
+}
+
 void LatentCrfModel::SupervisedTrainTheta() {
   cerr << "void LatentCrfModel::SupervisedTrainTheta() is not implemented" << endl;
   assert(false);
@@ -773,19 +1206,15 @@ void LatentCrfModel::SupervisedTrain(bool fitLambdas, bool fitThetas) {
         }
 
         // process your share of examples
-        vector<double> gradientPiece(lambda->GetParamsCount(), 0.0), dummy;
+        vector<double> gradientPiece;
+        ZeroReduceSumBuffer(gradientPiece, lambda->GetParamsCount(), 1);
         int fromSentId = 0;
         LatentCrfModel &model = LatentCrfModel::GetInstance();
         int toSentId = (int)model.examplesCount;
         double nllPiece = ComputeNllYGivenXAndLambdaGradient(gradientPiece, fromSentId, toSentId);
 
-        // merge your gradient with other slaves
-        mpi::reduce< vector<double> >(*learningInfo.mpiWorld, gradientPiece, dummy, 
-            AggregateVectors2(), 0);
-
-        // aggregate the loglikelihood computation as well
-        double dummy2;
-        mpi::reduce<double>(*learningInfo.mpiWorld, nllPiece, dummy2, std::plus<double>(), 0);
+        // merge your gradient and loglikelihood with other slaves
+        ReduceSum(gradientPiece, &nllPiece, 1, false);
 
       }
     } // end if master => run lbfgs() else help master
@@ -924,7 +1353,9 @@ double LatentCrfModel::CheckGradient(lbfgs_evaluate_t proc_evaluate, vector<int>
     double diff = analyticDerivatives[i] - numericDerivatives[i];
     double diffSquared = diff * diff;
     sumOfDiffSquared += diffSquared;
-    cerr << testIndexes[i] << "\t" << (*lambda->paramIdsPtr)[testIndexes[i]] << "\t" << lambdasArray[testIndexes[i]] << "\t";
+    cerr << testIndexes[i] << "\t";
+    if(!lambda->IsHashed()) { cerr << (*lambda->paramIdsPtr)[testIndexes[i]] << "\t"; }
+    cerr << lambdasArray[testIndexes[i]] << "\t";
     cerr << analyticDerivatives[i] << "\t" << numericDerivatives[i] << "\t" << diffSquared << endl;    
   }
   cerr << "\\sum_i (analytic - numeric)^2 = " << sumOfDiffSquared << endl;
@@ -952,17 +1383,17 @@ double LatentCrfModel::LbfgsCallbackEvalYGivenXLambdaGradient(void *uselessPtr,
   mpi::broadcast<bool>(*model.learningInfo.mpiWorld, NEED_HELP, 0);
 
   // even the master needs to process its share of sentences
-  vector<double> gradientPiece(model.lambda->GetParamsCount(), 0.0), reducedGradient;
+  vector<double> gradientPiece;
+  model.ZeroReduceSumBuffer(gradientPiece, model.lambda->GetParamsCount(), 1);
   int fromSentId = 0;
   int toSentId = model.goldLabelSequences.size();
 
   double NllPiece = model.ComputeNllYGivenXAndLambdaGradient(gradientPiece, fromSentId, toSentId);
-  double reducedNll = -1;
 
-  // now, the master aggregates gradient pieces computed by the slaves
-  mpi::reduce< vector<double> >(*model.learningInfo.mpiWorld, gradientPiece, reducedGradient, AggregateVectors2(), 0);
-  mpi::reduce<double>(*model.learningInfo.mpiWorld, NllPiece, reducedNll, std::plus<double>(), 0);
-  assert(reducedNll != -1);
+  // now, the master aggregates gradient pieces and loglikelihoods computed by the slaves
+  model.ReduceSum(gradientPiece, &NllPiece, 1, false);
+  const vector<double> &reducedGradient = gradientPiece;
+  double reducedNll = NllPiece;
 
   // fill in the gradient array allocated by lbfgs
   cerr << ">>> before l2 reg: reducednll = " << reducedNll;
@@ -1011,9 +1442,9 @@ double LatentCrfModel::AddL2Term(const vector<double> &unregularizedGradient,
   for(unsigned i = 0; i < lambda->GetParamsCount(); i++) {
     double lambda_i = lambda->GetParamWeight(i);
     double distance = 
-      lambda->featureGaussianMeans.find( lambda->GetParamId(i) ) == lambda->featureGaussianMeans.end()?
+      lambda->featureGaussianMeans.empty() || lambda->featureGaussianMeans.find( lambda->GetParamKey(i) ) == lambda->featureGaussianMeans.end()?
       lambda_i: 
-      lambda_i - lambda->featureGaussianMeans[ lambda->GetParamId(i) ];
+      lambda_i - lambda->featureGaussianMeans[ lambda->GetParamKey(i) ];
 
     regularizedGradient[i] = unregularizedGradient[i] + 2.0 * learningInfo.optimizationMethod.subOptMethod->regularizationStrength * distance;
     l2RegularizedObjective += learningInfo.optimizationMethod.subOptMethod->regularizationStrength * distance * distance;
@@ -1030,9 +1461,9 @@ double LatentCrfModel::AddL2Term(double unregularizedObjective) {
   for(unsigned i = 0; i < lambda->GetParamsCount(); i++) {
     double lambda_i = lambda->GetParamWeight(i);
     double distance = 
-      lambda->featureGaussianMeans.find( lambda->GetParamId(i) ) == lambda->featureGaussianMeans.end()?
+      lambda->featureGaussianMeans.empty() || lambda->featureGaussianMeans.find( lambda->GetParamKey(i) ) == lambda->featureGaussianMeans.end()?
       lambda_i: 
-      lambda_i - lambda->featureGaussianMeans[ lambda->GetParamId(i) ];
+      lambda_i - lambda->featureGaussianMeans[ lambda->GetParamKey(i) ];
     l2RegularizedObjective += learningInfo.optimizationMethod.subOptMethod->regularizationStrength * distance * distance;
   } 
   return l2RegularizedObjective;
@@ -1057,7 +1488,8 @@ double LatentCrfModel::LbfgsCallbackEvalZGivenXLambdaGradient(void *dummy,
   mpi::broadcast<bool>(*model.learningInfo.mpiWorld, NEED_HELP, 0);
 
   // even the master needs to process its share of sentences
-  vector<double> gradientPiece(model.lambda->GetParamsCount(), 0.0), reducedGradient;
+  vector<double> gradientPiece;
+  model.ZeroReduceSumBuffer(gradientPiece, model.lambda->GetParamsCount(), 2);
   int supervisedFromSentId = 0;
   int supervisedToSentId = model.goldLabelSequences.size();
   int fromSentId = model.goldLabelSequences.size();
@@ -1067,7 +1499,6 @@ double LatentCrfModel::LbfgsCallbackEvalZGivenXLambdaGradient(void *dummy,
 
   double devSetNllPiece = 0;
   double NllPiece = model.ComputeNllZGivenXAndLambdaGradient(gradientPiece, fromSentId, toSentId, &devSetNllPiece);
-  double reducedNll = -1, reducedDevSetNll = 0;
 
   // for semi-supervised learning, we need to also collect the gradient from labeled data
   // note this is supposed to *add to the gradient of the unsupervised objective*, but only 
@@ -1077,12 +1508,11 @@ double LatentCrfModel::LbfgsCallbackEvalZGivenXLambdaGradient(void *dummy,
     model.ComputeNllYGivenXAndLambdaGradient(gradientPiece, supervisedFromSentId, supervisedToSentId):
     0.0;
 
-  // now, the master aggregates gradient pieces computed by the slaves
-  mpi::reduce< vector<double> >(*model.learningInfo.mpiWorld, gradientPiece, reducedGradient, AggregateVectors2(), 0);
-  // now the master aggregates the unsupervised objective
-  mpi::reduce<double>(*model.learningInfo.mpiWorld, NllPiece + SupervisedNllPiece, reducedNll, std::plus<double>(), 0);
-  assert(reducedNll != -1);
-  mpi::reduce<double>(*model.learningInfo.mpiWorld, devSetNllPiece, reducedDevSetNll, std::plus<double>(), 0);
+  // now, the master aggregates gradient pieces, the objective and the dev set objective computed by the slaves
+  double objectives[] = {NllPiece + SupervisedNllPiece, devSetNllPiece};
+  model.ReduceSum(gradientPiece, objectives, 2, false);
+  const vector<double> &reducedGradient = gradientPiece;
+  double reducedNll = objectives[0], reducedDevSetNll = objectives[1];
 
   /*if(model.learningInfo.mpiWorld->rank() == 0) {
     for(unsigned i = 0; i < reducedGradient.size(); ++i) {
@@ -1135,9 +1565,10 @@ double LatentCrfModel::LbfgsCallbackEvalZGivenXLambdaGradient(void *dummy,
 bool LatentCrfModel::ComputeNllZGivenXAndLambdaGradientPerSentence(bool ignoreThetaTerms, 
     int sentId,
     double& sentNll,
-    FastSparseVector<double>& sentNllGradient) {
-  // sentId is assigned to the process with rank = sentId % world.size()
-  if(sentId % learningInfo.mpiWorld->size() != learningInfo.mpiWorld->rank()) {
+    FastSparseVector<double>& sentNllGradient,
+    SentenceWorkspace &workspace) {
+  // sentId is assigned to the process sentencePartition.Rank(sentId)
+  if(!IsMySentence(sentId)) {
     return false;
   }
 
@@ -1147,37 +1578,68 @@ bool LatentCrfModel::ComputeNllZGivenXAndLambdaGradientPerSentence(bool ignoreTh
     return false;
   }
 
-  // build the FSTs
-  fst::VectorFst<FstUtils::LogArc> thetaLambdaFst, lambdaFst;
-  vector<FstUtils::LogWeight> thetaLambdaAlphas, lambdaAlphas, thetaLambdaBetas, lambdaBetas;
-  if(!ignoreThetaTerms) {
-    BuildThetaLambdaFst(sentId, 
-        GetReconstructedObservableSequence(sentId), 
-        thetaLambdaFst, 
-        thetaLambdaAlphas, 
-        thetaLambdaBetas);
-  }
-  BuildLambdaFst(sentId, lambdaFst, lambdaAlphas, lambdaBetas);
+  double nLogC = 0, nLogZ = 0;
+  FastSparseVector<double> DOverCSparseVector, FOverZSparseVector;
+  if(UseDenseLattices()) {
+
+    // fire the features of each arc once. both lattices share them
+    ArcFeatureTable &arcFeatureTable = workspace.arcFeatureTable;
+    BuildArcFeatureTable(sentId, arcFeatureTable, true);
+
+    // build the dense lattices, and compute D/C, C, F/Z and Z
+    if(!ignoreThetaTerms) {
+      BuildThetaLambdaLattice(sentId, GetReconstructedObservableSequence(sentId), arcFeatureTable, workspace.thetaLambdaLattice);
+      ComputeDOverC(arcFeatureTable, workspace.thetaLambdaLattice, DOverCSparseVector);
+      nLogC = workspace.thetaLambdaLattice.NLogZ();
+    }
+    BuildLambdaLattice(arcFeatureTable, workspace.lambdaLattice);
+    ComputeFOverZ(arcFeatureTable, workspace.lambdaLattice, FOverZSparseVector);
+    nLogZ = workspace.lambdaLattice.NLogZ();
+
+  } else {
+
+    // build the FSTs
+    fst::VectorFst<FstUtils::LogArc> thetaLambdaFst, lambdaFst;
+    vector<FstUtils::LogWeight> thetaLambdaAlphas, lambdaAlphas, thetaLambdaBetas, lambdaBetas;
+    if(!ignoreThetaTerms) {
+      BuildThetaLambdaFst(sentId, 
+          GetReconstructedObservableSequence(sentId), 
+          thetaLambdaFst, 
+          thetaLambdaAlphas, 
+          thetaLambdaBetas);
+    }
+    BuildLambdaFst(sentId, lambdaFst, lambdaAlphas, lambdaBetas);
+
+    // compute the D map for this sentence
+    if(!ignoreThetaTerms) {
+      ComputeDOverC(sentId, GetObservableSequence(sentId), thetaLambdaFst, thetaLambdaAlphas, thetaLambdaBetas, DOverCSparseVector);
+    }
 
-  // compute the D map for this sentence
-  FastSparseVector<double> DOverCSparseVector;
-  if(!ignoreThetaTerms) {
-    ComputeDOverC(sentId, GetObservableSequence(sentId), thetaLambdaFst, thetaLambdaAlphas, thetaLambdaBetas, DOverCSparseVector);
-    for(auto& gradientTermIter : DOverCSparseVector) {
-      sentNllGradient[gradientTermIter.first] = -gradientTermIter.second;
+    // compute the C value for this sentence
+    if(!ignoreThetaTerms) {
+      nLogC = ComputeNLogC(thetaLambdaFst, thetaLambdaBetas);
     }
+    if((std::isnan(nLogC) || std::isinf(nLogC)) && learningInfo.debugLevel >= DebugLevel::ESSENTIAL) {
+      cerr << "thetaLambdaFst summary:" << endl;
+      cerr << FstUtils::PrintFstSummary(thetaLambdaFst);
+    }
+
+    // compute the F map fro this sentence
+    ComputeFOverZ(sentId, lambdaFst, lambdaAlphas, lambdaBetas, FOverZSparseVector);
+
+    // compute the Z value for this sentence
+    nLogZ = ComputeNLogZ_lambda(lambdaFst, lambdaBetas);
   }
 
-  // compute the C value for this sentence
-  double nLogC = 0;
-  if(!ignoreThetaTerms) {
-    nLogC = ComputeNLogC(thetaLambdaFst, thetaLambdaBetas);
+  // add -D/C to the gradient
+  for(auto& gradientTermIter : DOverCSparseVector) {
+    sentNllGradient[gradientTermIter.first] = -gradientTermIter.second;
   }
+
+  // keep an eye on bad numbers
   if(std::isnan(nLogC) || std::isinf(nLogC)) {
     if(learningInfo.debugLevel >= DebugLevel::ESSENTIAL) {
       cerr << "ERROR: nLogC = " << nLogC << ". my mistake. will halt!" << endl;
-      cerr << "thetaLambdaFst summary:" << endl;
-      cerr << FstUtils::PrintFstSummary(thetaLambdaFst);
     }
     assert(false);
   }
@@ -1187,14 +1649,6 @@ bool LatentCrfModel::ComputeNllZGivenXAndLambdaGradientPerSentence(bool ignoreTh
     sentNll = nLogC;
   }
 
-  // compute the F map fro this sentence
-  FastSparseVector<double> FOverZSparseVector;
-  ComputeFOverZ(sentId, lambdaFst, lambdaAlphas, lambdaBetas, FOverZSparseVector);
-
-  // compute the Z value for this sentence
-  double nLogZ = ComputeNLogZ_lambda(lambdaFst, lambdaBetas);
-
-  // keep an eye on bad numbers
   if(std::isnan(nLogZ) || std::isinf(nLogZ)) {
     if(learningInfo.debugLevel >= DebugLevel::ESSENTIAL) {
       cerr << "ERROR: nLogZ = " << nLogZ << ". my mistake. will halt!" << endl;
@@ -1257,34 +1711,58 @@ double LatentCrfModel::ComputeNllZGivenXAndLambdaGradient(vector<double> &deriva
 
   assert(derivativeWRTLambda.size() == lambda->GetParamsCount());
 
-  // for each training example
-  FastSparseVector<double> sentNllGradient;
+  // the sentences of this process
+  vector<unsigned> mySentIds;
   for(int sentId = fromSentId; sentId < toSentId; sentId++) {
-    // initialize sentence-level variables.
-    double sentNll = 0;
-    sentNllGradient.clear();
+    if(IsMySentence(sentId)) {
+      mySentIds.push_back(sentId);
+    }
+  }
 
-    // compute sentence-level variables (objective and gradient)
-    if(!ComputeNllZGivenXAndLambdaGradientPerSentence(ignoreThetaTerms, sentId, sentNll, sentNllGradient)) continue;
+  // each thread accumulates the objective, devSetNll and (sparse) gradient of its sentences separately
+  unsigned threadsCount = SentenceThreadsCount();
+  vector<double> threadObjectives(threadsCount, 0.0), threadDevSetNlls(threadsCount, 0.0);
+  vector< FastSparseVector<double> > threadGradients(threadsCount);
+  ProcessSentences(mySentIds, threadsCount, [&] (unsigned sentId, unsigned threadId) {
+      // initialize sentence-level variables.
+      double sentNll = 0;
+      FastSparseVector<double> sentNllGradient;
 
-    // Update objective or devSetNll as need be. also, update gradient.
-    if(learningInfo.useEarlyStopping && sentId % 10 == 0) {
-      *devSetNll += sentNll;
-    } else {
-      objective += sentNll;
-      // add the gradient
-      for(auto derivative = sentNllGradient.begin(); 
-          derivative != sentNllGradient.end(); ++derivative) {
-        double derivativeValue = derivative->second;
-        if(std::isnan(derivativeValue) || std::isinf(derivativeValue)) {
-          cerr << "ERROR: derivativeValue = " << derivativeValue << ". my mistake. will halt!" << endl;
-          assert(false);
-        }
-        assert(derivativeWRTLambda.size() > derivative->first);
-        derivativeWRTLambda[derivative->first] += derivativeValue;
-      } // end of loop over active derivatives in this example
-    } // end of early stopping check
-  } // end of training examples 
+      // compute sentence-level variables (objective and gradient)
+      if(!ComputeNllZGivenXAndLambdaGradientPerSentence(ignoreThetaTerms, sentId, sentNll, sentNllGradient, 
+                                                        GetWorkspace(threadId))) {
+        return;
+      }
+
+      // Update objective or devSetNll as need be. also, update gradient.
+      if(learningInfo.useEarlyStopping && sentId % 10 == 0) {
+        threadDevSetNlls[threadId] += sentNll;
+      } else {
+        threadObjectives[threadId] += sentNll;
+        // add the gradient
+        FastSparseVector<double> &threadGradient = threadGradients[threadId];
+        for(auto derivative = sentNllGradient.begin(); 
+            derivative != sentNllGradient.end(); ++derivative) {
+          double derivativeValue = derivative->second;
+          if(std::isnan(derivativeValue) || std::isinf(derivativeValue)) {
+            cerr << "ERROR: derivativeValue = " << derivativeValue << ". my mistake. will halt!" << endl;
+            assert(false);
+          }
+          assert(derivativeWRTLambda.size() > derivative->first);
+          threadGradient[derivative->first] += derivativeValue;
+        } // end of loop over active derivatives in this example
+      } // end of early stopping check
+    });
+
+  // merge the accumulators of all threads, in thread order
+  for(unsigned threadId = 0; threadId < threadsCount; ++threadId) {
+    objective += threadObjectives[threadId];
+    *devSetNll += threadDevSetNlls[threadId];
+    for(auto derivative = threadGradients[threadId].begin(); 
+        derivative != threadGradients[threadId].end(); ++derivative) {
+      derivativeWRTLambda[derivative->first] += derivative->second;
+    }
+  }
 
   cerr << learningInfo.mpiWorld->rank() << "|";
   return objective;
@@ -1500,6 +1978,120 @@ void LatentCrfModel::AllReduceMleAndMarginals(
 
 }
 
+void LatentCrfModel::ZeroReduceSumBuffer(std::vector<double> &values, unsigned valuesCount, unsigned scalarsCount) {
+  // reserve() only allocates the first time (or if valuesCount grew)
+  values.reserve(valuesCount + scalarsCount);
+  values.assign(valuesCount, 0.0);
+}
+
+void LatentCrfModel::ReduceSum(std::vector<double> &values, double *scalars, unsigned scalarsCount, bool allProcesses) {
+  // the scalars travel in the same message as values. values has room for them (see ZeroReduceSumBuffer()), so
+  // appending them does not reallocate it
+  unsigned valuesCount = values.size();
+  assert(values.capacity() >= valuesCount + scalarsCount);
+  values.insert(values.end(), scalars, scalars + scalarsCount);
+  double *buffer = values.empty()? 0 : &values[0];
+  if(learningInfo.nodeLocalReduce) {
+    if(!nodeReducer.IsInitialized()) {
+      nodeReducer.Init(*learningInfo.mpiWorld, learningInfo.sharedMemorySegment);
+      if(learningInfo.mpiWorld->rank() == 0) {
+        cerr << "master" << learningInfo.mpiWorld->rank() << ": reducing in shared memory across the " 
+             << nodeReducer.NodeSize() << " processes of each node" << endl;
+      }
+    }
+    nodeReducer.Reduce(buffer, values.size(), allProcesses);
+  } else {
+    MpiReduceSum(buffer, values.size(), allProcesses);
+  }
+  std::copy(values.begin() + valuesCount, values.end(), scalars);
+  values.resize(valuesCount);
+}
+
+void LatentCrfModel::MpiReduceSum(double *buffer, unsigned count, bool allProcesses) {
+  if(count == 0) {
+    return;
+  }
+  if(allProcesses) {
+    MPI_Allreduce(MPI_IN_PLACE, buffer, count, MPI_DOUBLE, MPI_SUM, *learningInfo.mpiWorld);
+  } else if(learningInfo.mpiWorld->rank() == 0) {
+    MPI_Reduce(MPI_IN_PLACE, buffer, count, MPI_DOUBLE, MPI_SUM, 0, *learningInfo.mpiWorld);
+  } else {
+    MPI_Reduce(buffer, 0, count, MPI_DOUBLE, MPI_SUM, 0, *learningInfo.mpiWorld);
+  }
+}
+
+void LatentCrfModel::SparseAllReduceSum(const FastSparseVector<double> &values, unsigned valuesCount, 
+                                        double *scalars, unsigned scalarsCount, std::vector<double> &reducedValues) {
+  MPI_Comm comm = *learningInfo.mpiWorld;
+  int processesCount = learningInfo.mpiWorld->size();
+
+  // how many indexes is each process contributing?
+  int activeCount = values.size();
+  vector<int> activeCounts(processesCount);
+  MPI_Allgather(&activeCount, 1, MPI_INT, &activeCounts[0], 1, MPI_INT, comm);
+  size_t totalActiveCount = 0;
+  for(int rank = 0; rank < processesCount; ++rank) {
+    totalActiveCount += activeCounts[rank];
+  }
+
+  // debug info
+  if(learningInfo.debugLevel >= DebugLevel::MINI_BATCH && learningInfo.mpiWorld->rank() == 0) {
+    cerr << "master" << learningInfo.mpiWorld->rank() << ": reducing " << totalActiveCount 
+         << " (index, value) pairs of a " << valuesCount << "-dimensional vector" << endl;
+  }
+
+  // fall back to the dense all-reduce when the (index, value) pairs are bigger than the dense vector.
+  // all processes see the same counts, so they all take the same path.
+  ZeroReduceSumBuffer(reducedValues, valuesCount, scalarsCount);
+  if(totalActiveCount * (sizeof(int) + sizeof(double)) >= valuesCount * sizeof(double)) {
+    for(auto valueIter = values.begin(); valueIter != values.end(); ++valueIter) {
+      reducedValues[valueIter->first] += valueIter->second;
+    }
+    ReduceSum(reducedValues, scalars, scalarsCount, true);
+    return;
+  }
+
+  // the run of each process consists of its active indexes, and their values followed by its scalars
+  vector<int> indexes;
+  vector<double> runValues;
+  indexes.reserve(activeCount);
+  runValues.reserve(activeCount + scalarsCount);
+  for(auto valueIter = values.begin(); valueIter != values.end(); ++valueIter) {
+    assert(valueIter->first < valuesCount);
+    indexes.push_back(valueIter->first);
+    runValues.push_back(valueIter->second);
+  }
+  runValues.insert(runValues.end(), scalars, scalars + scalarsCount);
+  
+  vector<int> indexOffsets(processesCount, 0), valueCounts(processesCount), valueOffsets(processesCount, 0);
+  for(int rank = 0; rank < processesCount; ++rank) {
+    valueCounts[rank] = activeCounts[rank] + scalarsCount;
+    if(rank > 0) {
+      indexOffsets[rank] = indexOffsets[rank - 1] + activeCounts[rank - 1];
+      valueOffsets[rank] = valueOffsets[rank - 1] + valueCounts[rank - 1];
+    }
+  }
+  vector<int> allIndexes(totalActiveCount);
+  vector<double> allValues(totalActiveCount + processesCount * scalarsCount);
+  MPI_Allgatherv(indexes.empty()? 0 : &indexes[0], activeCount, MPI_INT,
+                 allIndexes.empty()? 0 : &allIndexes[0], &activeCounts[0], &indexOffsets[0], MPI_INT, comm);
+  MPI_Allgatherv(runValues.empty()? 0 : &runValues[0], runValues.size(), MPI_DOUBLE,
+                 allValues.empty()? 0 : &allValues[0], &valueCounts[0], &valueOffsets[0], MPI_DOUBLE, comm);
+  
+  // add up the runs in rank order, so that all processes end up with identical sums
+  std::fill(scalars, scalars + scalarsCount, 0.0);
+  for(int rank = 0; rank < processesCount; ++rank) {
+    const int *runIndexes = allIndexes.empty()? 0 : &allIndexes[indexOffsets[rank]];
+    const double *run = allValues.empty()? 0 : &allValues[valueOffsets[rank]];
+    for(int i = 0; i < activeCounts[rank]; ++i) {
+      reducedValues[runIndexes[i]] += run[i];
+    }
+    for(unsigned i = 0; i < scalarsCount; ++i) {
+      scalars[i] += run[activeCounts[rank] + i];
+    }
+  }
+}
+
 void LatentCrfModel::PersistTheta(string thetaParamsFilename) {
   MultinomialParams::PersistParams(thetaParamsFilename, nLogThetaGivenOneLabel, 
       vocabEncoder, true, true);
@@ -1528,6 +2120,9 @@ void LatentCrfModel::BlockCoordinateDescent() {
   // baby steps
   unsigned originalMaxSequenceLength = learningInfo.maxSequenceLength;
 
+  // lambda may have been initialized, loaded or fit since the cache was last used
+  LambdaChanged();
+
   // TRAINING ITERATIONS
   bool converged = false;
   do {
@@ -1591,7 +2186,7 @@ void LatentCrfModel::BlockCoordinateDescent() {
       assert(examplesCount > 0);
       for(uint i = firstSentIdUsedForTraining; 
           i < firstSentIdUsedForTraining + examplesCount; ++i) {
-        if(i % learningInfo.mpiWorld->size() == learningInfo.mpiWorld->rank()) {
+        if(IsMySentence(i)) {
           mySentIndexes.push_back(i);
         }
       }
@@ -1620,9 +2215,8 @@ void LatentCrfModel::BlockCoordinateDescent() {
           
           int sentId = *sentIter;
 
-          // sentId is assigned to the process # (sentId % world.size())
-          if (sentId % learningInfo.mpiWorld->size() != 
-              (unsigned)learningInfo.mpiWorld->rank()) {
+          // sentId is assigned to the process # sentencePartition.Rank(sentId)
+          if (!IsMySentence(sentId)) {
             continue;
           }
 
@@ -1631,7 +2225,7 @@ void LatentCrfModel::BlockCoordinateDescent() {
           // http://cs.stanford.edu/~pliang/papers/online-naacl2009.pdf
           double sentLoglikelihood = 
             UpdateThetaMleForSent(sentId, mleGivenOneLabel, 
-                                  mleMarginalsGivenOneLabel, learningRate);
+                                  mleMarginalsGivenOneLabel, learningRate, workspace);
 
           // when emIter == 0, the mle estimates are too poor so we never update thetas 
           // during the first epoch when emIter == 0
@@ -1733,25 +2327,48 @@ void LatentCrfModel::BlockCoordinateDescent() {
           cerr << endl << "aggregating soft counts for each theta parameter...";
         }
 
-        double unregularizedObjective = 0;
+        // sentId is assigned to the process # sentencePartition.Rank(sentId)
+        vector<unsigned> mySentIds;
         for (unsigned sentId = firstSentIdUsedForTraining; 
             sentId < examplesCount; sentId++) {
-
-          // sentId is assigned to the process # (sentId % world.size())
-          if (sentId % learningInfo.mpiWorld->size() != 
-             (unsigned)learningInfo.mpiWorld->rank()) {
-            continue;
+          if (IsMySentence(sentId)) {
+            mySentIds.push_back(sentId);
           }
+        }
 
-          double learningRate = 1.0;
-          double sentLoglikelihood = 
-            UpdateThetaMleForSent(sentId, mleGivenOneLabel, 
-                                  mleMarginalsGivenOneLabel, learningRate);
-
-          unregularizedObjective += sentLoglikelihood;
-
-          if (sentId % learningInfo.nSentsPerDot == 0) {
-            cerr << ".";
+        // each thread accumulates the soft counts and objective of its sentences separately
+        unsigned threadsCount = SentenceThreadsCount();
+        vector< MultinomialParams::ConditionalMultinomialParam<int64_t> > threadMles(threadsCount - 1);
+        vector< boost::unordered_map<int64_t, double> > threadMleMarginals(threadsCount - 1);
+        vector<double> threadObjectives(threadsCount, 0.0);
+        ProcessSentences(mySentIds, threadsCount, [&] (unsigned sentId, unsigned threadId) {
+            double learningRate = 1.0;
+            double sentLoglikelihood = threadId == 0?
+              UpdateThetaMleForSent(sentId, mleGivenOneLabel, 
+                                    mleMarginalsGivenOneLabel, learningRate, workspace) :
+              UpdateThetaMleForSent(sentId, threadMles[threadId - 1], 
+                                    threadMleMarginals[threadId - 1], learningRate, GetWorkspace(threadId));
+
+            threadObjectives[threadId] += sentLoglikelihood;
+
+            if (sentId % learningInfo.nSentsPerDot == 0) {
+              cerr << ".";
+            }
+          });
+
+        // merge the soft counts of the other threads into the first one's
+        double unregularizedObjective = threadObjectives[0];
+        for (unsigned threadId = 1; threadId < threadsCount; ++threadId) {
+          unregularizedObjective += threadObjectives[threadId];
+          auto &threadMle = threadMles[threadId - 1].params;
+          for (auto contextIter = threadMle.begin(); contextIter != threadMle.end(); ++contextIter) {
+            for (auto eventIter = contextIter->second.begin(); eventIter != contextIter->second.end(); ++eventIter) {
+              mleGivenOneLabel[contextIter->first][eventIter->first] += eventIter->second;
+            }
+          }
+          auto &threadMarginals = threadMleMarginals[threadId - 1];
+          for (auto contextIter = threadMarginals.begin(); contextIter != threadMarginals.end(); ++contextIter) {
+            mleMarginalsGivenOneLabel[contextIter->first] += contextIter->second;
           }
         }
 
@@ -1887,7 +2504,8 @@ void LatentCrfModel::BlockCoordinateDescent() {
           }
 
           // process your share of examples
-          vector<double> gradientPiece(lambda->GetParamsCount(), 0.0), dummy;
+          vector<double> gradientPiece;
+          ZeroReduceSumBuffer(gradientPiece, lambda->GetParamsCount(), 2);
           double devSetNllPiece = 0.0;
           double nllPiece = ComputeNllZGivenXAndLambdaGradient(gradientPiece, fromSentId, toSentId, &devSetNllPiece);
 
@@ -1899,16 +2517,9 @@ void LatentCrfModel::BlockCoordinateDescent() {
             ComputeNllYGivenXAndLambdaGradient(gradientPiece, supervisedFromSentId, supervisedToSentId):
             0.0;
 
-          // merge your gradient with other slaves
-          mpi::reduce< vector<double> >(*learningInfo.mpiWorld, gradientPiece, dummy, 
-              AggregateVectors2(), 0);
-
-          // aggregate the loglikelihood computation as well
-          double dummy2;
-          mpi::reduce<double>(*learningInfo.mpiWorld, nllPiece + SupervisedNllPiece, dummy2, std::plus<double>(), 0);
-
-          // aggregate the loglikelihood computation as well
-          mpi::reduce<double>(*learningInfo.mpiWorld, devSetNllPiece, dummy2, std::plus<double>(), 0);
+          // merge your gradient and loglikelihoods with other slaves
+          double objectives[] = {nllPiece + SupervisedNllPiece, devSetNllPiece};
+          ReduceSum(gradientPiece, objectives, 2, false);
 
           // for debug
           if(learningInfo.debugLevel >= DebugLevel::REDICULOUS) {
@@ -1948,6 +2559,7 @@ void LatentCrfModel::BlockCoordinateDescent() {
 
     // done optimizing lambdas
     this->optimizingLambda = false;
+    LambdaChanged();
 
     // persist updated lambda params
     if(learningInfo.iterationsCount % learningInfo.persistParamsAfterNIteration == 0 && 
@@ -1969,6 +2581,9 @@ void LatentCrfModel::BlockCoordinateDescent() {
     // debug info
     if(learningInfo.debugLevel >= DebugLevel::CORPUS && learningInfo.mpiWorld->rank() == 0) {
       cerr << endl << "master" << learningInfo.mpiWorld->rank() << ": finished coordinate descent iteration #" << learningInfo.iterationsCount << " Nll=" << Nll << endl;
+      if(learningInfo.cacheActiveFeatures) {
+        lambda->posFactorIdToFeatures.PrintStats(cerr);
+      }
     }
 
     // update learningInfo
@@ -1979,6 +2594,9 @@ void LatentCrfModel::BlockCoordinateDescent() {
     }
     learningInfo.iterationsCount++;
 
+    // debug info
+    ReportSentenceLoads();
+
     // check convergence
     if(learningInfo.mpiWorld->rank() == 0) {
       converged = learningInfo.IsModelConverged();
@@ -2057,7 +2675,8 @@ void LatentCrfModel::OptimizeLambdasWithLbfgs(double& optimizedMiniBatchNll, lbf
       }
 
       // process your share of examples
-      vector<double> gradientPiece(lambda->GetParamsCount(), 0.0), dummy;
+      vector<double> gradientPiece;
+      ZeroReduceSumBuffer(gradientPiece, lambda->GetParamsCount(), 2);
       double devSetNllPiece = 0.0;
       double nllPiece = ComputeNllZGivenXAndLambdaGradient(gradientPiece, fromSentId, toSentId, &devSetNllPiece);
 
@@ -2069,16 +2688,9 @@ void LatentCrfModel::OptimizeLambdasWithLbfgs(double& optimizedMiniBatchNll, lbf
         ComputeNllYGivenXAndLambdaGradient(gradientPiece, supervisedFromSentId, supervisedToSentId):
         0.0;
 
-      // merge your gradient with other slaves
-      mpi::reduce< vector<double> >(*learningInfo.mpiWorld, gradientPiece, dummy, 
-          AggregateVectors2(), 0);
-
-      // aggregate the loglikelihood computation as well
-      double dummy2;
-      mpi::reduce<double>(*learningInfo.mpiWorld, nllPiece + SupervisedNllPiece, dummy2, std::plus<double>(), 0);
-
-      // aggregate the loglikelihood computation as well
-      mpi::reduce<double>(*learningInfo.mpiWorld, devSetNllPiece, dummy2, std::plus<double>(), 0);
+      // merge your gradient and loglikelihoods with other slaves
+      double objectives[] = {nllPiece + SupervisedNllPiece, devSetNllPiece};
+      ReduceSum(gradientPiece, objectives, 2, false);
 
       // for debug
       if(learningInfo.debugLevel >= DebugLevel::REDICULOUS) {
@@ -2179,7 +2791,7 @@ void LatentCrfModel::OptimizeLambdasWithSgd(double& optimizedMiniBatchNll) {
     int totalSentCount = toSentId - fromSentId;
     assert(totalSentCount > 0);
     for(uint i = fromSentId; i < toSentId; ++i) {
-      if(i % learningInfo.mpiWorld->size() == learningInfo.mpiWorld->rank()) {
+      if(IsMySentence(i)) {
         mySentIndexes.push_back(i);
       }
     }
@@ -2190,8 +2802,9 @@ void LatentCrfModel::OptimizeLambdasWithSgd(double& optimizedMiniBatchNll) {
 
     // use these variables to accumulate negative loglikelihood and its 
     // gradient across sentences.
+    // only the features active in my sentences are kept, so that the reduction below exchanges those only.
     double NllPiece = 0.0;
-    vector<double> NllGradientPiece(lambda->GetParamsCount(), 0.0);
+    FastSparseVector<double> NllGradientPiece;
     
     // reset this vector for each sentence.
     FastSparseVector<double> sentNllGradient;
@@ -2226,7 +2839,7 @@ void LatentCrfModel::OptimizeLambdasWithSgd(double& optimizedMiniBatchNll) {
       int sentId = *sentIter;
       double sentNll = 0.0;
       bool ignoreThetaTerms = false;
-      if(!ComputeNllZGivenXAndLambdaGradientPerSentence(ignoreThetaTerms, sentId, sentNll, sentNllGradient)) continue;
+      if(!ComputeNllZGivenXAndLambdaGradientPerSentence(ignoreThetaTerms, sentId, sentNll, sentNllGradient, workspace)) continue;
 
       // update objective value across sentences
       NllPiece += sentNll;
@@ -2262,11 +2875,9 @@ void LatentCrfModel::OptimizeLambdasWithSgd(double& optimizedMiniBatchNll) {
 
     // debug info.
     // now all processes aggregate their NllPiece's and have the same value of reducedNll
-    double reducedNll = -1;
     vector<double> reducedNllGradient;
-    mpi::all_reduce< vector<double> >(*learningInfo.mpiWorld, NllGradientPiece, reducedNllGradient, AggregateVectors2());
-    mpi::all_reduce<double>(*learningInfo.mpiWorld, NllPiece, reducedNll, std::plus<double>());
-    assert(reducedNll != -1);
+    SparseAllReduceSum(NllGradientPiece, lambda->GetParamsCount(), &NllPiece, 1, reducedNllGradient);
+    double reducedNll = NllPiece;
 
     // debug info.
     double nllGradientL2NormSquared = 0.0;
@@ -2423,13 +3034,25 @@ void LatentCrfModel::InitLambda() {
 
   assert(examplesCount > 0);
 
+  // all training loops use the same assignment of sentences to processes
+  PartitionSentences();
+
+  // with hashed features, lambda has a fixed size, so there are no features to discover or broadcast
+  if(lambda->IsHashed()) {
+    lambda->Seal();
+    if(learningInfo.compileFeatures && UseDenseLattices()) {
+      CompileFeatures();
+    }
+    return;
+  }
+
   // then, each process discovers the features that may show up in their sentences.
   for(unsigned sentId = 0; sentId < examplesCount; sentId++) {
 
     assert(learningInfo.mpiWorld->size() > 0);
 
     // skip sentences not assigned to this process
-    if(sentId % learningInfo.mpiWorld->size() != (unsigned)learningInfo.mpiWorld->rank()) {
+    if(!IsMySentence(sentId)) {
       continue;
     }
 
@@ -2441,10 +3064,14 @@ void LatentCrfModel::InitLambda() {
 
     //    FastSparseVector<double> h;
     //    FireFeatures(sentId, h);
-    fst::VectorFst<FstUtils::LogArc> fst;
-    vector<double> derivativeWRTLambda;
-    double objective;
-    BuildLambdaFst(sentId, fst);
+    if(UseDenseLattices()) {
+      // fire the same features the dense lattices will fire during training. the lattice is not pruned, 
+      // since different labels may be pruned in later iterations
+      BuildArcFeatureTable(sentId, workspace.arcFeatureTable, false);
+    } else {
+      fst::VectorFst<FstUtils::LogArc> fst;
+      BuildLambdaFst(sentId, fst);
+    }
   }
 
   if(learningInfo.mpiWorld->rank() == 0) {
@@ -2455,16 +3082,16 @@ void LatentCrfModel::InitLambda() {
   assert(!lambda->IsSealed());
 
   if (learningInfo.mpiWorld->rank() == 0) {
-    std::vector< std::vector< FeatureId > > localFeatureVectors;
+    std::vector< std::vector< FeatureKey > > localFeatureVectors;
     cerr << "master: collecting lambdas from all slaves ... ";
-    mpi::gather<std::vector< FeatureId > >(*learningInfo.mpiWorld, lambda->paramIdsTemp, localFeatureVectors, 0);
+    mpi::gather<std::vector< FeatureKey > >(*learningInfo.mpiWorld, lambda->paramIdsTemp, localFeatureVectors, 0);
     for (int proc = 0; proc < learningInfo.mpiWorld->size(); ++proc) {
       lambda->AddParams(localFeatureVectors[proc]);
     }
     cerr << "master: done collecting all lambda features.  |lambda| = " << lambda->paramIndexes.size() << endl; 
   } else {
     //    cerr << "rank " << learningInfo.mpiWorld->rank() << ": sending my |paramIdsTemp| = " << lambda->paramIdsTemp.size() << "  to master ... ";
-    mpi::gather< std::vector< FeatureId > >(*learningInfo.mpiWorld, lambda->paramIdsTemp, 0);
+    mpi::gather< std::vector< FeatureKey > >(*learningInfo.mpiWorld, lambda->paramIdsTemp, 0);
   }
 
   // master seals his lambda params creating shared memory 
@@ -2476,12 +3103,10 @@ void LatentCrfModel::InitLambda() {
     lambda->Seal();
     assert(lambda->paramIdsTemp.size() == 0 && lambda->paramWeightsTemp.size() == 0);
     assert(lambda->paramIdsPtr != 0 && lambda->paramWeightsPtr != 0);
-    assert(lambda->paramIdsPtr->size() == lambda->paramWeightsPtr->size() && \
-        lambda->paramIdsPtr->size() == lambda->paramIndexes.size());
+    assert(lambda->paramIdsPtr->size() == lambda->paramWeightsPtr->size());
   }
 
-  // paramIndexes is out of sync. master must send it
-  mpi::broadcast<unordered_map_featureId_int>(*learningInfo.mpiWorld, lambda->paramIndexes, 0);
+  // note: slaves need not receive paramIndexes. the index of all parameters is built by master in shared memory
 
   // slaves seal their lambda params, consuming the shared memory created by master
   if(learningInfo.mpiWorld->rank() != 0) {
@@ -2490,8 +3115,12 @@ void LatentCrfModel::InitLambda() {
     lambda->Seal();
     assert(lambda->paramIdsTemp.size() == 0 && lambda->paramWeightsTemp.size() == 0);
     assert(lambda->paramIdsPtr != 0 && lambda->paramWeightsPtr != 0 \
-        && lambda->paramIdsPtr->size() == lambda->paramWeightsPtr->size() \
-        && lambda->paramIdsPtr->size() == lambda->paramIndexes.size());    
+        && lambda->paramIdsPtr->size() == lambda->paramWeightsPtr->size());    
+  }
+
+  // now that all processes agree on the parameter indexes, resolve the features of each sentence once
+  if(learningInfo.compileFeatures && UseDenseLattices()) {
+    CompileFeatures();
   }
 }
 
@@ -2521,39 +3150,101 @@ int64_t LatentCrfModel::GetContextOfTheta(unsigned sentId, int y) {
 double LatentCrfModel::UpdateThetaMleForSent(const unsigned sentId, 
                                              MultinomialParams::ConditionalMultinomialParam<int64_t> &mle, 
                                              boost::unordered_map<int64_t, double> &mleMarginals,
-                                             double learningRate = 1.0) {
+                                             double learningRate,
+                                             SentenceWorkspace &workspace) {
 
   assert(sentId < examplesCount);
 
-  // build the FSTs
-  fst::VectorFst<FstUtils::LogArc> thetaLambdaFst;
-  fst::VectorFst<FstUtils::LogArc> lambdaFst;
-  std::vector<FstUtils::LogWeight> thetaLambdaAlphas, lambdaAlphas, 
-    thetaLambdaBetas, lambdaBetas;
-  BuildThetaLambdaFst(sentId, GetReconstructedObservableSequence(sentId), 
-                      thetaLambdaFst, thetaLambdaAlphas, thetaLambdaBetas);
-  BuildLambdaFst(sentId, lambdaFst, lambdaAlphas, lambdaBetas);
-  
-  // compute the B matrix for this sentence
-  boost::unordered_map< int64_t, boost::unordered_map< int64_t, LogVal<double> > > B;
-  B.clear();
-  ComputeB(sentId, this->GetReconstructedObservableSequence(sentId), 
-           thetaLambdaFst, thetaLambdaAlphas, thetaLambdaBetas, B);
-  
-  // compute the C value for this sentence
-  double nLogC = ComputeNLogC(thetaLambdaFst, thetaLambdaBetas);
-  double nLogZ = ComputeNLogZ_lambda(lambdaFst, lambdaBetas);
+  // B / C, i.e. the expected number of times z is generated by y in this sentence
+  boost::unordered_map< int64_t, boost::unordered_map< int64_t, double > > BOverC;
+  double nLogC, nLogZ;
+  // lambda is fixed during the EM iterations, so Z(x) and the arc scores are only computed 
+  // the first time this sentence is visited after lambda changed
+  // only this thread uses the entry of this sentence, but other threads may add entries concurrently
+  LambdaCacheEntry *cached = 0;
+  {
+    boost::mutex::scoped_lock lock(lambdaCacheMutex);
+    auto cachedIter = lambdaCache.find(sentId);
+    if(cachedIter != lambdaCache.end()) {
+      cached = &cachedIter->second;
+    }
+  }
+  bool lambdaIsCached = cached != 0 && cached->lambdaVersion == lambdaVersion;
+  if(UseDenseLattices()) {
+    // pruning depends on theta. a cached lambda lattice keeps the pruning of the first EM iteration, which 
+    // Z(x) was computed with, until lambda changes. without the lattice, Z(x) can only be reused if nothing is pruned
+    bool pruning = learningInfo.pruningBeamSize > 0 || learningInfo.pruningPosteriorThreshold > 0.0;
+    ArcFeatureTable &arcFeatureTable = workspace.arcFeatureTable;
+    DenseLattice &thetaLambdaLattice = workspace.thetaLambdaLattice;
+    const DenseLattice *lambdaLattice = 0;
+    if(lambdaIsCached && cached->hasLattice) {
+      lambdaLattice = &cached->lattice;
+      nLogZ = cached->nLogZ;
+    } else if(lambdaIsCached && !pruning) {
+      BuildArcFeatureTable(sentId, arcFeatureTable, true);
+      nLogZ = cached->nLogZ;
+    } else {
+      BuildArcFeatureTable(sentId, arcFeatureTable, true);
+      BuildLambdaLattice(arcFeatureTable, workspace.lambdaLattice);
+      lambdaLattice = &workspace.lambdaLattice;
+      nLogZ = lambdaLattice->NLogZ();
+      CacheLambdaQuantities(sentId, lambdaLattice, nLogZ);
+    }
+
+    // build the theta-lambda lattice (from the arc weights of the lambda lattice, when there is one)
+    if(lambdaLattice) {
+      BuildThetaLambdaLattice(sentId, GetReconstructedObservableSequence(sentId), *lambdaLattice, thetaLambdaLattice);
+    } else {
+      BuildThetaLambdaLattice(sentId, GetReconstructedObservableSequence(sentId), arcFeatureTable, thetaLambdaLattice);
+    }
+
+    // compute the B matrix for this sentence. the posteriors come normalized out of the
+    // lattice (without an exp per entry, if the lattice is scaled)
+    ComputeBOverC(sentId, this->GetReconstructedObservableSequence(sentId), thetaLambdaLattice, BOverC);
+    
+    // compute the C value for this sentence
+    nLogC = thetaLambdaLattice.NLogZ();
+  } else {
+    // build the FSTs
+    fst::VectorFst<FstUtils::LogArc> thetaLambdaFst;
+    std::vector<FstUtils::LogWeight> thetaLambdaAlphas, thetaLambdaBetas;
+    BuildThetaLambdaFst(sentId, GetReconstructedObservableSequence(sentId), 
+                        thetaLambdaFst, thetaLambdaAlphas, thetaLambdaBetas);
+    
+    // compute the B matrix for this sentence
+    boost::unordered_map< int64_t, boost::unordered_map< int64_t, LogVal<double> > > B;
+    ComputeB(sentId, this->GetReconstructedObservableSequence(sentId), 
+             thetaLambdaFst, thetaLambdaAlphas, thetaLambdaBetas, B);
+    
+    // compute the C and Z values for this sentence
+    nLogC = ComputeNLogC(thetaLambdaFst, thetaLambdaBetas);
+    if(lambdaIsCached) {
+      nLogZ = cached->nLogZ;
+    } else {
+      fst::VectorFst<FstUtils::LogArc> lambdaFst;
+      std::vector<FstUtils::LogWeight> lambdaAlphas, lambdaBetas;
+      BuildLambdaFst(sentId, lambdaFst, lambdaAlphas, lambdaBetas);
+      nLogZ = ComputeNLogZ_lambda(lambdaFst, lambdaBetas);
+      CacheLambdaQuantities(sentId, 0, nLogZ);
+    }
+
+    for (auto yIter = B.begin(); yIter != B.end(); yIter++) {
+      for (auto zIter = yIter->second.begin(); zIter != yIter->second.end(); zIter++) {
+        double nLogb = -log<double>(zIter->second);
+        assert(zIter->second.s_ == false); //  all B values must be positive
+        BOverC[yIter->first][zIter->first] = MultinomialParams::nExp(nLogb - nLogC);
+      }
+    }
+  }
   double nLogP_ZGivenX = nLogC - nLogZ;
   
   // update mle for each z^*|y^* fired
-  for (auto yIter = B.begin(); yIter != B.end(); yIter++) {
+  for (auto yIter = BOverC.begin(); yIter != BOverC.end(); yIter++) {
     int context = GetContextOfTheta(sentId, yIter->first);
     for (auto zIter = yIter->second.begin(); zIter != yIter->second.end(); 
          zIter++) {
       int64_t z_ = zIter->first;
-      double nLogb = -log<double>(zIter->second);
-      assert(zIter->second.s_ == false); //  all B values must be positive
-      double bOverC = MultinomialParams::nExp(nLogb - nLogC);
+      double bOverC = zIter->second;
       assert(bOverC > -0.001);
 
       if (learningInfo.useEarlyStopping && sentId % 10 == 0) {
@@ -8,6 +8,9 @@
 #include <set>
 #include <algorithm>
 #include <ctime>
+#include <functional>
+#include <atomic>
+#include <chrono>
 
 #include "mpi.h"
 
@@ -16,6 +19,7 @@
 #include <boost/mpi/nonblocking.hpp>
 #include <boost/mpi/collectives.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/serialization/map.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/set.hpp>
@@ -44,6 +48,11 @@
 #include "Functors.h"
 
 #include "LogLinearParams.h"
+#include "DenseLattice.h"
+#include "ArcFeatureTable.h"
+#include "CompiledFeatureIndex.h"
+#include "NodeReducer.h"
+#include "SentencePartition.h"
 #include "UnsupervisedSequenceTaggingModel.h"
 
 typedef std::mt19937 rng;
@@ -106,6 +115,12 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
  public: 
 
   enum Task {POS_TAGGING=0, WORD_ALIGNMENT=1, DEPENDENCY_PARSING=2};
+
+  // the dense lattices and arc features of the sentence being processed
+  struct SentenceWorkspace {
+    DenseLattice lambdaLattice, thetaLambdaLattice;
+    ArcFeatureTable arcFeatureTable;
+  };
   
   // STATIC METHODS
   /////////////////
@@ -192,6 +207,26 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
   
   void BroadcastTheta(unsigned rankId);
 
+  // sums values and scalars (e.g. the nll and the dev set nll) across processes in place, with one in-place 
+  // MPI_Reduce to the master (or one MPI_Allreduce when allProcesses is set) on a contiguous buffer of doubles. 
+  // scalars are appended to values so that they travel in the same message, so values must have room for them
+  // (see ZeroReduceSumBuffer()). with learningInfo.nodeLocalReduce, processes on the same node add up their 
+  // buffers in shared memory first, and only one process per node sends a message.
+  void ReduceSum(std::vector<double> &values, double *scalars, unsigned scalarsCount, bool allProcesses);
+
+  // makes values valuesCount zeros, with room for the scalarsCount scalars ReduceSum() appends to them
+  void ZeroReduceSumBuffer(std::vector<double> &values, unsigned valuesCount, unsigned scalarsCount);
+
+  // one in-place MPI_Reduce to the master (or MPI_Allreduce when allProcesses is set) of buffer[0..count).
+  // used by ReduceSum() without learningInfo.nodeLocalReduce
+  void MpiReduceSum(double *buffer, unsigned count, bool allProcesses);
+
+  // sums sparse values (with indexes < valuesCount) and scalars across all processes into the dense reducedValues.
+  // every process allgathers the (index, value) pairs of the others, so the traffic grows with the number of 
+  // active indexes rather than valuesCount. falls back to ReduceSum when the pairs outweigh the dense vector.
+  void SparseAllReduceSum(const FastSparseVector<double> &values, unsigned valuesCount, 
+                          double *scalars, unsigned scalarsCount, std::vector<double> &reducedValues);
+
   // filenames
   string GetLambdaFilename(int iteration, bool humane);
   string GetThetaFilename(int iteration);
@@ -252,7 +287,8 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
   virtual double UpdateThetaMleForSent(const unsigned sentId, 
                                        MultinomialParams::ConditionalMultinomialParam< int64_t > &mle, 
                                        boost::unordered_map< int64_t , double> &mleMarginals, 
-                                       double eta);
+                                       double eta,
+                                       SentenceWorkspace &workspace);
     
   // adds l2 reguarlization term (for lambdas) to both the objective and the gradient
   double AddL2Term(const std::vector<double> &unregularizedGradient, 
@@ -280,6 +316,72 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
   // build an FST to compute Z(x). also computes potentials
   void BuildLambdaFst(unsigned sentId, fst::VectorFst<FstUtils::LogArc> &fst, std::vector<FstUtils::LogWeight> &alphas, std::vector<FstUtils::LogWeight> &betas);
 
+  // fire the features of this sentence (emissions per state, transitions per arc), and compute their \lambda h
+  // (when prune is set, labels are pruned first; see PruneLatticeLabels(). only training prunes)
+  void BuildArcFeatureTable(unsigned sentId, ArcFeatureTable &arcFeatures, bool prune = false);
+
+  // fill a dense lattice whose arc weights are -\lambda h(y_i, y_{i-1}, x, i), and compute its potentials (unless only decoding)
+  void BuildLambdaLattice(const ArcFeatureTable &arcFeatures, DenseLattice &lattice, bool computePotentials = true);
+
+  // fill a dense lattice whose arc weights are -log \theta_{z_i|y_i} - \lambda h(y_i, y_{i-1}, x, i), and compute its potentials (unless only decoding)
+  void BuildThetaLambdaLattice(unsigned sentId, const std::vector<int64_t> &z, 
+                               const ArcFeatureTable &arcFeatures, DenseLattice &lattice, bool computePotentials = true);
+
+  // same, adding -log \theta_{z_i|y_i} to the arc weights of a lambda lattice
+  void BuildThetaLambdaLattice(unsigned sentId, const std::vector<int64_t> &z, 
+                               const DenseLattice &lambdaLattice, DenseLattice &lattice, bool computePotentials = true);
+
+  // adds -log \theta_{z_i|y_i} to the weight of each arc into y_i
+  void AddNLogThetas(unsigned sentId, const std::vector<int64_t> &z, DenseLattice &lattice);
+
+  // the values y_i may take in this example (i.e. yDomain minus the special start/end values, after PrepareExample())
+  virtual void GetLatticeLabels(unsigned sentId, std::vector<int> &labels);
+
+  // marks the labels which are unlikely to be used at each timestep as not allowed (see learningInfo.pruningBeamSize 
+  // and learningInfo.pruningPosteriorThreshold), based on the posterior of y_i given z_i according to theta
+  void PruneLatticeLabels(unsigned sentId, ArcFeatureTable &arcFeatures);
+
+  // whether to use DenseLattice (rather than openfst lattices) for forward/backward computations
+  bool UseDenseLattices() const;
+
+  // assigns the training sentences to processes, once, by the estimated cost of their lattices (see
+  // learningInfo.balanceSentencesByCost), and reports the expected load of each process
+  void PartitionSentences();
+
+  // true if sentId is assigned to this process
+  bool IsMySentence(unsigned sentId) const;
+
+  // reports the time each process spent in ProcessSentences() since the last report (collective)
+  void ReportSentenceLoads();
+
+  // the number of threads which process the training sentences of this process (see learningInfo.threadsPerRank).
+  // only the dense lattices of compiled sentences can be processed concurrently, since firing features modifies 
+  // state shared between sentences
+  unsigned SentenceThreadsCount() const;
+
+  // the number of threads DenseLattice::ComputePotentials() may split the positions of one sentence among 
+  // (see DenseLattice::positionThreads). only used when sentences aren't already processed concurrently
+  unsigned PositionThreadsCount() const;
+
+  // calls process(sentId, threadId) for each of sentIds, from threadsCount threads which keep taking the next 
+  // unprocessed sentence. GetWorkspace(threadId) is reserved for the calling thread
+  void ProcessSentences(const std::vector<unsigned> &sentIds, unsigned threadsCount, 
+                        const std::function<void (unsigned sentId, unsigned threadId)> &process);
+
+  // the member workspace for the first thread, threadWorkspaces for the others
+  SentenceWorkspace& GetWorkspace(unsigned threadId);
+
+  // fire the features of every sentence processed by this process once more, and keep their parameter indexes 
+  // in compiledFeatures, so that BuildArcFeatureTable() does not fire them again (requires sealed lambda params)
+  void CompileFeatures();
+
+  // must be called whenever lambda may have changed. invalidates the lambda-only quantities cached in lambdaCache
+  void LambdaChanged();
+
+  // remember Z(x) of this sentence according to the current lambda, and the arc weights of its (pruned) lambda
+  // lattice if they fit in learningInfo.lambdaCacheMegabytes
+  void CacheLambdaQuantities(unsigned sentId, const DenseLattice *lambdaLattice, double nLogZ);
+
   // iterates over training examples, accumulates p(z|x) according to the current model and also accumulates its derivative w.r.t lambda
   virtual double ComputeNllZGivenXAndLambdaGradient(vector<double> &gradient, int fromSentId, int toSentId, double *devSetNll);
   virtual double ComputeNllYGivenXAndLambdaGradient(vector<double> &gradient, int fromSentId, int toSentId);
@@ -287,7 +389,8 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
   virtual bool ComputeNllZGivenXAndLambdaGradientPerSentence(bool ignoreThetaTerms, 
                                                              int sentId,
                                                              double& sentNll,
-                                                             FastSparseVector<double>& sentNllGradient);
+                                                             FastSparseVector<double>& sentNllGradient,
+                                                             SentenceWorkspace &workspace);
   
 
   // compute the partition function Z_\lambda(x)
@@ -328,6 +431,19 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
 		const std::vector<FstUtils::LogWeight> &alphas, const std::vector<FstUtils::LogWeight> &betas,
 		FastSparseVector<double> &DOverCk);
 
+  // same as above, but using dense lattices populated with BuildLambdaLattice() and BuildThetaLambdaLattice().
+  // the expected counts are normalized by C, i.e. BOverC[y][z] = B[y][z] / C
+  void ComputeBOverC(unsigned sentId, const std::vector<int64_t> &z, const DenseLattice &lattice, 
+		     boost::unordered_map< int64_t, boost::unordered_map< int64_t, double > > &BOverC);
+  void ComputeB(unsigned sentId, const std::vector<int64_t> &z, const DenseLattice &lattice, 
+		boost::unordered_map< std::pair<int64_t, int64_t>, boost::unordered_map< int64_t, LogVal<double> > > &BXZ);
+  void ComputeFOverZ(const ArcFeatureTable &arcFeatures, const DenseLattice &lattice, FastSparseVector<double> &FOverZk);
+  void ComputeDOverC(const ArcFeatureTable &arcFeatures, const DenseLattice &lattice, FastSparseVector<double> &DOverCk);
+
+  // accumulates the expected value of each feature under the distribution defined by a dense lattice
+  void ComputeFeatureExpectations(const ArcFeatureTable &arcFeatures, const DenseLattice &lattice, 
+                                  FastSparseVector<double> &expectations);
+
  protected:
   LatentCrfModel(const std::string &textFilename, 
 		 const std::string &outputPrefix, 
@@ -382,6 +498,46 @@ class LatentCrfModel : public UnsupervisedSequenceTaggingModel {
 
   // random generator
   rng random_generator; 
+
+  // dense lattices reused across sentences when learningInfo.useDenseLattices is set. each thread which processes
+  // sentences has its own (see ProcessSentences())
+  SentenceWorkspace workspace;
+  std::vector<SentenceWorkspace> threadWorkspaces;
+
+  // the features of the training sentences, when learningInfo.compileFeatures is set
+  CompiledFeatureIndex compiledFeatures;
+
+  // the quantities of one sentence which only depend on lambda, and can be reused across EM iterations
+  struct LambdaCacheEntry {
+    LambdaCacheEntry() : lambdaVersion(0), nLogZ(0.0), hasLattice(false) {}
+    // the value of LatentCrfModel::lambdaVersion when this entry was computed
+    unsigned lambdaVersion;
+    double nLogZ;
+    // when hasLattice is set, lattice holds the arc weights -\lambda h of the labels kept by pruning (but no potentials)
+    bool hasLattice;
+    DenseLattice lattice;
+  };
+
+  // sentId -> lambda-only quantities of the sentences processed by this process
+  boost::unordered_map<unsigned, LambdaCacheEntry> lambdaCache;
+
+  // incremented by LambdaChanged(). entries of lambdaCache with an older version are stale
+  unsigned lambdaVersion;
+
+  // memory used by the lattices in lambdaCache
+  size_t lambdaCacheBytes;
+
+  // the process of each training sentence, and the time this process spent in ProcessSentences() since the last
+  // ReportSentenceLoads()
+  SentencePartition sentencePartition;
+  double sentencesSeconds;
+
+  // guards lambdaCache and lambdaCacheBytes while sentences are processed concurrently
+  boost::mutex lambdaCacheMutex;
+
+  // sums the buffers of ReduceSum in shared memory before reducing across nodes, when learningInfo.nodeLocalReduce
+  // is set. initialized by the first ReduceSum
+  NodeReducer nodeReducer;
 };
 
 #endif
@@ -53,6 +53,7 @@ class LearningInfo {
     unspecified = 0;
     unspecified2 = 0;
     firstKExamplesToLabel = 0;
+    threadsPerRank = 1;
     invokeCallbackFunctionEveryKIterations = 10;
     endOfKIterationsCallbackFunction = 0;
     nSentsPerDot = 1;
@@ -69,6 +70,18 @@ class LearningInfo {
     maxSequenceLength = 0;
     hiddenSequenceIsMarkovian = true;
     cacheActiveFeatures = false;
+    featureCacheSize = 1000000;
+    useDenseLattices = false;
+    useScaledLattices = false;
+    pruningBeamSize = 0;
+    pruningPosteriorThreshold = 0.0;
+    lambdaCacheMegabytes = 0;
+    compileFeatures = false;
+    nodeLocalReduce = false;
+    balanceSentencesByCost = true;
+    logSumExpKernels = "auto";
+    featureHashBits = 0;
+    signedFeatureHash = false;
     multinomialSymmetricDirichletAlpha = 1.0;
     variationalInferenceOfMultinomials = false;
     testWithCrfOnly = false;
@@ -325,6 +338,10 @@ class LearningInfo {
 
   unsigned firstKExamplesToLabel;
 
+  // number of threads used by each mpi process to label sentences with a thread-safe model, and to process 
+  // training sentences (see LatentCrfModel::SentenceThreadsCount())
+  unsigned threadsPerRank;
+
   unsigned invokeCallbackFunctionEveryKIterations;
 
   void (*endOfKIterationsCallbackFunction)();
@@ -353,6 +370,48 @@ class LearningInfo {
   bool hiddenSequenceIsMarkovian;
 
   bool cacheActiveFeatures;
+
+  // with cacheActiveFeatures, the maximum number of factors whose active features are cached (per process)
+  unsigned featureCacheSize;
+
+  // use contiguous arrays instead of openfst lattices for forward/backward computations
+  bool useDenseLattices;
+
+  // compute dense lattice potentials in probability space with per-timestep scaling (instead of the log semiring),
+  // except for sentences which would underflow
+  bool useScaledLattices;
+
+  // dense lattices only keep the top pruningBeamSize labels at each position (0 = no beam), and the labels whose 
+  // posterior p(y_i|z_i) according to theta is at least pruningPosteriorThreshold (0 = no threshold)
+  unsigned pruningBeamSize;
+  double pruningPosteriorThreshold;
+
+  // while theta is optimized with EM, the arc weights of the (pruned) dense lambda lattices are cached for each
+  // sentence until they use this many megabytes in each MPI process, i.e. the total is this budget times the number
+  // of ranks on a node (0 = only cache Z(x), which is always cached)
+  unsigned lambdaCacheMegabytes;
+
+  // with dense lattices, keep the parameter indexes of the features fired on each training sentence 
+  // after lambda is sealed, instead of firing them again in every iteration (trades memory for speed)
+  bool compileFeatures;
+
+  // reduce gradients and objectives in two levels: processes on the same node add them up in the shared memory 
+  // segment, then one process per node takes part in the MPI reduction
+  bool nodeLocalReduce;
+
+  // assign training sentences to processes by the estimated cost of their lattices (longest first, each to the least
+  // loaded process) rather than round-robin
+  bool balanceSentencesByCost;
+
+  // the log-sum-exp kernels of dense lattices: "auto" picks them by the number of labels (see LogSumExp::Best(K)),
+  // "scalar", "avx2" or "avx512" forces them
+  string logSumExpKernels;
+
+  // when non-zero, lambda is a fixed array of 2^featureHashBits weights indexed by the hash of each feature id, 
+  // rather than one weight per feature discovered in the training data. signedFeatureHash also hashes each 
+  // feature to a sign, which reduces the bias introduced by collisions
+  unsigned featureHashBits;
+  bool signedFeatureHash;
   
   // this makes the optimization problem convex
   bool fixPosteriorExpectationsAccordingToPZGivenXWhileOptimizingLambdas;
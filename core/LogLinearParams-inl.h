@@ -18,8 +18,18 @@ public:
     assert(weightsMultiplier > 0.0);
     assert(sealed);
     double unscaledValue = newValue / weightsMultiplier;
-    if(!AddParam(paramId, unscaledValue)) {
-      (*paramWeightsPtr)[paramIndexes[paramId]] = unscaledValue;
+    FeatureKey paramKey(paramId);
+    if(IsHashed()) {
+      double sign;
+      unsigned paramIndex = HashedParamIndex(paramKey, sign);
+      (*paramWeightsPtr)[paramIndex] = sign * unscaledValue;
+    } else {
+      int paramIndex = sealedIndex.Find(paramKey);
+      if(paramIndex < 0) {
+        cerr << "trying to update the following paramId after object is sealed: " << paramId << endl;
+        throw LogLinearParamsException("updating a parameter which does not exist after object is sealed!");
+      }
+      (*paramWeightsPtr)[paramIndex] = unscaledValue;
     }
   }
 
@@ -33,34 +43,94 @@ public:
     (*paramWeightsPtr)[paramIndex] = newValue / weightsMultiplier;
   }
 
+  // with learningInfo->featureHashBits > 0, parameters are not indexed in paramIndexes. instead, each feature id
+  // is hashed into one of 2^featureHashBits slots of the weights array
+  inline bool IsHashed() const {
+    return learningInfo->featureHashBits > 0;
+  }
+
+  // the slot of a feature id in hashing mode. with a signed hash, features which collide in the same slot 
+  // contribute with independent signs (+1/-1), so that collisions cancel out in expectation
+  inline unsigned HashedParamIndex(const FeatureKey &paramKey, double &sign) const {
+    size_t hash = FeatureKey::FeatureKeyHash()(paramKey);
+    sign = learningInfo->signedFeatureHash && ((hash >> learningInfo->featureHashBits) & 1)? -1.0 : 1.0;
+    return hash & (((size_t)1 << learningInfo->featureHashBits) - 1);
+  }
+
+  // activeFeatures[index of paramId] += value. before Seal() (i.e. while discovering features in InitLambda), 
+  // new parameters are added. after Seal(), the parameter is looked up in the read-only sealedIndex and 
+  // features which were not discovered are skipped
+  inline void FireFeature(const FeatureId &paramId, double value, FastSparseVector<double> &activeFeatures) {
+    FeatureKey paramKey(paramId);
+    if(IsHashed()) {
+      double sign;
+      unsigned paramIndex = HashedParamIndex(paramKey, sign);
+      activeFeatures[paramIndex] += sign * value;
+    } else if(sealed) {
+      int paramIndex = sealedIndex.Find(paramKey);
+      if(paramIndex >= 0) {
+        activeFeatures[paramIndex] += value;
+      }
+    } else {
+      AddParam(paramKey);
+      activeFeatures[paramIndexes[paramKey]] += value;
+    }
+  }
+
   // checks whether a parameter exists
   inline bool ParamExists(const FeatureId &paramId) {
-    return paramIndexes.count(paramId) == 1;
+    FeatureKey paramKey(paramId);
+    return IsHashed() || (sealed? sealedIndex.Find(paramKey) >= 0 : paramIndexes.count(paramKey) == 1);
   }
 
   // checks whether a parameter exists
   inline bool ParamExists(const unsigned &paramIndex) {
-    return paramIndex < paramIndexes.size();
+    return paramIndex < GetParamsCount();
   }
 
   // returns the int index of the parameter in the underlying array
   inline unsigned GetParamIndex(const FeatureId &paramId) {
-    AddParam(paramId);
-    return paramIndexes[paramId];
+    FeatureKey paramKey(paramId);
+    if(IsHashed()) {
+      double sign;
+      return HashedParamIndex(paramKey, sign);
+    } else if(sealed) {
+      int paramIndex = sealedIndex.Find(paramKey);
+      assert(paramIndex >= 0);
+      return paramIndex;
+    }
+    AddParam(paramKey);
+    return paramIndexes[paramKey];
   }
 
   // returns the string identifier of the parameter given its int index in the weights array
   inline FeatureId GetParamId(const unsigned paramIndex) {
     assert(sealed);
+    // feature ids are not kept in hashing mode
+    assert(!IsHashed());
+    assert(paramIndex < paramWeightsPtr->size());
+    return (*paramIdsPtr)[paramIndex].ToFeatureId();
+  }
+
+  // the packed form of GetParamId()
+  inline const FeatureKey& GetParamKey(const unsigned paramIndex) {
+    assert(sealed);
+    assert(!IsHashed());
     assert(paramIndex < paramWeightsPtr->size());
     return (*paramIdsPtr)[paramIndex];
   }
 
-  // returns the current weight of this param (adds the parameter if necessary)
+  // returns the current weight of this param (zero if the parameter does not exist)
   inline double GetParamWeight(const FeatureId &paramId) {
     assert(sealed);
-    AddParam(paramId);
-    return (*paramWeightsPtr)[paramIndexes[paramId]] * weightsMultiplier;
+    FeatureKey paramKey(paramId);
+    if(IsHashed()) {
+      double sign;
+      unsigned paramIndex = HashedParamIndex(paramKey, sign);
+      return sign * (*paramWeightsPtr)[paramIndex] * weightsMultiplier;
+    }
+    int paramIndex = sealedIndex.Find(paramKey);
+    return paramIndex < 0? 0.0 : (*paramWeightsPtr)[paramIndex] * weightsMultiplier;
   }
   
   // returns the current weight of this param (adds the parameter if necessary)
@@ -71,9 +141,12 @@ public:
   }
   
   inline unsigned GetParamsCount() {
+    if(IsHashed()) {
+      return sealed? paramWeightsPtr->size() : 0;
+    }
     if(sealed) {
       assert(paramWeightsPtr->size() == paramIdsPtr->size());
-      assert(paramWeightsPtr->size() == paramIndexes.size());
+      return paramWeightsPtr->size();
     } else {
       assert(paramWeightsTemp.size() == paramIdsTemp.size());
       assert(paramWeightsTemp.size() == paramIndexes.size());
@@ -81,6 +154,18 @@ public:
     return paramIndexes.size();
   }
 
+  // should FireFeatures() fire this template, given firedTemplates?
+  inline bool IsFired(FeatureTemplate featureTemplate) const {
+    switch(firedTemplates) {
+    case FeatureTemplateSubset::LABEL:
+      return !DependsOnPreviousLabel(featureTemplate);
+    case FeatureTemplateSubset::LABEL_PAIR:
+      return DependsOnPreviousLabel(featureTemplate);
+    default:
+      return true;
+    }
+  }
+
   // returns a pointer to the array of parameter weights
   // note: in order to get the correct weight values, multiply this array by weightsMultiplier.
   inline double* GetParamWeightsArray() { 
@@ -1,3 +1,5 @@
+#include <cstdlib>
+
 #include "LogLinearParams.h"
 #include "LatentCrfModel.h"
 
@@ -191,6 +193,113 @@ std::ostream& operator<<(std::ostream& os, const FeatureId& obj)
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, const FeatureKey& obj)
+{
+  return os << obj.ToFeatureId();
+}
+
+void FeatureKey::FieldOverflow(unsigned bits, int64_t value) const {
+  // the template is always packed first, so it can be reported
+  cerr << "FATAL ERROR: a field of a feature of template " << Type() << " has the value " << value 
+       << ", which does not fit in the " << bits << " bits FeatureKey packs it in." << endl << "will terminate." << endl;
+  abort();
+}
+
+// the inverse of FeatureKey(featureId)
+FeatureId FeatureKey::ToFeatureId() const {
+  FeatureId featureId;
+  memset(&featureId, 0, sizeof(FeatureId));
+  unsigned offset = 0;
+  featureId.type = (FeatureTemplate) Get(offset, 8);
+  switch(featureId.type) {
+  case FeatureTemplate::BOUNDARY_LABELS:
+    featureId.boundaryLabel.position = Get(offset, 32);
+    featureId.boundaryLabel.label = Get(offset, 32);
+    break;
+  case FeatureTemplate::EMISSION:
+    featureId.emission.displacement = Get(offset, 16);
+    featureId.emission.label = Get(offset, 32);
+    featureId.emission.word = Get(offset, 40);
+    break;
+  case FeatureTemplate::PRECOMPUTED_PAIR:
+    featureId.precomputedPair.displacement = Get(offset, 16);
+    featureId.precomputedPair.label = Get(offset, 24);
+    featureId.precomputedPair.word = Get(offset, 40);
+    featureId.precomputedPair.other_word = Get(offset, 40);
+    break;
+  case FeatureTemplate::LABEL_BIGRAM:
+  case FeatureTemplate::SRC_BIGRAM:
+    featureId.bigram.current = Get(offset, 40);
+    featureId.bigram.previous = Get(offset, 40);
+    break;
+  case FeatureTemplate::ALIGNMENT_JUMP:
+  case FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO:
+    featureId.alignmentJump = Get(offset, 32);
+    break;
+  case FeatureTemplate::LOG_ALIGNMENT_JUMP:
+    featureId.biasedAlignmentJump.alignmentJump = Get(offset, 32);
+    featureId.biasedAlignmentJump.wordBias = Get(offset, 64);
+    break;
+  case FeatureTemplate::SRC0_TGT0:
+  case FeatureTemplate::HC_TOKEN:
+  case FeatureTemplate::HC_POS:
+  case FeatureTemplate::CH_TOKEN:
+  case FeatureTemplate::CH_POS:
+  case FeatureTemplate::HEAD_CHILD_TOKEN_SET:
+  case FeatureTemplate::HEAD_CHILD_POS_SET:
+    featureId.wordPair.srcWord = Get(offset, 60);
+    featureId.wordPair.tgtWord = Get(offset, 60);
+    break;
+  case FeatureTemplate::HXC_POS:
+  case FeatureTemplate::CXH_POS:
+  case FeatureTemplate::XHC_POS:
+  case FeatureTemplate::XCH_POS:
+  case FeatureTemplate::HCX_POS:
+  case FeatureTemplate::CHX_POS:
+  case FeatureTemplate::HXxC_POS:
+  case FeatureTemplate::CXxH_POS:
+  case FeatureTemplate::HxXC_POS:
+  case FeatureTemplate::CxXH_POS:
+  case FeatureTemplate::POS_PAIR_DISTANCE:
+    featureId.wordTriple.word1 = Get(offset, 40);
+    featureId.wordTriple.word2 = Get(offset, 40);
+    featureId.wordTriple.word3 = Get(offset, 40);
+    break;
+  case FeatureTemplate::PRECOMPUTED:
+    featureId.precomputed = Get(offset, 64);
+    break;
+  case FeatureTemplate::DIAGONAL_DEVIATION:
+  case FeatureTemplate::SRC_WORD_BIAS:
+  case FeatureTemplate::HEAD_POS:
+  case FeatureTemplate::CHILD_POS:
+    featureId.wordBias = Get(offset, 64);
+    break;
+  case FeatureTemplate::SYNC_START:
+  case FeatureTemplate::SYNC_END:
+  case FeatureTemplate::NULL_ALIGNMENT:
+  case FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO:
+    break;
+  case FeatureTemplate::OTHER_ALIGNERS:
+    featureId.otherAligner.alignerId = Get(offset, 40);
+    featureId.otherAligner.compatible = Get(offset, 8);
+    break;
+  case FeatureTemplate::OTHER_POS:
+    featureId.otherPos.posId = Get(offset, 24);
+    featureId.otherPos.label = Get(offset, 32);
+    featureId.otherPos.pred_hash = Get(offset, 64);
+    break;
+  case FeatureTemplate::PHRASE:
+    featureId.phraseListFeature.bigramInContext = Get(offset, 8);
+    featureId.phraseListFeature.phraseListId = Get(offset, 40);
+    featureId.phraseListFeature.label = Get(offset, 32);
+    featureId.phraseListFeature.imLabel = Get(offset, 32);
+    break;
+  default:
+    assert(false);
+  }
+  return featureId;
+}
+
 
 LogLinearParams::LogLinearParams(VocabEncoder &types, 
                                  double gaussianStdDev) :
@@ -202,7 +311,62 @@ LogLinearParams::LogLinearParams(VocabEncoder &types,
   sealed = false;
   paramIdsPtr = 0;
   paramWeightsPtr = 0;
+  paramIndexSlotsPtr = 0;
   weightsMultiplier = 1.0;
+  firedTemplates = FeatureTemplateSubset::ALL;
+  wordPairFeaturesMapped = false;
+  alignerExtractor = &LogLinearParams::FireAlignerTemplatesGeneric;
+  posExtractor = &LogLinearParams::FirePosTemplatesGeneric;
+  posTemplatesAreSentenceSpecific = false;
+}
+
+bool LogLinearParams::DependsOnPreviousLabel(FeatureTemplate featureTemplate) {
+  switch(featureTemplate) {
+  case FeatureTemplate::LABEL_BIGRAM:
+  case FeatureTemplate::PHRASE:
+  case FeatureTemplate::ALIGNMENT_JUMP:
+  case FeatureTemplate::LOG_ALIGNMENT_JUMP:
+  case FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO:
+  case FeatureTemplate::SRC_BIGRAM:
+  case FeatureTemplate::DIAGONAL_DEVIATION:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool LogLinearParams::DependsOnPosition(FeatureTemplate featureTemplate) {
+  switch(featureTemplate) {
+  case FeatureTemplate::LABEL_BIGRAM:
+  case FeatureTemplate::ALIGNMENT_JUMP:
+  case FeatureTemplate::LOG_ALIGNMENT_JUMP:
+  case FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO:
+  case FeatureTemplate::SRC_BIGRAM:
+    return false;
+  default:
+    return true;
+  }
+}
+
+bool LogLinearParams::HasEnabledTemplates(FeatureTemplateSubset::FeatureTemplateSubset subset) {
+  for(auto featTemplateIter = learningInfo->featureTemplates.begin();
+      featTemplateIter != learningInfo->featureTemplates.end(); ++featTemplateIter) {
+    if(subset == FeatureTemplateSubset::ALL ||
+       (subset == FeatureTemplateSubset::LABEL_PAIR) == DependsOnPreviousLabel(*featTemplateIter)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LogLinearParams::LabelPairTemplatesArePositionIndependent() {
+  for(auto featTemplateIter = learningInfo->featureTemplates.begin();
+      featTemplateIter != learningInfo->featureTemplates.end(); ++featTemplateIter) {
+    if(DependsOnPreviousLabel(*featTemplateIter) && DependsOnPosition(*featTemplateIter)) {
+      return false;
+    }
+  }
+  return true;
 }
 
 bool LogLinearParams::IsSealed() const {
@@ -220,12 +384,20 @@ void* LogLinearParams::MapToSharedMemory(bool create, const string objectNicknam
     }
 
   } else if (string(objectNickname) == string("paramIds")) {
-    ShmemFeatureIdAllocator sharedMemoryFeatureIdAllocator(learningInfo->sharedMemorySegment->get_segment_manager());
+    ShmemFeatureKeyAllocator sharedMemoryFeatureKeyAllocator(learningInfo->sharedMemorySegment->get_segment_manager());
     if(create) {
-      auto ptr = learningInfo->sharedMemorySegment->find_or_construct<ShmemVectorOfFeatureId> (objectNickname.c_str()) (sharedMemoryFeatureIdAllocator);
+      auto ptr = learningInfo->sharedMemorySegment->find_or_construct<ShmemVectorOfFeatureKey> (objectNickname.c_str()) (sharedMemoryFeatureKeyAllocator);
       return ptr;
     } else {
-      return learningInfo->sharedMemorySegment->find<ShmemVectorOfFeatureId> (objectNickname.c_str()).first;
+      return learningInfo->sharedMemorySegment->find<ShmemVectorOfFeatureKey> (objectNickname.c_str()).first;
+    }
+
+  } else if (string(objectNickname) == string("paramIndexSlots")) {
+    ShmemParamIndexSlotAllocator sharedMemorySlotAllocator(learningInfo->sharedMemorySegment->get_segment_manager());
+    if(create) {
+      return learningInfo->sharedMemorySegment->find_or_construct<ShmemVectorOfParamIndexSlot> (objectNickname.c_str()) (sharedMemorySlotAllocator);
+    } else {
+      return learningInfo->sharedMemorySegment->find<ShmemVectorOfParamIndexSlot> (objectNickname.c_str()).first;
     }
 
   } /*else if (string(objectNickname) == string("precomputedFeaturesWithTwoInputs")) {
@@ -240,67 +412,35 @@ void* LogLinearParams::MapToSharedMemory(bool create, const string objectNicknam
   }
 }
 
-OuterMappedType* LogLinearParams::MapWordPairFeaturesToSharedMemory(bool create, const std::pair<int64_t, int64_t> &wordPair) {
-  //cerr << "ttt0:" << wordPair.first << ","<<wordPair.second << endl;
-  if(cacheWordPairFeatures.count(wordPair) == 0) {
-    stringstream ss;
-    ss << wordPair.first << " " << wordPair.second;
-    string wordPairStr = ss.str();
-    auto features = MapWordPairFeaturesToSharedMemory(create, wordPairStr);
-    cacheWordPairFeatures[wordPair] = features;
-    return features;
-  } else {
-    return cacheWordPairFeatures[wordPair];
+// the precomputed features of a word pair (see LoadPrecomputedFeaturesWith2Inputs()). may be empty
+WordPairFeatureRange LogLinearParams::GetWordPairFeatures(const std::pair<int64_t, int64_t> &wordPair) {
+  if(wordPairFeaturesFile.IsMapped()) {
+    return wordPairFeaturesFile.Find(wordPair.first, wordPair.second);
   }
-}
-
-// disclaimer: may return zeros
-OuterMappedType* LogLinearParams::MapWordPairFeaturesToSharedMemory(bool create, const string& objectNickname) {
-  ShmemInnerValueAllocator sharedMemorySimpleMapAllocator(learningInfo->sharedMemorySegment->get_segment_manager()); 
-  if(create) {
-    try {
-      auto temp = learningInfo->sharedMemorySegment->find< OuterMappedType > (objectNickname.c_str()).first;
-      if(temp) {
-        return temp;
-      }
-    } catch(std::exception const&  ex) {
-      assert(false);
-    }
-
-    try {
-      auto temp = learningInfo->sharedMemorySegment->construct< OuterMappedType > (objectNickname.c_str()) (std::less<InnerKeyType>(), sharedMemorySimpleMapAllocator);
-      return temp;
-    } catch(std::exception const& ex) {
-      cerr << "sharedMemorySegment->construct( " << objectNickname << " ) threw " << ex.what() << endl;
-      assert(false);
-    }
-  } else {
-    try {
-      auto temp = learningInfo->sharedMemorySegment->find< OuterMappedType > (objectNickname.c_str()).first;
-      if(temp) { 
-        return temp;
-      } else {
-        return 0;
-      }
-    } catch (std::exception const& ex) {
-      cerr << "create == false, sharedMemorySegment->find( " << objectNickname << " ) threw " << ex.what() << endl;
-      assert(false);
+  // the table is built by the master. other processes map it the first time they need it
+  if(!wordPairFeaturesMapped) {
+    if(!wordPairFeatures.IsMapped()) {
+      wordPairFeatures.Map(*learningInfo->sharedMemorySegment);
     }
+    wordPairFeaturesMapped = true;
   }
+  return wordPairFeatures.Find(wordPair.first, wordPair.second);
 }
 
 void LogLinearParams::Seal() {
   assert(!sealed);
   assert(paramIdsPtr == 0 && paramWeightsPtr == 0);
+  if(IsHashed()) {
+    SealHashed();
+    return;
+  }
   if(learningInfo->mpiWorld->rank() == 0) {
     paramWeightsPtr = (ShmemVectorOfDouble *) MapToSharedMemory(true, "paramWeights");
     assert(paramWeightsPtr != 0);
-    paramIdsPtr = (ShmemVectorOfFeatureId *) MapToSharedMemory(true, "paramIds");
+    paramIdsPtr = (ShmemVectorOfFeatureKey *) MapToSharedMemory(true, "paramIds");
     assert(paramIdsPtr != 0);
-    
-    // sync
-    bool dummy = true;
-    boost::mpi::broadcast<bool>(*learningInfo->mpiWorld, dummy, 0);
+    paramIndexSlotsPtr = (ShmemVectorOfParamIndexSlot *) MapToSharedMemory(true, "paramIndexSlots");
+    assert(paramIndexSlotsPtr != 0);
     
     // copy paramIdsTemp and paramWeightsTemp, and wipe off temporary parameters you had
     assert(paramWeightsTemp.size() == paramIdsTemp.size());
@@ -309,31 +449,42 @@ void LogLinearParams::Seal() {
       paramIdsPtr->push_back(paramIdsTemp[i]);
     }
 
+    // the index of all parameters is built once, and used read-only by all processes
+    ParamIndex::Slot emptySlot = {0, -1, 0};
+    paramIndexSlotsPtr->assign(ParamIndex::SlotsCount(paramIdsPtr->size()), emptySlot);
+    ParamIndex::Build(paramIdsPtr->data(), paramIdsPtr->size(), paramIndexSlotsPtr->data());
+    
+    // sync
+    bool dummy = true;
+    boost::mpi::broadcast<bool>(*learningInfo->mpiWorld, dummy, 0);
+
   } else {
 
     // this is done by the slaves, not the master
     assert(learningInfo->mpiWorld->rank() != 0);
-    // first, wipe off all the parameters you already have to save memory
 
     // sync
     bool dummy = true;
     boost::mpi::broadcast<bool>(*learningInfo->mpiWorld, dummy, 0);
 
-    // map paramIds and paramWeights to shared memory
+    // map paramIds, paramWeights and the index to shared memory
     paramWeightsPtr = (ShmemVectorOfDouble *)MapToSharedMemory(false, "paramWeights");
-    paramIdsPtr = (ShmemVectorOfFeatureId *)MapToSharedMemory(false, "paramIds");
+    paramIdsPtr = (ShmemVectorOfFeatureKey *)MapToSharedMemory(false, "paramIds");
+    paramIndexSlotsPtr = (ShmemVectorOfParamIndexSlot *)MapToSharedMemory(false, "paramIndexSlots");
   }
-  assert(paramIdsPtr != 0 && paramWeightsPtr != 0);
+  assert(paramIdsPtr != 0 && paramWeightsPtr != 0 && paramIndexSlotsPtr != 0);
+
+  // from now on, features are looked up in the read-only index
+  sealedIndex.Attach(paramIdsPtr->data(), paramIndexSlotsPtr->data(), paramIndexSlotsPtr->size());
 
-  // update the feature indexes to reference paramIdsPtr instead of paramIdsTemp. you need to keep track of the indexes served by your process. note: this puts a restriction that a sentence must be decoded using its respective process.
-  int localParams = paramIndexes.size(), localParamsInGlobalVector = 0;
-  for(int i = 0; i < paramIdsPtr->size(); ++i) {
-    if(paramIndexes.count( (*paramIdsPtr)[i] ) == 1) {
-      paramIndexes[ (*paramIdsPtr)[i] ] = i;
+  // sanity check: all features fired by this process while initializing lambdas must be in the shared vector.
+  // note: this puts a restriction that a sentence must be decoded using its respective process.
+  int localParams = paramIdsTemp.size(), localParamsInGlobalVector = 0;
+  for(auto paramIdIter = paramIdsTemp.begin(); paramIdIter != paramIdsTemp.end(); ++paramIdIter) {
+    if(sealedIndex.Find(*paramIdIter) >= 0) {
       localParamsInGlobalVector++;
     }
   }
-  // sanity check
   if(localParams != localParamsInGlobalVector) {
     cerr << "this is a major bug in LogLinearParams.cc; I'm not sure what caused the bug but "
          << "process #" << learningInfo->mpiWorld->rank() << " fired " << localParams << " unique features "
@@ -354,15 +505,15 @@ void LogLinearParams::Seal() {
         ++oldIndexIter) {
       int oldIndex = oldIndexIter->first;
       double featureValue = oldIndexIter->second;
-      FeatureId &featureId = paramIdsTemp[oldIndex];
-      int newIndex = paramIndexes[featureId];
+      int newIndex = sealedIndex.Find(paramIdsTemp[oldIndex]);
       factorIdIter->second[newIndex] = featureValue;
     }
   }
   
-  // we no longer need the temp weights/ids
+  // we no longer need the temp weights/ids, nor the index of the features discovered by this process
   paramWeightsTemp.clear(); 
   paramIdsTemp.clear(); 
+  unordered_map_featureKey_int().swap(paramIndexes);
     
   
   // now every core reads the mean of the gaussian prior for features specified in learningInfo.featureGaussianMeanFilename, and keep a map with FeatureId keys and double values (i.e. the mean)
@@ -392,7 +543,7 @@ void LogLinearParams::Seal() {
       stringstream featureIdString(splits[0]);
       featureIdString >> featureId;
       // now add this one to the map
-      featureGaussianMeans[featureId] = gaussianMean;
+      featureGaussianMeans[FeatureKey(featureId)] = gaussianMean;
     }
     featureGaussianMeanFile.close();
     if(learningInfo->mpiWorld->rank() == 0) {
@@ -403,11 +554,48 @@ void LogLinearParams::Seal() {
   sealed = true;
 }
 
+// in hashing mode, all processes share 2^featureHashBits weights. features are not discovered, 
+// so there's nothing to gather or broadcast.
+void LogLinearParams::SealHashed() {
+  assert(IsHashed() && learningInfo->featureHashBits < 32);
+  assert(paramIdsTemp.size() == 0 && paramWeightsTemp.size() == 0);
+  if(learningInfo->mpiWorld->rank() == 0) {
+    paramWeightsPtr = (ShmemVectorOfDouble *) MapToSharedMemory(true, "paramWeights");
+    paramIdsPtr = (ShmemVectorOfFeatureKey *) MapToSharedMemory(true, "paramIds");
+    assert(paramWeightsPtr != 0 && paramIdsPtr != 0);
+    size_t slotsCount = (size_t)1 << learningInfo->featureHashBits;
+    paramWeightsPtr->reserve(slotsCount);
+    for(size_t i = 0; i < slotsCount; ++i) {
+      paramWeightsPtr->push_back(SampleInitialWeight() / weightsMultiplier);
+    }
+    cerr << "master: lambda has " << slotsCount << " hashed weights" << endl;
+  }
+
+  // sync. slaves map the weights once the master populated them
+  bool dummy = true;
+  boost::mpi::broadcast<bool>(*learningInfo->mpiWorld, dummy, 0);
+
+  if(learningInfo->mpiWorld->rank() != 0) {
+    paramWeightsPtr = (ShmemVectorOfDouble *)MapToSharedMemory(false, "paramWeights");
+    paramIdsPtr = (ShmemVectorOfFeatureKey *)MapToSharedMemory(false, "paramIds");
+  }
+  assert(paramIdsPtr != 0 && paramWeightsPtr != 0);
+
+  // the mean of the gaussian prior is specified per feature id, which is not kept in hashing mode
+  if(learningInfo->featureGaussianMeanFilename.size() > 0 && learningInfo->mpiWorld->rank() == 0) {
+    cerr << "WARNING: " << learningInfo->featureGaussianMeanFilename << " is ignored with hashed features" << endl;
+  }
+  
+  sealed = true;
+}
+
 void LogLinearParams::Unseal() {
   assert(sealed);
   assert(paramWeightsTemp.size() == 0);
   assert(paramIdsTemp.size() == 0);
   paramIndexes.clear();
+  sealedIndex.Clear();
+  paramIndexSlotsPtr = 0;
   if(learningInfo->mpiWorld->rank() == 0) {
     // sync
     double dummy=1.0;
@@ -436,6 +624,7 @@ void LogLinearParams::LoadPrecomputedFeaturesWith2Inputs(const string &wordPairF
   cerr << "rank " << learningInfo->mpiWorld->rank() << " is going to read the word pair features file..." << endl;
   ifstream wordPairFeaturesFile(wordPairFeaturesFilename.c_str(), ios::in);
   string line;
+  WordPairFeatureTable::WordPairToFeatures wordPairToFeatures;
   
   while( getline(wordPairFeaturesFile, line) ) {
     if(line.size() == 0) {
@@ -462,9 +651,7 @@ void LogLinearParams::LoadPrecomputedFeaturesWith2Inputs(const string &wordPairF
     // skip |||
     splitsIter++;
     std::pair<int64_t, int64_t> srcTgtPair(input1, input2);
-    //cerr << "ttt-2" << endl;
-    auto tempMap = MapWordPairFeaturesToSharedMemory(true, srcTgtPair);
-    assert(tempMap);
+    std::vector<WordPairFeature> &features = wordPairToFeatures[srcTgtPair];
     // the remaining elements are precomputed features for (input1, input2)
     while(splitsIter != splits.end()) {
       // read feature id
@@ -478,33 +665,71 @@ void LogLinearParams::LoadPrecomputedFeaturesWith2Inputs(const string &wordPairF
         }
       }
       assert(featureIdAndValue.size() == 2);
-      FeatureId featureId;
-      featureId.type = FeatureTemplate::PRECOMPUTED;
-      featureId.precomputed = types.Encode(featureIdAndValue[0]);
+      WordPairFeature feature;
+      feature.precomputed = types.Encode(featureIdAndValue[0]);
 
       // read feature value
-      double featureValue;
       stringstream temp;
       temp << featureIdAndValue[1];
-      temp >> featureValue;
-      
-      try {
-        tempMap->insert( std::pair<FeatureId, double>( featureId, featureValue ));
-       
-      } catch(std::exception const&  ex) {
-        cerr << "tempMap->insert( pair (" << featureId << ", " << featureValue << ") ) threw exception: "  << ex.what() << endl;
-        assert(false);
-      }
+      temp >> feature.value;
+      features.push_back(feature);
     }
   }
   
   wordPairFeaturesFile.close();
+
+  // copy the features of all pairs into the shared memory table
+  try {
+    wordPairFeatures.Build(*learningInfo->sharedMemorySegment, wordPairToFeatures);
+  } catch(std::exception const& ex) {
+    cerr << "building the word pair features table in shared memory threw exception: " << ex.what() << endl;
+    assert(false);
+  }
+  wordPairFeaturesMapped = true;
+  cerr << "rank " << learningInfo->mpiWorld->rank() << " stored the features of " << wordPairToFeatures.size() << " word pairs." << endl;
   cerr << "rank " << learningInfo->mpiWorld->rank() << " finished reading the word pair features file." << endl;
   
 }
 
+void LogLinearParams::MapPrecomputedFeaturesWith2Inputs(const string &wordPairFeaturesFilename) {
+  if(!wordPairFeaturesFile.Map(wordPairFeaturesFilename)) {
+    cerr << "rank " << learningInfo->mpiWorld->rank() << " could not map the binary word pair features file " << wordPairFeaturesFilename << endl;
+    assert(false);
+    exit(1);
+  }
+
+  // only the master adds feature names to the vocab. then sync
+  if(learningInfo->mpiWorld->rank() == 0) {
+    for(uint64_t featureName = 0; featureName < wordPairFeaturesFile.FeatureNamesCount(); ++featureName) {
+      types.Encode(wordPairFeaturesFile.FeatureName(featureName));
+    }
+  }
+  bool dummy = false;
+  boost::mpi::broadcast<bool>(*learningInfo->mpiWorld, dummy, 0);
+
+  vector<int64_t> featureIds(wordPairFeaturesFile.FeatureNamesCount());
+  for(uint64_t featureName = 0; featureName < featureIds.size(); ++featureName) {
+    featureIds[featureName] = types.ConstEncode(wordPairFeaturesFile.FeatureName(featureName));
+  }
+  wordPairFeaturesFile.SetFeatureIds(featureIds);
+
+  // words of the file which are not in the vocab never fire
+  vector<int64_t> vocabToWord;
+  for(auto tokenIter = types.intToToken->begin(); tokenIter != types.intToToken->end(); ++tokenIter) {
+    if(tokenIter->first >= (int64_t)vocabToWord.size()) {
+      vocabToWord.resize(tokenIter->first + 1, -1);
+    }
+    vocabToWord[tokenIter->first] = wordPairFeaturesFile.FindWord(string(tokenIter->second.begin(), tokenIter->second.end()));
+  }
+  wordPairFeaturesFile.SetWordIds(vocabToWord);
+
+  cerr << "rank " << learningInfo->mpiWorld->rank() << " mapped the features of " << wordPairFeaturesFile.PairsCount() << " word pairs from " << wordPairFeaturesFilename << endl;
+}
+
 void LogLinearParams::SetLearningInfo(LearningInfo &learningInfo, bool otherForPos) {
     this->learningInfo = &learningInfo;
+    posFactorIdToFeatures.SetCapacity(learningInfo.cacheActiveFeatures? learningInfo.featureCacheSize : 0);
+    ChooseFeatureExtractors();
     LoadPhrases();
     if (otherForPos) {
         LoadPosOutput();
@@ -581,62 +806,27 @@ void LogLinearParams::LoadPosOutput() {
 }
 
 void LogLinearParams::LoadOtherAlignersOutput() {
-  // each process independently reads the output of other word aligners
-  if(learningInfo->otherAlignersOutputFilenames.size() > 0) {
-    for(auto filenameIter = learningInfo->otherAlignersOutputFilenames.begin();
-        filenameIter != learningInfo->otherAlignersOutputFilenames.end();
-        ++filenameIter) {
-      cerr << "aligner filename: " << *filenameIter << endl;
-      auto alignerOutput = new vector< vector< set<int>* >* >();
-      //cerr << "adding this aligner to the list of aligners" << endl;
-      otherAlignersOutput.push_back(alignerOutput);
-      std::ifstream infile(filenameIter->c_str());
-      std::string line;
-      while (std::getline(infile, line)) {
-        auto sentAlignments = new vector< set<int>* >();
-        //cerr << "adding this sentence to the list of sentences for this aligner" << endl;
-        alignerOutput->push_back(sentAlignments);
-        // each line consists of a number of word-to-word alignments
-        vector<std::string> srcpos_tgtpos_pairs;
-        StringUtils::SplitString(line, ' ', srcpos_tgtpos_pairs);
-        for(auto pairIter = srcpos_tgtpos_pairs.begin(); 
-            pairIter != srcpos_tgtpos_pairs.end();
-            ++pairIter) {
-          // TODO check if task == POS_TAGGING
-          // if yes, convert label string to ids using map LatentCrfPosTagger::labelStringToInt 
-          // 
-          // read this pair
-          int srcpos, tgtpos; 
-          char del;
-          std::istringstream ss(*pairIter);
-          ss >> srcpos >> del >> tgtpos;
-          assert(del == '-');
-          // if this is a 'reverse' training, swap srcpos with tgtpos
-          if(learningInfo->reverse) {
-            int temp = srcpos;
-            srcpos = tgtpos;
-            tgtpos = temp;
-          }
-          // increment srcpos because we insert the NULL src word at the beginning of each sentence
-          srcpos++;
-          // make room in the sentAlignments vector for this pair. tgt positions not mentioned are aligned to NULL
-          assert(tgtpos >= 0);
-          while(sentAlignments->size() <= (unsigned) tgtpos) { 
-            auto tgtPosAlignments = new set<int>();
-            sentAlignments->push_back(tgtPosAlignments); 
-          }
-          // memorize this pair
-          //cerr << "adding this word pair to this sentence" << endl;
-          (*sentAlignments)[tgtpos]->insert(srcpos);
-          //cerr << "tgtpos=" << tgtpos << " aligns to srcpos=" << srcpos << endl;
-        }
-        //cerr << endl;
-      }
+  if(learningInfo->otherAlignersOutputFilenames.size() == 0) {
+    return;
+  }
+  // the master reads the output of other word aligners into shared memory
+  if(learningInfo->mpiWorld->rank() == 0) {
+    try {
+      otherAlignersOutput.Build(*learningInfo->sharedMemorySegment, learningInfo->otherAlignersOutputFilenames, learningInfo->reverse);
+    } catch(std::exception const& ex) {
+      cerr << "building the table of other aligners output in shared memory threw exception: " << ex.what() << endl;
+      assert(false);
     }
+    cerr << "master: the output of " << otherAlignersOutput.AlignersCount() << " other aligners takes " << otherAlignersOutput.Bytes() << " bytes of shared memory" << endl;
+  }
+  learningInfo->mpiWorld->barrier();
+  if(learningInfo->mpiWorld->rank() != 0) {
+    bool mapped = otherAlignersOutput.Map(*learningInfo->sharedMemorySegment);
+    assert(mapped);
   }
 }
 
-int LogLinearParams::AddParams(const std::vector< FeatureId > &paramIds) {
+int LogLinearParams::AddParams(const std::vector< FeatureKey > &paramIds) {
   paramIndexes.reserve(paramIndexes.size() + paramIds.size());
   paramIdsTemp.reserve(paramIdsTemp.size() + paramIds.size());
   paramWeightsTemp.reserve(paramWeightsTemp.size() + paramIds.size());
@@ -651,11 +841,21 @@ int LogLinearParams::AddParams(const std::vector< FeatureId > &paramIds) {
 
 // initializes the parameter weight by drawing from a gaussian
 bool LogLinearParams::AddParam(const FeatureId &paramId) {
+  return AddParam(FeatureKey(paramId));
+}
+
+bool LogLinearParams::AddParam(const FeatureKey &paramKey) {
   // does the parameter already exist?
-  if(paramIndexes.count(paramId) > 0) {
+  if(sealed? sealedIndex.Find(paramKey) >= 0 : paramIndexes.count(paramKey) > 0) {
     return false;
   }
 
+  // add param
+  return AddParam(paramKey, SampleInitialWeight());
+}
+
+// the initial weight of a new parameter, according to learningInfo
+double LogLinearParams::SampleInitialWeight() {
   // sample paramWeight from an approx of gaussian with mean 0 and variance of 0.01
   double paramWeight = 0;
   if(this->learningInfo->initializeLambdasWithGaussian) {
@@ -667,18 +867,20 @@ bool LogLinearParams::AddParam(const FeatureId &paramId) {
   } else {
     assert(false);
   }
-  
-  // add param
-  return AddParam(paramId, paramWeight);
+  return paramWeight;
 }
 
 // if there's another parameter with the same ID already, do nothing
 bool LogLinearParams::AddParam(const FeatureId &paramId, double paramWeight) {
+  return AddParam(FeatureKey(paramId), paramWeight);
+}
+
+bool LogLinearParams::AddParam(const FeatureKey &paramKey, double paramWeight) {
   bool returnValue;
-  if(paramIndexes.count(paramId) == 0) {
+  if(sealed? sealedIndex.Find(paramKey) < 0 : paramIndexes.count(paramKey) == 0) {
     
     if(sealed) {
-      cerr << "trying to add the followign paramId after object is sealed: " << paramId << endl;
+      cerr << "trying to add the followign paramId after object is sealed: " << paramKey << endl;
       throw LogLinearParamsException("adding new parameter after object is sealed!");
     }
     // new features are not allowed when the object is sealed
@@ -691,8 +893,8 @@ bool LogLinearParams::AddParam(const FeatureId &paramId, double paramWeight) {
 
     // do the work
     int newParamIndex = paramIndexes.size();
-    paramIndexes[paramId] = newParamIndex;
-    paramIdsTemp.push_back(paramId);
+    paramIndexes[paramKey] = newParamIndex;
+    paramIdsTemp.push_back(paramKey);
     paramWeightsTemp.push_back(paramWeight / weightsMultiplier);
     returnValue = true;
   } else {
@@ -705,21 +907,29 @@ bool LogLinearParams::AddParam(const FeatureId &paramId, double paramWeight) {
 // the returned vector will be of length max(sampleSize, # of unique feature templates)
 vector<int> LogLinearParams::SampleFeatures(int sampleSize) {
   assert(sealed);
+  // feature templates are unknown in hashing mode. sample slots uniformly
+  if(IsHashed()) {
+    vector<int> slots;
+    for(int k = 0; k < sampleSize; ++k) {
+      slots.push_back(rand() % paramWeightsPtr->size());
+    }
+    return slots;
+  }
   map<FeatureTemplate, int> templateToCount;
   set<int> sampledIndexes;
   // first, explore all the feature templates available
   for(int index = 0; index < paramIdsPtr->size(); ++index) {
-    if( templateToCount.count( (*paramIdsPtr)[index].type ) == 0 ) {
+    if( templateToCount.count( (*paramIdsPtr)[index].Type() ) == 0 ) {
       sampledIndexes.insert(index);
-      templateToCount[ (*paramIdsPtr)[index].type ] = 1;
+      templateToCount[ (*paramIdsPtr)[index].Type() ] = 1;
     }
   }
   // then, sample more
   for(int index = 0; index < paramIdsPtr->size(); ++index) {
-    if( templateToCount[ (*paramIdsPtr)[index].type ] < sampleSize / templateToCount.size() + 1 &&
+    if( templateToCount[ (*paramIdsPtr)[index].Type() ] < sampleSize / templateToCount.size() + 1 &&
         sampledIndexes.find(index) == sampledIndexes.end()) {
       sampledIndexes.insert(index);
-      templateToCount[ (*paramIdsPtr)[index].type ]++;
+      templateToCount[ (*paramIdsPtr)[index].Type() ]++;
     }
   }
   // return
@@ -734,7 +944,11 @@ void LogLinearParams::PrintFeatureValues(FastSparseVector<double> &feats) {
   for(auto feat = feats.begin();
       feat != feats.end();
       ++feat) {
-    cerr << "  index=" << feat->first << ", id=" << (*paramIdsPtr)[feat->first] << ", val=" << feat->second << endl;
+    if(IsHashed()) {
+      cerr << "  index=" << feat->first << ", val=" << feat->second << endl;
+    } else {
+      cerr << "  index=" << feat->first << ", id=" << (*paramIdsPtr)[feat->first] << ", val=" << feat->second << endl;
+    }
   }
 }
 
@@ -766,10 +980,10 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
   int64_t aggregate;
 
   std::pair<int64_t, int64_t> headChildPair(headSurfaceForm, childSurfaceForm);
-  auto precomputedFeatures = MapWordPairFeaturesToSharedMemory(false, headChildPair);
-  if(!precomputedFeatures) {
+  auto precomputedFeatures = GetWordPairFeatures(headChildPair);
+  if(precomputedFeatures.empty()) {
     std::pair<int64_t, int64_t> childHeadPair(childSurfaceForm, headSurfaceForm);
-    precomputedFeatures = MapWordPairFeaturesToSharedMemory(false, childHeadPair);
+    precomputedFeatures = GetWordPairFeatures(childHeadPair);
   }
   
   for(auto featTemplateIter = learningInfo->featureTemplates.begin();
@@ -784,8 +998,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
       if(*featTemplateIter != featureId.type) break;
       featureId.wordPair.srcWord = headSurfaceForm;
       featureId.wordPair.tgtWord = childSurfaceForm;  
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
     case FeatureTemplate::HEAD_CHILD_TOKEN_SET:
@@ -794,8 +1007,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
                                        childSurfaceForm);
       featureId.wordPair.tgtWord = max(headSurfaceForm,
                                        childSurfaceForm);
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
     case FeatureTemplate::HC_POS:
@@ -812,8 +1024,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
       //    break;
       //  }
       //}
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
     case FeatureTemplate::HEAD_CHILD_POS_SET:
@@ -822,22 +1033,19 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
                                        childDetails.details[ObservationDetailsHeader::CPOSTAG]);
       featureId.wordPair.tgtWord = max(headDetails.details[ObservationDetailsHeader::CPOSTAG],
                                        childDetails.details[ObservationDetailsHeader::CPOSTAG]);
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
     case FeatureTemplate::HEAD_POS:
       featureId.type = FeatureTemplate::HEAD_POS;
       featureId.wordBias = headDetails.details[ObservationDetailsHeader::CPOSTAG];
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
     case FeatureTemplate::CHILD_POS:
       featureId.type = FeatureTemplate::CHILD_POS;
       featureId.wordBias = headDetails.details[ObservationDetailsHeader::CPOSTAG];
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
       // inbetween
@@ -857,14 +1065,12 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
         assert(inbetweenIndex >= 0 && inbetweenIndex < sentDetails.size());
         featureId.wordTriple.word3 = sentDetails[inbetweenIndex].details[ObservationDetailsHeader::CPOSTAG];
         aggregate += (inbetweenIndex - earlierIndex) * sentDetails[inbetweenIndex].details[ObservationDetailsHeader::CPOSTAG];
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
+        FireFeature(featureId, 1.0, activeFeatures);
       }
       // only fire the hashed aggregate value of inbetween POS tags when the span length is 1, 2, 3, or 4
       if(laterIndex - earlierIndex < 6 && laterIndex - earlierIndex > 1) {
         featureId.wordTriple.word3 = aggregate;
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
+        FireFeature(featureId, 1.0, activeFeatures);
       }
       break;
       
@@ -882,8 +1088,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
         featureId.wordTriple.word1 = headDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word2 = childDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word3 = earlierIndex == 0? -1: sentDetails[earlierIndex-1].details[ObservationDetailsHeader::CPOSTAG];
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;  
+        FireFeature(featureId, 1.0, activeFeatures);
       }
       
       // adjacent from the inside
@@ -893,8 +1098,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
         featureId.wordTriple.word1 = headDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word2 = childDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word3 = earlierIndex + 1 == laterIndex? -1: sentDetails[earlierIndex+1].details[ObservationDetailsHeader::CPOSTAG];
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
+        FireFeature(featureId, 1.0, activeFeatures);
       }
       break;
 
@@ -911,8 +1115,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
         featureId.wordTriple.word1 = headDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word2 = childDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word3 = laterIndex == sentDetails.size() - 1? -1: sentDetails[laterIndex+1].details[ObservationDetailsHeader::CPOSTAG];
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
+        FireFeature(featureId, 1.0, activeFeatures);
 
         //featureId.wordTriple.word1 = headDetails.details[ObservationDetailsHeader::FORM];
         //featureId.wordTriple.word2 = childDetails.details[ObservationDetailsHeader::FORM];
@@ -928,8 +1131,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
         featureId.wordTriple.word1 = headDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word2 = childDetails.details[ObservationDetailsHeader::CPOSTAG];
         featureId.wordTriple.word3 = laterIndex - 1 == earlierIndex? -1: sentDetails[laterIndex-1].details[ObservationDetailsHeader::CPOSTAG];
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
+        FireFeature(featureId, 1.0, activeFeatures);
 
         //featureId.wordTriple.word1 = headDetails.details[ObservationDetailsHeader::FORM];
         //featureId.wordTriple.word2 = childDetails.details[ObservationDetailsHeader::FORM];
@@ -954,8 +1156,7 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
       
       // unbiased version:
       featureId.biasedAlignmentJump.wordBias = FeatureId::vocabEncoder->UnkInt();
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
 
       // biased version:
       // obsolete. now we use POS_PAIR_DISTANCE instead
@@ -972,24 +1173,17 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
       if(headDetails.details[ObservationDetailsHeader::ID] == 0) break;
       featureId.type = FeatureTemplate::ALIGNMENT_JUMP;
       featureId.alignmentJump = headDetails.details[ObservationDetailsHeader::ID] - childDetails.details[ObservationDetailsHeader::ID];
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
+      FireFeature(featureId, 1.0, activeFeatures);
       break;
       
     case FeatureTemplate::PRECOMPUTED:
       //assert(precomputedFeaturesWithTwoInputsPtr->size() > 0);
-      if(precomputedFeatures) {
-        for(auto precomputedIter = precomputedFeatures->begin();
-            precomputedIter != precomputedFeatures->end();
-            precomputedIter++) {
-          try {
-            AddParam(precomputedIter->first);
-          } catch (LogLinearParamsException &ex) {
-            cerr << "LogLinearParamsException " << ex.what() << " -- thrown at LogLinearParams::FireFeatures()" << endl;
-            throw;
-          }
-          activeFeatures[paramIndexes[precomputedIter->first]] += precomputedIter->second;
-        }
+      for(auto precomputedIter = precomputedFeatures.begin();
+          precomputedIter != precomputedFeatures.end();
+          precomputedIter++) {
+        featureId.type = FeatureTemplate::PRECOMPUTED;
+        featureId.precomputed = precomputedIter->precomputed;
+        FireFeature(featureId, precomputedIter->value, activeFeatures);
       }
       break;
       
@@ -1002,6 +1196,201 @@ void LogLinearParams::FireFeatures(const ObservationDetails &headDetails,
 
 // for word alignment
 // x_t is the tgt sentence, and x_s is the src sentence (which has a null token at position 0)
+// feature extractors of the word alignment templates. FireAlignerTemplates<...>() calls the extractors 
+// of a fixed list of templates without looking at learningInfo->featureTemplates, and 
+// FireAlignerTemplatesGeneric() handles any other list (see ChooseFeatureExtractors())
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO;
+  featureId.alignmentJump = (factor.yI == factor.yIM1) ? 0 : 1;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::LOG_ALIGNMENT_JUMP>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::LOG_ALIGNMENT_JUMP;
+  featureId.biasedAlignmentJump.alignmentJump = 
+    factor.yI >= factor.yIM1? 
+    log(1 + 2.0 * (factor.yI - factor.yIM1)):
+    -1 * log(1 + 2.0 * (factor.yIM1 - factor.yI));
+  // biased version:
+  featureId.biasedAlignmentJump.wordBias = factor.srcToken;
+  FireFeature(featureId, 1.0, activeFeatures);
+  // unbiased version:
+  featureId.biasedAlignmentJump.wordBias = -1;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::SRC0_TGT0>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::SRC0_TGT0;
+  featureId.wordPair.srcWord = factor.srcToken;
+  featureId.wordPair.tgtWord = factor.tgtToken;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::PRECOMPUTED>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  std::pair<int64_t, int64_t> srcTgtPair(factor.srcToken, factor.tgtToken);
+  auto precomputedFeatures = GetWordPairFeatures(srcTgtPair);
+  for(auto precomputedIter = precomputedFeatures.begin();
+      precomputedIter != precomputedFeatures.end();
+      precomputedIter++) {
+    featureId.type = FeatureTemplate::PRECOMPUTED;
+    featureId.precomputed = precomputedIter->precomputed;
+    FireFeature(featureId, precomputedIter->value, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::ALIGNMENT_JUMP>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::ALIGNMENT_JUMP;
+  featureId.alignmentJump = factor.yI - factor.yIM1;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::SRC_BIGRAM>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::SRC_BIGRAM;
+  featureId.bigram.previous = factor.prevSrcToken;
+  featureId.bigram.current = factor.srcToken;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::DIAGONAL_DEVIATION>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  if(factor.yI + factor.yIM1 > 0) {
+    featureId.type = FeatureTemplate::DIAGONAL_DEVIATION;
+    featureId.wordBias = factor.srcToken;
+    double deviation = (factor.yI > 0)?
+      fabs(1.0 * (factor.yI-1) / (factor.x_s.size()-1) - 1.0 * factor.i / factor.x_t.size()):
+      fabs(1.0 * (factor.yIM1-1) / (factor.x_s.size()-1) - 1.0 * factor.i / factor.x_t.size());
+    FireFeature(featureId, deviation, activeFeatures);
+
+    // this feature is not specific to the srcToken
+    featureId.wordBias = -1; 
+    FireFeature(featureId, deviation, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::SRC_WORD_BIAS>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::SRC_WORD_BIAS;
+  featureId.wordBias = factor.srcToken;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::SYNC_START>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  if(factor.i == 0 && factor.yI == 1) {
+    featureId.type = FeatureTemplate::SYNC_START;
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::SYNC_END>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  if(factor.i == factor.x_t.size() - 1 && factor.yI == (int)factor.x_s.size() - 1) {
+    featureId.type = FeatureTemplate::SYNC_END;
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::OTHER_ALIGNERS>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  for(unsigned alignerId = 0; alignerId < otherAlignersOutput.AlignersCount(); alignerId++) {
+    assert(learningInfo->currentSentId < (int)otherAlignersOutput.SentsCount(alignerId));
+    if( otherAlignersOutput.TokensCount(alignerId, learningInfo->currentSentId) <= factor.i ) {continue;}
+    featureId.type = FeatureTemplate::OTHER_ALIGNERS;
+    featureId.otherAligner.compatible = otherAlignersOutput.IsCompatible(alignerId, learningInfo->currentSentId, factor.i, factor.yI);
+    featureId.otherAligner.alignerId = alignerId;
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::NULL_ALIGNMENT>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  if(factor.yI == 0) {
+    featureId.type = FeatureTemplate::NULL_ALIGNMENT;
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FireAlignerTemplate<FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO>(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  if(factor.yI == 0) {
+    featureId.type = FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO;
+    FireFeature(featureId, 1.0 * (factor.x_t.size() - factor.x_s.size() - 1) / factor.x_t.size(), activeFeatures);
+  }
+}
+
+template <FeatureTemplate... Templates>
+void LogLinearParams::FireAlignerTemplates(const AlignerFactor &factor, FastSparseVector<double> &activeFeatures) {
+  FeatureId featureId;
+  // expands to one call per template, in order
+  int expansion[] = {0, (IsFired(Templates)? FireAlignerTemplate<Templates>(factor, featureId, activeFeatures) : (void)0, 0)...};
+  (void)expansion;
+}
+
+void LogLinearParams::FireAlignerTemplatesGeneric(const AlignerFactor &factor, FastSparseVector<double> &activeFeatures) {
+  FeatureId featureId;
+  
+  for(auto featTemplateIter = learningInfo->featureTemplates.begin();
+      featTemplateIter != learningInfo->featureTemplates.end(); ++featTemplateIter) {
+    
+    if(!IsFired(*featTemplateIter)) { continue; }
+
+    switch(*featTemplateIter) {
+    case FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO:
+      FireAlignerTemplate<FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::LOG_ALIGNMENT_JUMP:
+      FireAlignerTemplate<FeatureTemplate::LOG_ALIGNMENT_JUMP>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::SRC0_TGT0:
+      FireAlignerTemplate<FeatureTemplate::SRC0_TGT0>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::PRECOMPUTED:
+      FireAlignerTemplate<FeatureTemplate::PRECOMPUTED>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::ALIGNMENT_JUMP:
+      FireAlignerTemplate<FeatureTemplate::ALIGNMENT_JUMP>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::SRC_BIGRAM:
+      FireAlignerTemplate<FeatureTemplate::SRC_BIGRAM>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::DIAGONAL_DEVIATION:
+      FireAlignerTemplate<FeatureTemplate::DIAGONAL_DEVIATION>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::SRC_WORD_BIAS:
+      FireAlignerTemplate<FeatureTemplate::SRC_WORD_BIAS>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::SYNC_START:
+      FireAlignerTemplate<FeatureTemplate::SYNC_START>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::SYNC_END:
+      FireAlignerTemplate<FeatureTemplate::SYNC_END>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::OTHER_ALIGNERS:
+      FireAlignerTemplate<FeatureTemplate::OTHER_ALIGNERS>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::NULL_ALIGNMENT:
+      FireAlignerTemplate<FeatureTemplate::NULL_ALIGNMENT>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO:
+      FireAlignerTemplate<FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::EMISSION:
+    case FeatureTemplate::LABEL_BIGRAM:
+      cerr << "this feature template is not implemented for word alignment" << endl;
+      assert(false);
+      break;
+    default:
+      assert(false);
+    } // end of switch
+  } // end of loop over enabled feature templates
+}
+
 void LogLinearParams::FireFeatures(int yI, int yIM1, const vector<int64_t> &x_t, const vector<int64_t> &x_s, unsigned i, 
 				   int START_OF_SENTENCE_Y_VALUE, int FIRST_POS,
 				   FastSparseVector<double> &activeFeatures) {
@@ -1027,162 +1416,246 @@ void LogLinearParams::FireFeatures(int yI, int yIM1, const vector<int64_t> &x_t,
   auto tgtToken = x_t[i];
   //auto prevTgtToken = i > 0? x_t[i-1] : -1;
   //auto nextTgtToken = (i < x_t.size() - 1)? x_t[i+1] : (int64_t) -1;
-  std::pair<int64_t, int64_t> srcTgtPair(srcToken, tgtToken);
-  auto precomputedFeatures = MapWordPairFeaturesToSharedMemory(false, srcTgtPair);
-  
-  FeatureId featureId;
-  
-  for(auto featTemplateIter = learningInfo->featureTemplates.begin();
-      featTemplateIter != learningInfo->featureTemplates.end(); ++featTemplateIter) {
-    
-    switch(*featTemplateIter) {
-      case FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO:
-      featureId.type = FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO;
-      featureId.alignmentJump = (yI == yIM1) ? 0 : 1;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
 
-      case FeatureTemplate::LOG_ALIGNMENT_JUMP:
-      featureId.type = FeatureTemplate::LOG_ALIGNMENT_JUMP;
-      featureId.biasedAlignmentJump.alignmentJump = 
-        yI >= yIM1? 
-        log(1 + 2.0 * (yI - yIM1)):
-        -1 * log(1 + 2.0 * (yIM1 - yI));
-      // biased version:
-      featureId.biasedAlignmentJump.wordBias = srcToken;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      // unbiased version:
-      featureId.biasedAlignmentJump.wordBias = -1;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
-
-      case FeatureTemplate::SRC0_TGT0:
-      featureId.type = FeatureTemplate::SRC0_TGT0;
-      featureId.wordPair.srcWord = srcToken;
-      featureId.wordPair.tgtWord = tgtToken;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
+  AlignerFactor factor = {yI, yIM1, x_t, x_s, i, srcToken, prevSrcToken, tgtToken};
+  (this->*alignerExtractor)(factor, activeFeatures);
+}
 
-      case FeatureTemplate::PRECOMPUTED:
-        //assert(precomputedFeaturesWithTwoInputsPtr->size() > 0);
-        if(precomputedFeatures) {
-          for(auto precomputedIter = precomputedFeatures->begin();
-              precomputedIter != precomputedFeatures->end();
-              precomputedIter++) {
-            try {
-              AddParam(precomputedIter->first);
-            } catch (LogLinearParamsException &ex) {
-              cerr << "LogLinearParamsException " << ex.what() << " -- thrown at LogLinearParams::FireFeatures(int yI, int yIM1, const vector<int64_t> &x_t, const vector<int64_t> &x_s, int i, int START_OF_SENTENCE_Y_VALUE, int FIRST_POS, FastSparseVector<double> &activeFeatures) where yI = " << yI << ", yIM1 = " << yIM1 << ", i = " << i << ", x_t[i] = " << x_t[i] << ", x_s[yI] = " << x_s[yI] << ", types.Decode(x_t[i]) = " << types.Decode(x_t[i]) << ", types.Decode(x_s[yI]) = " << types.Decode(x_s[yI]) << ", precomputedFeatures->size() = " << precomputedFeatures->size() << ", precomputedIter->first = " << precomputedIter->first << ", precomputedIter->second = " << precomputedIter->second << ", types.Decode(precomputedIter->first.precomputed) = " << types.Decode(precomputedIter->first.precomputed) << endl;
-              throw;
-            }
-            activeFeatures[paramIndexes[precomputedIter->first]] += precomputedIter->second;
-          }
+// feature extractors of the pos tagging templates (see FireAlignerTemplate<>())
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::PRECOMPUTED>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  // a moving window of tokens y[i]:Precomputed(x[i+k])
+  for(auto kIter = precomputedDisplacements.begin(); kIter != precomputedDisplacements.end(); ++kIter) {
+    int k = *kIter;
+    int64_t xIPlusK = factor.Token(k);
+    std::pair<int64_t, int64_t> wordPair(xIPlusK, xIPlusK);
+    if(wordPair.first == -1) { continue; }
+        
+    auto precomputedFeatures = GetWordPairFeatures(wordPair);
+    if(precomputedFeatures.empty()) { continue; }
+
+    // set the relative position of this token to the label being considered
+    featureId.emission.displacement = k;
+
+    // now, for each precomputed feature of this token:
+    for(auto precomputedIter = precomputedFeatures.begin();
+        precomputedIter != precomputedFeatures.end();
+        precomputedIter++) {
+      // now set all fields of the precomputed feature. 
+      // TODO-REFACTOR: this is a misuse of the field names.
+      // override the feature type because we need to conjoin the precomputed feature with label id in pos tagging
+      featureId.type = FeatureTemplate::EMISSION;
+      featureId.emission.label = factor.yI;
+      featureId.emission.word = precomputedIter->precomputed;
+      // now, all necessary fields of this featureId has been set
+      // fire
+      FireFeature(featureId, precomputedIter->value, activeFeatures);
+          
+      // if k != 0, consider also conjoining with the precomputed features at k=0
+      bool conjoin_multiple_precomputed = true;
+      if(conjoin_multiple_precomputed && k != 0 && learningInfo->firePrecomputedFeaturesForXI) {
+        // first, get the feature map for k=0
+        std::pair<int64_t, int64_t> xIWordPair(factor.xI, factor.xI);
+        if(xIWordPair.first == -1) { continue; }
+        auto xIPrecomputedFeatures = GetWordPairFeatures(xIWordPair);
+        if(xIPrecomputedFeatures.empty()) { continue; }
+        // for each precomputed feature in this map
+        for(auto xIPrecomputedIter = xIPrecomputedFeatures.begin();
+            xIPrecomputedIter != xIPrecomputedFeatures.end();
+            xIPrecomputedIter++) {
+          // now populate a feature id of type wordtriple
+          featureId.type = FeatureTemplate::PRECOMPUTED_PAIR;
+          featureId.precomputedPair.displacement = k;
+          featureId.precomputedPair.word = xIPrecomputedIter->precomputed;
+          featureId.precomputedPair.other_word = precomputedIter->precomputed;
+          featureId.precomputedPair.label = factor.yI;
+          // now, all necessary fields of this featureId has been set
+          // fire
+          FireFeature(featureId, precomputedIter->value, activeFeatures);
         }
-      break;
-
-      case FeatureTemplate::ALIGNMENT_JUMP:
-      featureId.type = FeatureTemplate::ALIGNMENT_JUMP;
-      featureId.alignmentJump = yI - yIM1;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
-    
-      case FeatureTemplate::SRC_BIGRAM:
-      featureId.type = FeatureTemplate::SRC_BIGRAM;
-      featureId.bigram.previous = prevSrcToken;
-      featureId.bigram.current = srcToken;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
-      
-      case FeatureTemplate::DIAGONAL_DEVIATION:
-      if(yI + yIM1 > 0) {
-        featureId.type = FeatureTemplate::DIAGONAL_DEVIATION;
-        featureId.wordBias = srcToken;
-        double deviation = (yI > 0)?
-          fabs(1.0 * (yI-1) / (x_s.size()-1) - 1.0 * i / x_t.size()):
-          fabs(1.0 * (yIM1-1) / (x_s.size()-1) - 1.0 * i / x_t.size());
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += deviation;
-
-        // this feature is not specific to the srcToken
-        featureId.wordBias = -1; 
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += deviation;
       }
-      break;
+    }
+  }
+}
 
-      case FeatureTemplate::SRC_WORD_BIAS:
-      featureId.type = FeatureTemplate::SRC_WORD_BIAS;
-      featureId.wordBias = srcToken;
-      AddParam(featureId);
-      activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::LABEL_BIGRAM>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  featureId.type = FeatureTemplate::LABEL_BIGRAM;
+  featureId.bigram.current = factor.yI;
+  featureId.bigram.previous = factor.yIM1;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
 
-      case FeatureTemplate::SYNC_START:
-      if(i == 0 && yI == 1) {
-        featureId.type = FeatureTemplate::SYNC_START;
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
-      }
-      break;
-      
-      case FeatureTemplate::SYNC_END:
-        if(i == x_t.size() - 1 && yI == (int)x_s.size() - 1) {
-        featureId.type = FeatureTemplate::SYNC_END;
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
-      }
-      break;
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::EMISSION>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  // y[i]:x[i]
+  featureId.type = FeatureTemplate::EMISSION;
+  featureId.emission.label = factor.yI;
+  featureId.emission.word = factor.xI;
+  featureId.emission.displacement = 0;
+  FireFeature(featureId, 1.0, activeFeatures);
+}
+
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::OTHER_ALIGNERS>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  for(unsigned alignerId = 0; alignerId < otherAlignersOutput.AlignersCount(); alignerId++) {
+    assert(factor.sentId < (int)otherAlignersOutput.SentsCount(alignerId));
+    if( otherAlignersOutput.TokensCount(alignerId, factor.sentId) <= factor.i ) {
+      continue;
+    }
+    featureId.type = FeatureTemplate::OTHER_ALIGNERS;
+    featureId.otherAligner.compatible = otherAlignersOutput.IsCompatible(alignerId, factor.sentId, factor.i, factor.yI);
+    featureId.otherAligner.alignerId = alignerId;
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::OTHER_POS>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  std::hash<string> hash_fn;
+  for (unsigned posId = 0; posId < otherPOSOutput.size(); posId++) {
+    if ((*otherPOSOutput[posId])[factor.sentId].size() <= factor.i)
+      continue;
+    auto otherPred = (*otherPOSOutput[posId])[factor.sentId][factor.i];
+    featureId.type = FeatureTemplate::OTHER_POS;
+    featureId.otherPos.posId = posId; // predictor ID
+    featureId.otherPos.pred_hash = hash_fn(otherPred); // otherPred can be 'en', 'es', ...
+    featureId.otherPos.label = factor.yI; // lang1, lang2
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::BOUNDARY_LABELS>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  if(factor.i == 0 || factor.i == factor.x.size() - 1) {
+    featureId.type = FeatureTemplate::BOUNDARY_LABELS;
+    featureId.boundaryLabel.position = factor.i == 0? 0 : -1;
+    featureId.boundaryLabel.label = factor.yI;
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <>
+void LogLinearParams::FirePosTemplate<FeatureTemplate::PHRASE>(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures) {
+  const vector<int64_t> &x = factor.x;
+  unsigned i = factor.i;
+  std::hash<string> hash_fn;
+  size_t bigram_hash_init;
+  size_t bigram_hash;
+  if (this->concatMap.count(std::make_pair(-1, x[i])) == 0) {
+    const string init = "^";
+    auto combined_init = string(init + FeatureId::vocabEncoder->Decode(x[i]));
+    boost::algorithm::to_lower(combined_init);
+    this->concatMap.insert(std::make_pair(std::make_pair(-1, x[i]), hash_fn(combined_init)));
+  }
+  bigram_hash_init = this->concatMap.at(std::make_pair(-1, x[i]));
+        
+  if (i > 0) {
+    if (this->concatMap.count(std::make_pair(x[i - 1], x[i])) == 0) {
+      auto combined = FeatureId::vocabEncoder->Decode(x[i - 1]) + "_" + FeatureId::vocabEncoder->Decode(x[i]);
+      boost::algorithm::to_lower(combined);
+      this->concatMap.insert(std::make_pair(std::make_pair(x[i - 1], x[i]), hash_fn(combined)));
+    }
+    bigram_hash = this->concatMap.at(std::make_pair(x[i - 1], x[i]));
+  } else {
+    bigram_hash = 0;
+  }
+  for (unsigned listId = 0; listId < phraseBigrams.size(); listId++) {
+    featureId.type = FeatureTemplate::PHRASE;
+    featureId.phraseListFeature.phraseListId = listId;
+    featureId.phraseListFeature.label = factor.yI;
+    featureId.phraseListFeature.imLabel = factor.yIM1;
+    if (phraseBigrams[listId]->find(bigram_hash) != phraseBigrams[listId]->end() \
+        || phraseBigrams[listId]->find(bigram_hash_init) != phraseBigrams[listId]->end()) {
+      featureId.phraseListFeature.bigramInContext = true;
+    } else {
+      featureId.phraseListFeature.bigramInContext = false;
+    }
+    FireFeature(featureId, 1.0, activeFeatures);
+  }
+}
+
+template <FeatureTemplate... Templates>
+void LogLinearParams::FirePosTemplates(const PosFactor &factor, FastSparseVector<double> &activeFeatures) {
+  FeatureId featureId;
+  // expands to one call per template, in order
+  int expansion[] = {0, (IsFired(Templates)? FirePosTemplate<Templates>(factor, featureId, activeFeatures) : (void)0, 0)...};
+  (void)expansion;
+}
+
+void LogLinearParams::FirePosTemplatesGeneric(const PosFactor &factor, FastSparseVector<double> &activeFeatures) {
+  FeatureId featureId;
+
+  for(auto featTemplateIter = learningInfo->featureTemplates.begin();
+      featTemplateIter != learningInfo->featureTemplates.end(); 
+      ++featTemplateIter) {
     
-      case FeatureTemplate::EMISSION:
-      cerr << "this feature template is not implemented for word alignment" << endl;
-      assert(false);
-      break;
+    if(!IsFired(*featTemplateIter)) { continue; }
 
-      case FeatureTemplate::LABEL_BIGRAM:
-      cerr << "this feature template is not implemented for word alignment" << endl;
-      assert(false);
+    switch(*featTemplateIter) {
+    case FeatureTemplate::PRECOMPUTED:
+      FirePosTemplate<FeatureTemplate::PRECOMPUTED>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::LABEL_BIGRAM:
+      FirePosTemplate<FeatureTemplate::LABEL_BIGRAM>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::EMISSION:
+      FirePosTemplate<FeatureTemplate::EMISSION>(factor, featureId, activeFeatures);
       break;
-
     case FeatureTemplate::OTHER_ALIGNERS:
-      for(unsigned alignerId = 0; alignerId < otherAlignersOutput.size(); alignerId++) {
-        assert(learningInfo->currentSentId < (int)otherAlignersOutput[alignerId]->size());
-	if( (*(*otherAlignersOutput[alignerId])[learningInfo->currentSentId]).size() <= i ) {continue;}
-	auto woodAlignments = (*(*otherAlignersOutput[alignerId])[learningInfo->currentSentId])[i];
-	featureId.type = FeatureTemplate::OTHER_ALIGNERS;
-	featureId.otherAligner.compatible = woodAlignments->count(yI) == 1 || \
-	  (yI == 0 && woodAlignments->size() == 0);
-	featureId.otherAligner.alignerId = alignerId;
-	AddParam(featureId);
-	activeFeatures[paramIndexes[featureId]] += 1.0;
-      }
+      FirePosTemplate<FeatureTemplate::OTHER_ALIGNERS>(factor, featureId, activeFeatures);
       break;
-
-    case FeatureTemplate::NULL_ALIGNMENT:
-      if(yI == 0) {
-	featureId.type = FeatureTemplate::NULL_ALIGNMENT;
-	AddParam(featureId);
-	activeFeatures[paramIndexes[featureId]] += 1.0;
-      }
+    case FeatureTemplate::OTHER_POS:
+      FirePosTemplate<FeatureTemplate::OTHER_POS>(factor, featureId, activeFeatures);
       break;
-
-    case FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO:
-      if(yI == 0) {
-	featureId.type = FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO;
-	AddParam(featureId);
-	activeFeatures[paramIndexes[featureId]] += 1.0 * (x_t.size() - x_s.size() - 1) / x_t.size();
-      }
+    case FeatureTemplate::BOUNDARY_LABELS:
+      FirePosTemplate<FeatureTemplate::BOUNDARY_LABELS>(factor, featureId, activeFeatures);
+      break;
+    case FeatureTemplate::PHRASE:
+      FirePosTemplate<FeatureTemplate::PHRASE>(factor, featureId, activeFeatures);
       break;
-
     default:
       assert(false);
-    } // end of switch
-  } // end of loop over enabled feature templates
+    }
+  }
+}
+
+// picks specialized extractors when learningInfo->featureTemplates is one of the lists used by 
+// train-latentCrfAligner and the pos tagging scripts (in the same order), and the generic ones otherwise
+void LogLinearParams::ChooseFeatureExtractors() {
+  // displacements k of the tokens x[i+k] whose precomputed features are fired in pos tagging
+  precomputedDisplacements.clear();
+  if(learningInfo->firePrecomputedFeaturesForXIM2) { precomputedDisplacements.push_back(-2); }
+  if(learningInfo->firePrecomputedFeaturesForXIM1) { precomputedDisplacements.push_back(-1); }
+  if(learningInfo->firePrecomputedFeaturesForXI) { precomputedDisplacements.push_back(0); }
+  if(learningInfo->firePrecomputedFeaturesForXIP1) { precomputedDisplacements.push_back(1); }
+  if(learningInfo->firePrecomputedFeaturesForXIP2) { precomputedDisplacements.push_back(2); }
+
+  typedef FeatureTemplate F;
+  const vector<F> &templates = learningInfo->featureTemplates;
+
+  // templates which depend on the sentence, not only on the window of tokens around x[i]
+  posTemplatesAreSentenceSpecific = 
+    find(templates.begin(), templates.end(), F::OTHER_POS) != templates.end() ||
+    find(templates.begin(), templates.end(), F::OTHER_ALIGNERS) != templates.end();
+  
+  alignerExtractor = &LogLinearParams::FireAlignerTemplatesGeneric;
+  if(templates == vector<F>{F::SRC0_TGT0}) {
+    alignerExtractor = &LogLinearParams::FireAlignerTemplates<F::SRC0_TGT0>;
+  } else if(templates == vector<F>{F::PRECOMPUTED, F::DIAGONAL_DEVIATION, F::LOG_ALIGNMENT_JUMP}) {
+    alignerExtractor = &LogLinearParams::FireAlignerTemplates<F::PRECOMPUTED, F::DIAGONAL_DEVIATION, F::LOG_ALIGNMENT_JUMP>;
+  } else if(templates == vector<F>{F::PRECOMPUTED, F::DIAGONAL_DEVIATION, F::LOG_ALIGNMENT_JUMP, F::OTHER_ALIGNERS, F::SRC_BIGRAM}) {
+    alignerExtractor = &LogLinearParams::FireAlignerTemplates<F::PRECOMPUTED, F::DIAGONAL_DEVIATION, F::LOG_ALIGNMENT_JUMP, F::OTHER_ALIGNERS, F::SRC_BIGRAM>;
+  }
+
+  posExtractor = &LogLinearParams::FirePosTemplatesGeneric;
+  if(templates == vector<F>{F::LABEL_BIGRAM, F::EMISSION}) {
+    posExtractor = &LogLinearParams::FirePosTemplates<F::LABEL_BIGRAM, F::EMISSION>;
+  } else if(templates == vector<F>{F::LABEL_BIGRAM, F::EMISSION, F::PRECOMPUTED}) {
+    posExtractor = &LogLinearParams::FirePosTemplates<F::LABEL_BIGRAM, F::EMISSION, F::PRECOMPUTED>;
+  } else if(templates == vector<F>{F::LABEL_BIGRAM, F::PRECOMPUTED}) {
+    posExtractor = &LogLinearParams::FirePosTemplates<F::LABEL_BIGRAM, F::PRECOMPUTED>;
+  }
 }
 
 // for pos induction
@@ -1197,8 +1670,10 @@ void LogLinearParams::FireFeatures(int yI, int yIM1, int sentId, const vector<in
   const int64_t &xIP2 = i+2 < x.size()? x[i+2] : -1; 
 
   // return cached features for this factor id
+  // (the cache is keyed on full factors, so it's bypassed when firing a subset of the templates)
+  bool useCache = learningInfo->cacheActiveFeatures && firedTemplates == FeatureTemplateSubset::ALL;
   PosFactorId factorId;
-  if(learningInfo->cacheActiveFeatures) {
+  if(useCache) {
     factorId.yI = yI;
     factorId.yIM1 = yIM1;
     factorId.xIM2 = xIM2;
@@ -1206,215 +1681,24 @@ void LogLinearParams::FireFeatures(int yI, int yIM1, int sentId, const vector<in
     factorId.xI = xI;
     factorId.xIP1 = xIP1;
     factorId.xIP2 = xIP2;
-    factorId.sentId = sentId;
-
-    if(posFactorIdToFeatures.count(factorId) == 1) {
-      activeFeatures = posFactorIdToFeatures[factorId];
+    // the other templates only depend on the window of tokens (sentence boundaries are -1), 
+    // so identical windows in different sentences share the same entry
+    factorId.sentId = posTemplatesAreSentenceSpecific? sentId : -1;
+    factorId.position = posTemplatesAreSentenceSpecific? (int)i : -1;
+
+    const FastSparseVector<double> *cachedFeatures = posFactorIdToFeatures.Find(factorId);
+    if(cachedFeatures) {
+      activeFeatures = *cachedFeatures;
       return;
     }
   }
 
-  FeatureId featureId;
-
-  std::vector<int> kValues;
-  std::hash<string> hash_fn;
-  for(auto featTemplateIter = learningInfo->featureTemplates.begin();
-      featTemplateIter != learningInfo->featureTemplates.end(); 
-      ++featTemplateIter) {
-    
-    featureId.type = *featTemplateIter;
-    
-    switch(featureId.type) {
-
-    case FeatureTemplate::PRECOMPUTED:
-      // a moving window of tokens y[i]:Precomputed(x[i+k])
-      kValues.clear();
-      if(learningInfo->firePrecomputedFeaturesForXIM2) { kValues.push_back(-2); }
-      if(learningInfo->firePrecomputedFeaturesForXIM1) { kValues.push_back(-1); }
-      if(learningInfo->firePrecomputedFeaturesForXI) { kValues.push_back(0); }
-      if(learningInfo->firePrecomputedFeaturesForXIP1) { kValues.push_back(1); }
-      if(learningInfo->firePrecomputedFeaturesForXIP2) { kValues.push_back(2); }
-      for(auto kIter = kValues.begin(); kIter != kValues.end(); ++kIter) {
-        int k = *kIter;
-        std::pair<int64_t, int64_t> wordPair(k==-2? xIM2: k==-1? xIM1: k==0? xI: k==1? xIP1: xIP2,
-                                             k==-2? xIM2: k==-1? xIM1: k==0? xI: k==1? xIP1: xIP2);
-        if(wordPair.first == -1) { continue; }
-        
-        auto precomputedFeatures = MapWordPairFeaturesToSharedMemory(false, wordPair);
-        if(!precomputedFeatures) { continue; }
-
-        // set the relative position of this token to the label being considered
-        featureId.emission.displacement = k;
-
-        // now, for each precomputed feature of this token:
-        for(auto precomputedIter = precomputedFeatures->begin();
-            precomputedIter != precomputedFeatures->end();
-            precomputedIter++) {
-          // now set all fields of the precomputed feature. 
-          // TODO-REFACTOR: this is a misuse of the field names.
-          // override the feature type because we need to conjoin the precomputed feature with label id in pos tagging
-          featureId.type = FeatureTemplate::EMISSION;
-          featureId.emission.label = yI;
-          featureId.emission.word = precomputedIter->first.precomputed;
-          // now, all necessary fields of this featureId has been set
-          try { AddParam(featureId); } catch(LogLinearParamsException &ex) { throw; }
-          // fire
-          activeFeatures[paramIndexes[featureId]] += precomputedIter->second;
-          
-          // if k != 0, consider also conjoining with the precomputed features at k=0
-          bool conjoin_multiple_precomputed = true;
-          if(conjoin_multiple_precomputed && k != 0 && learningInfo->firePrecomputedFeaturesForXI) {
-            // first, get the feature map for k=0
-            std::pair<int64_t, int64_t> xIWordPair(xI, xI);
-            if(xIWordPair.first == -1) { continue; }
-            auto xIPrecomputedFeatures = MapWordPairFeaturesToSharedMemory(false, xIWordPair);
-            if(!xIPrecomputedFeatures) { continue; }
-            // for each precomputed feature in this map
-            for(auto xIPrecomputedIter = xIPrecomputedFeatures->begin();
-                xIPrecomputedIter != xIPrecomputedFeatures->end();
-                xIPrecomputedIter++) {
-              // now populate a feature id of type wordtriple
-              featureId.type = FeatureTemplate::PRECOMPUTED_PAIR;
-              featureId.precomputedPair.displacement = k;
-              featureId.precomputedPair.word = xIPrecomputedIter->first.precomputed;
-              featureId.precomputedPair.other_word = precomputedIter->first.precomputed;
-              featureId.precomputedPair.label = yI;
-              // now, all necessary fields of this featureId has been set
-              try { AddParam(featureId); } catch(LogLinearParamsException &ex) { throw; }
-              // fire
-              activeFeatures[paramIndexes[featureId]] += precomputedIter->second;
-            }
-          }
-        }
-      }
-      
-      break;
-
-      case FeatureTemplate::LABEL_BIGRAM:
-        featureId.bigram.current = yI;
-        featureId.bigram.previous = yIM1;
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
-        
-        // label bias features
-        //featureId.bigram.previous = -1;
-        //AddParam(featureId);
-        //activeFeatures[paramIndexes[featureId]] += 1.0;
-      break;
-
-      case FeatureTemplate::EMISSION:
-        featureId.emission.label = yI;
-        // y[i]:x[i+k]
-        kValues.clear();
-        kValues.push_back(0);
-        //kValues.push_back(1);
-        //kValues.push_back(2);
-        for(auto kIter = kValues.begin(); kIter != kValues.end(); ++kIter) {
-          int k = *kIter;
-          featureId.emission.word = k==-2? xIM2: k==-1? xIM1: k==0? xI: k==1? xIP1: xIP2;
-          featureId.emission.displacement = k;
-          AddParam(featureId);
-          activeFeatures[paramIndexes[featureId]] += 1.0;
-          
-        }
-      break;
-
-      case FeatureTemplate::OTHER_ALIGNERS:
-        for(unsigned alignerId = 0; alignerId < otherAlignersOutput.size(); alignerId++) {
-        assert(sentId < (int)otherAlignersOutput[alignerId]->size());
-        if( (*(*otherAlignersOutput[alignerId])[sentId]).size() <= i ) {
-          continue;
-        }
-        auto woodAlignments = (*(*otherAlignersOutput[alignerId])[sentId])[i];
-        featureId.type = FeatureTemplate::OTHER_ALIGNERS;
-        featureId.otherAligner.compatible = woodAlignments->count(yI) == 1 || \
-          (yI == 0 && woodAlignments->size() == 0);
-        featureId.otherAligner.alignerId = alignerId;
-        AddParam(featureId);
-            activeFeatures[paramIndexes[featureId]] += 1.0;
-        }
-      break;
-
-    case FeatureTemplate::OTHER_POS:
-        for (unsigned posId = 0; posId < otherPOSOutput.size(); posId++) {
-            if ((*otherPOSOutput[posId])[sentId].size() <= i)
-                continue;
-            auto otherPred = (*otherPOSOutput[posId])[sentId][i];
-            featureId.type = FeatureTemplate::OTHER_POS;
-            featureId.otherPos.posId = posId; // predictor ID
-            featureId.otherPos.pred_hash = hash_fn(otherPred); // otherPred can be 'en', 'es', ...
-            featureId.otherPos.label = yI; // lang1, lang2
-            AddParam(featureId);
-            // activeFeatures[paramIndexes[featureId]] += (1.0/double(x.size()));
-            activeFeatures[paramIndexes[featureId]] += 1.0;
-        }
-
-        break;
-
-    case FeatureTemplate::BOUNDARY_LABELS:
-      if(i == 0 || i == x.size() - 1) {
-        featureId.type = FeatureTemplate::BOUNDARY_LABELS;
-        featureId.boundaryLabel.position = i == 0? 0 : -1;
-        featureId.boundaryLabel.label = yI;
-        AddParam(featureId);
-        activeFeatures[paramIndexes[featureId]] += 1.0;
-      }
-      break;
-
-    case FeatureTemplate::PHRASE:
-      {
-        // cerr << "phrase fired\n";
-        size_t bigram_hash_init;
-        size_t bigram_hash;
-        if (this->concatMap.count(std::make_pair(-1, x[i])) == 0) {
-          const string init = "^";
-          auto combined_init = string(init + FeatureId::vocabEncoder->Decode(x[i]));
-          boost::algorithm::to_lower(combined_init);
-          this->concatMap.insert(std::make_pair(std::make_pair(-1, x[i]), hash_fn(combined_init)));
-        }
-        bigram_hash_init = this->concatMap.at(std::make_pair(-1, x[i]));
-        
-        if (i > 0) {
-          if (this->concatMap.count(std::make_pair(x[i - 1], x[i])) == 0) {
-            auto combined = FeatureId::vocabEncoder->Decode(x[i - 1]) + "_" + FeatureId::vocabEncoder->Decode(x[i]);
-            boost::algorithm::to_lower(combined);
-            this->concatMap.insert(std::make_pair(std::make_pair(x[i - 1], x[i]), hash_fn(combined)));
-          }
-          bigram_hash = this->concatMap.at(std::make_pair(x[i - 1], x[i]));
-        } else {
-          bigram_hash = 0;
-        }
-        for (unsigned listId = 0; listId < phraseBigrams.size(); listId++) {
-          featureId.type = FeatureTemplate::PHRASE;
-          featureId.phraseListFeature.phraseListId = listId;
-          featureId.phraseListFeature.label = yI;
-          featureId.phraseListFeature.imLabel = yIM1;
-          if (phraseBigrams[listId]->find(bigram_hash) != phraseBigrams[listId]->end() \
-              || phraseBigrams[listId]->find(bigram_hash_init) != phraseBigrams[listId]->end()) {
-            featureId.phraseListFeature.bigramInContext = true;
-          } else {
-            featureId.phraseListFeature.bigramInContext = false;
-          }
-          AddParam(featureId);
-          activeFeatures[paramIndexes[featureId]] += 1.0;
-                }
-        // cerr << "ended phrase fired\n";
-        break;
-      }
-    default:
-      assert(false);
-      
-    }
-  }
+  PosFactor factor = {yI, yIM1, sentId, x, i, xIM2, xIM1, xI, xIP1, xIP2};
+  (this->*posExtractor)(factor, activeFeatures);
   
   // save the active features in the cache
-  if(learningInfo->cacheActiveFeatures) {
-    assert(posFactorIdToFeatures.count(factorId) == 0);
-    posFactorIdToFeatures[factorId] = activeFeatures;
-    if(posFactorIdToFeatures.size() % 1000000 == 0) {
-      cerr << learningInfo->mpiWorld->rank() << ": |factorIds| is now " << posFactorIdToFeatures.size() << endl;
-    } 
-    
+  if(useCache) {
+    posFactorIdToFeatures.Insert(factorId, activeFeatures);
   }
 }
 
@@ -1437,15 +1721,23 @@ void LogLinearParams::PersistParams(const string &outputFilename, bool humanFrie
   
   assert(paramsFile.good());
 
-  if(!humanFriendly) {
+  if(IsHashed()) {
+    // feature ids are not kept in hashing mode. each line consists of: <slot><space><featureWeight>\n
+    paramsFile << "# feature-hash-bits=" << learningInfo->featureHashBits << " signed=" << learningInfo->signedFeatureHash << endl;
+    for(unsigned i = 0; i < paramWeightsPtr->size(); ++i) {
+      if((*paramWeightsPtr)[i] != 0.0) {
+        paramsFile << i << " " << (*paramWeightsPtr)[i] << endl;
+      }
+    }
+  } else if(!humanFriendly) {
     // save data to archive
     archive::text_oarchive oa(paramsFile);
     // write class instance to archive
     oa << *this;
     // archive and stream closed when destructors are called
   } else {
-    for (auto paramsIter = paramIndexes.begin(); paramsIter != paramIndexes.end(); paramsIter++) {
-      paramsFile << paramsIter->first << " " << (*paramWeightsPtr)[paramsIter->second] << endl;
+    for (unsigned i = 0; i < paramIdsPtr->size(); i++) {
+      paramsFile << (*paramIdsPtr)[i] << " " << (*paramWeightsPtr)[i] << endl;
     }
   }
   paramsFile.close();
@@ -1454,6 +1746,10 @@ void LogLinearParams::PersistParams(const string &outputFilename, bool humanFrie
 // each line consists of: <featureStringId><space><featureWeight>\n
 void LogLinearParams::LoadParams(const string &inputFilename) {
   assert(!sealed);
+  if(IsHashed()) {
+    cerr << "ERROR: initial lambda params cannot be loaded with hashed features" << endl;
+    assert(false);
+  }
   
   // master is in charge of laoding params
   if(learningInfo->mpiWorld->rank() == 0){ 
@@ -1479,15 +1775,15 @@ void LogLinearParams::LoadParams(const string &inputFilename) {
 }
 void LogLinearParams::PrintFirstNParams(unsigned n) {
   assert(sealed);
-  for (auto paramsIter = paramIndexes.begin(); n-- > 0 && paramsIter != paramIndexes.end(); paramsIter++) {
-    cerr << paramsIter->first << " " << (*paramWeightsPtr)[paramsIter->second] * weightsMultiplier << " at " << paramsIter->second << endl;
+  for (unsigned i = 0; i < n && i < paramIdsPtr->size(); i++) {
+    cerr << (*paramIdsPtr)[i] << " " << (*paramWeightsPtr)[i] * weightsMultiplier << " at " << i << endl;
   }
 }
 
 // each line consists of: <featureStringId><space><featureWeight>\n
 void LogLinearParams::PrintParams() {
-  assert(paramIndexes.size() == paramWeightsPtr->size());
-  PrintFirstNParams(paramIndexes.size());
+  assert(paramIdsPtr->size() == paramWeightsPtr->size());
+  PrintFirstNParams(paramIdsPtr->size());
 }
 
 void LogLinearParams::PrintParams(unordered_map_featureId_double &tempParams) {
@@ -1504,10 +1800,10 @@ void LogLinearParams::UpdateParams(const unordered_map_featureId_double &gradien
   case OptAlgorithm::GRADIENT_DESCENT:
     for(auto gradientIter = gradient.begin(); gradientIter != gradient.end();
         gradientIter++) {
-      // in case this parameter does not exist in paramWeights/paramIndexes
+      // in case this parameter does not exist in paramWeights
       AddParam(gradientIter->first);
       // update the parameter weight
-      (*paramWeightsPtr)[ paramIndexes[gradientIter->first] ] -= optMethod.learningRate * gradientIter->second;
+      (*paramWeightsPtr)[ GetParamIndex(gradientIter->first) ] -= optMethod.learningRate * gradientIter->second;
     }
     break;
   default:
@@ -1523,7 +1819,7 @@ void LogLinearParams::UpdateParams(const double* array, const int arrayLength) {
   cerr << "##################" << endl;
   cerr << "pointer to internal weights: " << paramWeightsPtr->data() << ". pointer to external weights: " << array << endl;
   assert((unsigned)arrayLength == paramWeightsPtr->size());
-  assert(paramWeightsPtr->size() == paramIndexes.size());
+  assert(IsHashed() || paramWeightsPtr->size() == paramIdsPtr->size());
   for(int i = 0; i < arrayLength; i++) {
     (*paramWeightsPtr)[i] = array[i];
   }
@@ -1536,17 +1832,18 @@ void LogLinearParams::ConvertFeatureMapToFeatureArray(
     unordered_map_featureId_double& valuesMap, double* valuesArray, 
     unsigned constrainedFeaturesCount) { 
   // init to 0 
-  for(unsigned i = constrainedFeaturesCount; i < paramIndexes.size(); i++) { 
+  for(unsigned i = constrainedFeaturesCount; i < GetParamsCount(); i++) { 
     valuesArray[i-constrainedFeaturesCount] = 0; 
   } 
   // set the active features 
   for(auto valuesMapIter = valuesMap.begin(); valuesMapIter != valuesMap.end(); valuesMapIter++) { 
     // skip constrained features 
-    if(paramIndexes[valuesMapIter->first] < (int)constrainedFeaturesCount) { 
+    unsigned paramIndex = GetParamIndex(valuesMapIter->first);
+    if(paramIndex < constrainedFeaturesCount) { 
       continue; 
     } 
     // set the modified index in valuesArray 
-    valuesArray[ paramIndexes[valuesMapIter->first]-constrainedFeaturesCount ] = valuesMapIter->second; 
+    valuesArray[ paramIndex-constrainedFeaturesCount ] = valuesMapIter->second; 
   } 
 } 
 
@@ -1556,7 +1853,7 @@ double LogLinearParams::ComputeL2Norm() {
   double l2 = 0; 
   for(unsigned i = 0; i < paramWeightsPtr->size(); i++) { 
     double distance = 
-      featureGaussianMeans.find( (*paramIdsPtr)[i] ) == featureGaussianMeans.end()?
+      featureGaussianMeans.empty() || featureGaussianMeans.find( (*paramIdsPtr)[i] ) == featureGaussianMeans.end()?
       (*paramWeightsPtr)[i] : 
       (*paramWeightsPtr)[i] - featureGaussianMeans[ (*paramIdsPtr)[i] ];
     l2 += distance * distance;
@@ -1572,6 +1869,7 @@ bool LogLinearParams::LogLinearParamsIsIdentical(const LogLinearParams &otherPar
     return false;
   if(paramIndexes.size() != otherParams.paramIndexes.size()) 
     return false; 
+  // once sealed, paramIndexes is empty and the order of paramIds below determines the indexes
   if(paramWeightsPtr->size() != otherParams.paramWeightsPtr->size()) 
     return false; 
   if(paramWeightsTemp.size() != otherParams.paramWeightsTemp.size()) 
@@ -1606,7 +1904,7 @@ bool LogLinearParams::LogLinearParamsIsIdentical(const LogLinearParams &otherPar
   return true; 
 }
 
-// side effect: adds zero weights for parameter IDs present in values but not present in paramIndexes and paramWeights
+// side effect: adds zero weights for parameter IDs present in values but not present in paramWeights
 double LogLinearParams::DotProduct(const unordered_map_featureId_double& values) {
   if(!sealed) {
     return 0.0;
@@ -1615,14 +1913,15 @@ double LogLinearParams::DotProduct(const unordered_map_featureId_double& values)
   double dotProduct = 0;
   // for each active feature
   for(auto valuesIter = values.begin(); valuesIter != values.end(); valuesIter++) {
-    // make sure there's a corresponding feature in paramIndexes and paramWeights
+    // make sure there's a corresponding feature in paramWeights
     bool newParam = AddParam(valuesIter->first);
     // then update the dot product
-    dotProduct += valuesIter->second * (*paramWeightsPtr)[paramIndexes[valuesIter->first]];
+    unsigned paramIndex = GetParamIndex(valuesIter->first);
+    dotProduct += valuesIter->second * (*paramWeightsPtr)[paramIndex];
     if(std::isnan(dotProduct) || std::isinf(dotProduct)){
-      cerr << "problematic param: " << valuesIter->first << " with index " << paramIndexes[valuesIter->first] << endl;
+      cerr << "problematic param: " << valuesIter->first << " with index " << paramIndex << endl;
       cerr << "value = " << valuesIter->second << endl;
-      cerr << "weight = " << weightsMultiplier * (*paramWeightsPtr)[paramIndexes[valuesIter->first]] << endl;
+      cerr << "weight = " << weightsMultiplier * (*paramWeightsPtr)[paramIndex] << endl;
       if(newParam) { cerr << "newParam." << endl; } else { cerr << "old param." << endl;}
       assert(false);
     }
@@ -1653,6 +1952,20 @@ double LogLinearParams::DotProduct(const FastSparseVector<double> &values) {
   return DotProduct(values, *paramWeightsPtr, weightsMultiplier);
 }
 
+double LogLinearParams::DotProduct(const int *indexes, const double *values, unsigned count) {
+  if(!sealed) {
+    return 0.0;
+  }
+  const ShmemVectorOfDouble &weights = *paramWeightsPtr;
+  double dotProduct = 0;
+  for(unsigned k = 0; k < count; ++k) {
+    assert(indexes[k] >= 0 && (unsigned)indexes[k] < weights.size());
+    dotProduct += values[k] * weights[indexes[k]];
+  }
+  assert(!std::isnan(dotProduct) && !std::isinf(dotProduct));
+  return dotProduct * weightsMultiplier;
+}
+
 // compute dot product of two vectors
 // assumptions:
 // -both vectors are of the same size
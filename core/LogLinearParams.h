@@ -9,6 +9,7 @@
 #include <cmath>
 #include <functional>
 #include <utility>
+#include <algorithm>
 #include <exception>
 
 #include <boost/interprocess/managed_shared_memory.hpp>
@@ -35,6 +36,11 @@
 
 #include "LearningInfo.h"
 #include "VocabEncoder.h"
+#include "WordPairFeatureTable.h"
+#include "WordPairFeatureFile.h"
+#include "FactorFeaturesCache.h"
+#include "OtherAlignersTable.h"
+#include "SealedIndex.h"
 #include "../wammar-utils/Samplers.h"
 #include "../wammar-utils/tuple.h"
 
@@ -688,15 +694,207 @@ public:
   
 };
 
+// the packed, canonical form of a FeatureId: the template in the top byte of high, followed by the fields of 
+// the template, bit-packed in a fixed order. unused bits are zero, so two keys are equal iff both words are 
+// equal. feature ids are packed once when fired; containers of parameters then hash and compare 16 bytes
+// without switching on the template. FeatureId remains the readable form (see ToFeatureId())
+struct FeatureKey {
+public:
+  uint64_t high, low;
+
+  FeatureKey() : high(0), low(0) {}
+
+  explicit FeatureKey(const FeatureId &featureId) : high(0), low(0) {
+    unsigned offset = 0;
+    assert(featureId.type >= 0 && featureId.type < 256);
+    Put(offset, 8, featureId.type);
+    switch(featureId.type) {
+    case FeatureTemplate::BOUNDARY_LABELS:
+      Put(offset, 32, featureId.boundaryLabel.position);
+      Put(offset, 32, featureId.boundaryLabel.label);
+      break;
+    case FeatureTemplate::EMISSION:
+      Put(offset, 16, featureId.emission.displacement);
+      Put(offset, 32, featureId.emission.label);
+      Put(offset, 40, featureId.emission.word);
+      break;
+    case FeatureTemplate::PRECOMPUTED_PAIR:
+      Put(offset, 16, featureId.precomputedPair.displacement);
+      Put(offset, 24, featureId.precomputedPair.label);
+      Put(offset, 40, featureId.precomputedPair.word);
+      Put(offset, 40, featureId.precomputedPair.other_word);
+      break;
+    case FeatureTemplate::LABEL_BIGRAM:
+    case FeatureTemplate::SRC_BIGRAM:
+      Put(offset, 40, featureId.bigram.current);
+      Put(offset, 40, featureId.bigram.previous);
+      break;
+    case FeatureTemplate::ALIGNMENT_JUMP:
+    case FeatureTemplate::ALIGNMENT_JUMP_IS_ZERO:
+      Put(offset, 32, featureId.alignmentJump);
+      break;
+    case FeatureTemplate::LOG_ALIGNMENT_JUMP:
+      Put(offset, 32, featureId.biasedAlignmentJump.alignmentJump);
+      Put(offset, 64, featureId.biasedAlignmentJump.wordBias);
+      break;
+    case FeatureTemplate::SRC0_TGT0:
+    case FeatureTemplate::HC_TOKEN:
+    case FeatureTemplate::HC_POS:
+    case FeatureTemplate::CH_TOKEN:
+    case FeatureTemplate::CH_POS:
+    case FeatureTemplate::HEAD_CHILD_TOKEN_SET:
+    case FeatureTemplate::HEAD_CHILD_POS_SET:
+      Put(offset, 60, featureId.wordPair.srcWord);
+      Put(offset, 60, featureId.wordPair.tgtWord);
+      break;
+    case FeatureTemplate::HXC_POS:
+    case FeatureTemplate::CXH_POS:
+    case FeatureTemplate::XHC_POS:
+    case FeatureTemplate::XCH_POS:
+    case FeatureTemplate::HCX_POS:
+    case FeatureTemplate::CHX_POS:
+    case FeatureTemplate::HXxC_POS:
+    case FeatureTemplate::CXxH_POS:
+    case FeatureTemplate::HxXC_POS:
+    case FeatureTemplate::CxXH_POS:
+    case FeatureTemplate::POS_PAIR_DISTANCE:
+      Put(offset, 40, featureId.wordTriple.word1);
+      Put(offset, 40, featureId.wordTriple.word2);
+      Put(offset, 40, featureId.wordTriple.word3);
+      break;
+    case FeatureTemplate::PRECOMPUTED:
+      Put(offset, 64, featureId.precomputed);
+      break;
+    case FeatureTemplate::DIAGONAL_DEVIATION:
+    case FeatureTemplate::SRC_WORD_BIAS:
+    case FeatureTemplate::HEAD_POS:
+    case FeatureTemplate::CHILD_POS:
+      Put(offset, 64, featureId.wordBias);
+      break;
+    case FeatureTemplate::SYNC_START:
+    case FeatureTemplate::SYNC_END:
+    case FeatureTemplate::NULL_ALIGNMENT:
+    case FeatureTemplate::NULL_ALIGNMENT_LENGTH_RATIO:
+      break;
+    case FeatureTemplate::OTHER_ALIGNERS:
+      Put(offset, 40, featureId.otherAligner.alignerId);
+      Put(offset, 8, featureId.otherAligner.compatible);
+      break;
+    case FeatureTemplate::OTHER_POS:
+      Put(offset, 24, featureId.otherPos.posId);
+      Put(offset, 32, featureId.otherPos.label);
+      Put(offset, 64, featureId.otherPos.pred_hash);
+      break;
+    case FeatureTemplate::PHRASE:
+      Put(offset, 8, featureId.phraseListFeature.bigramInContext);
+      Put(offset, 40, featureId.phraseListFeature.phraseListId);
+      Put(offset, 32, featureId.phraseListFeature.label);
+      Put(offset, 32, featureId.phraseListFeature.imLabel);
+      break;
+    default:
+      assert(false);
+    }
+  }
+
+  // unpacks the key
+  FeatureId ToFeatureId() const;
+
+  inline FeatureTemplate Type() const {
+    return (FeatureTemplate) (high >> 56);
+  }
+
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+    ar & high;
+    ar & low;
+  }
+
+  inline bool operator==(const FeatureKey &rhs) const {
+    return high == rhs.high && low == rhs.low;
+  }
+
+  inline bool operator!=(const FeatureKey &rhs) const {
+    return high != rhs.high || low != rhs.low;
+  }
+
+  // orders by template first, like FeatureId
+  inline bool operator<(const FeatureKey &rhs) const {
+    return high < rhs.high || (high == rhs.high && low < rhs.low);
+  }
+
+  struct FeatureKeyHash : public std::unary_function<FeatureKey, size_t> {
+    inline size_t operator()(const FeatureKey &x) const {
+      // mix both words, then finalize as in murmur3
+      uint64_t h = x.high * 0x9e3779b97f4a7c15ULL ^ x.low;
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+    }
+  };
+
+  struct FeatureKeyEqual : public std::binary_function<FeatureKey, FeatureKey, bool> {
+    inline bool operator()(const FeatureKey &left, const FeatureKey &right) const {
+      return left == right;
+    }
+  };
+
+private:
+  // writes the lowest bits of value at bits [offset, offset + bits) of the key, counting from the most 
+  // significant bit of high, then advances offset. values must fit in bits (as signed integers); a value which
+  // does not would silently collide with other features, so it terminates the process (in release builds too)
+  inline void Put(unsigned &offset, unsigned bits, int64_t value) {
+    assert(offset + bits <= 128);
+    if(bits < 64 && ((int64_t) ((uint64_t) value << (64 - bits)) >> (64 - bits)) != value) {
+      FieldOverflow(bits, value);
+    }
+    uint64_t field = bits == 64? (uint64_t) value : (uint64_t) value & (((uint64_t) 1 << bits) - 1);
+    unsigned end = offset + bits;
+    if(end <= 64) {
+      high |= field << (64 - end);
+    } else if(offset >= 64) {
+      low |= field << (128 - end);
+    } else {
+      high |= field >> (end - 64);
+      low |= field << (128 - end);
+    }
+    offset = end;
+  }
+
+  // reports a value which does not fit in its field, and aborts
+  void FieldOverflow(unsigned bits, int64_t value) const;
+
+  // reads the field written by Put(offset, bits, value), and advances offset
+  inline int64_t Get(unsigned &offset, unsigned bits) const {
+    unsigned end = offset + bits;
+    uint64_t field;
+    if(end <= 64) {
+      field = high >> (64 - end);
+    } else if(offset >= 64) {
+      field = low >> (128 - end);
+    } else {
+      field = (high << (end - 64)) | (low >> (128 - end));
+    }
+    offset = end;
+    return bits == 64? (int64_t) field : (int64_t) (field << (64 - bits)) >> (64 - bits);
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, const FeatureKey& obj);
+
 // a few typedefs
 using unordered_map_featureId_double = boost::unordered_map<FeatureId, double, FeatureId::FeatureIdHash, FeatureId::FeatureIdEqual>;
 using unordered_map_featureId_int = boost::unordered_map<FeatureId, int, FeatureId::FeatureIdHash, FeatureId::FeatureIdEqual>;
+using unordered_map_featureKey_double = boost::unordered_map<FeatureKey, double, FeatureKey::FeatureKeyHash, FeatureKey::FeatureKeyEqual>;
+using unordered_map_featureKey_int = boost::unordered_map<FeatureKey, int, FeatureKey::FeatureKeyHash, FeatureKey::FeatureKeyEqual>;
 
 // Alias an STL compatible allocator of ints that allocates ints from the managed
 // shared memory segment.  This allocator will allow to place containers
 // in managed shared memory segments
 typedef boost::interprocess::allocator<double, boost::interprocess::managed_shared_memory::segment_manager> ShmemDoubleAllocator;
-typedef boost::interprocess::allocator<FeatureId, boost::interprocess::managed_shared_memory::segment_manager> ShmemFeatureIdAllocator;
+typedef boost::interprocess::allocator<FeatureKey, boost::interprocess::managed_shared_memory::segment_manager> ShmemFeatureKeyAllocator;
 typedef FeatureId InnerKeyType;
 typedef double InnerMappedType;
 typedef std::pair<const InnerKeyType, InnerMappedType> InnerValueType;
@@ -709,7 +907,12 @@ typedef std::map<OuterKeyType, OuterMappedType*, std::less<OuterKeyType>, ShmemO
 
 // Alias a vector that uses the previous STL-like allocator
 typedef vector<double, ShmemDoubleAllocator> ShmemVectorOfDouble;
-typedef vector<FeatureId, ShmemFeatureIdAllocator> ShmemVectorOfFeatureId;
+typedef vector<FeatureKey, ShmemFeatureKeyAllocator> ShmemVectorOfFeatureKey;
+
+// the index of sealed parameters, which lives in the shared memory segment (see LogLinearParams::Seal())
+typedef SealedIndex<FeatureKey, FeatureKey::FeatureKeyHash, FeatureKey::FeatureKeyEqual> ParamIndex;
+typedef boost::interprocess::allocator<ParamIndex::Slot, boost::interprocess::managed_shared_memory::segment_manager> ShmemParamIndexSlotAllocator;
+typedef vector<ParamIndex::Slot, ShmemParamIndexSlotAllocator> ShmemVectorOfParamIndexSlot;
 
 std::ostream& operator<<(std::ostream& os, const FeatureId& obj);
 
@@ -724,8 +927,7 @@ class LogLinearParams {
   // for the latent CRF model
   LogLinearParams(VocabEncoder &types, double gaussianStdDev = 1);
   
-  OuterMappedType* MapWordPairFeaturesToSharedMemory(bool create, const std::pair<int64_t, int64_t> &wordPair);
-  OuterMappedType* MapWordPairFeaturesToSharedMemory(bool create, const string& objectNickname);
+  WordPairFeatureRange GetWordPairFeatures(const std::pair<int64_t, int64_t> &wordPair);
   
   void* MapToSharedMemory(bool create, string name);
 
@@ -737,7 +939,8 @@ class LogLinearParams {
       int count = paramIdsPtr->size();
       os << count;
       for(unsigned i = 0; i < paramIdsPtr->size(); i++) {
-        os << (*paramIdsPtr)[i];
+        FeatureId featureId = (*paramIdsPtr)[i].ToFeatureId();
+        os << featureId;
         os << (*paramWeightsPtr)[i];
       }
     }
@@ -750,7 +953,7 @@ class LogLinearParams {
       for(int i = 0; i < count; ++i) {
         FeatureId featureId;
         is >> featureId;
-        paramIdsTemp.push_back(featureId);
+        paramIdsTemp.push_back(FeatureKey(featureId));
         double weight;
         is >> weight;
         paramWeightsTemp.push_back(weight);
@@ -761,11 +964,18 @@ class LogLinearParams {
     
   // this method seals the set of parameters being used, not their weights
   void Seal();
+
+  // Seal() in hashing mode (see IsHashed())
+  void SealHashed();
+
   void Unseal();
   bool IsSealed() const;
 
   void LoadPrecomputedFeaturesWith2Inputs(const std::string &wordPairFeaturesFilename);
 
+  // called by all processes with a binary word pair features file (see WordPairFeatureFile)
+  void MapPrecomputedFeaturesWith2Inputs(const std::string &wordPairFeaturesFilename);
+
   void AddToPrecomputedFeaturesWith2Inputs(int input1, int input2, FeatureId &featureId, double featureValue);
 
   double Hash();
@@ -788,6 +998,18 @@ class LogLinearParams {
             int srcSentLength, int tgtSentLength,
             unordered_map_featureId_double& activeFeatures);
 
+  // does this feature template look at y_{i-1}?
+  static bool DependsOnPreviousLabel(FeatureTemplate featureTemplate);
+
+  // given y_{i-1} and y_i, does this feature template look at the position i or the observations around it?
+  static bool DependsOnPosition(FeatureTemplate featureTemplate);
+
+  // is any of the enabled feature templates in this subset?
+  bool HasEnabledTemplates(FeatureTemplateSubset::FeatureTemplateSubset subset);
+
+  // true when none of the enabled templates which look at y_{i-1} depend on the position i
+  bool LabelPairTemplatesArePositionIndependent();
+
   // for pos tagging
   void FireFeatures(int yI, int yIM1, int sentId, const vector<int64_t> &x, unsigned i, 
 		    FastSparseVector<double> &activeFeatures);
@@ -797,12 +1019,49 @@ class LogLinearParams {
 		    int START_OF_SENTENCE_Y_VALUE, int NULL_POS,
 		    FastSparseVector<double> &activeFeatures);
 
+  // the inputs of one word alignment factor, read by the extractors of all templates
+  struct AlignerFactor {
+    int yI, yIM1;
+    const vector<int64_t> &x_t, &x_s;
+    unsigned i;
+    int64_t srcToken, prevSrcToken, tgtToken;
+  };
+
+  // the inputs of one pos tagging factor
+  struct PosFactor {
+    int yI, yIM1, sentId;
+    const vector<int64_t> &x;
+    unsigned i;
+    int64_t xIM2, xIM1, xI, xIP1, xIP2;
+    // x[i+k], or -1 outside the sentence
+    int64_t Token(int k) const { return k==-2? xIM2: k==-1? xIM1: k==0? xI: k==1? xIP1: xIP2; }
+  };
+
+  // fire the features of a single template (specialized in LogLinearParams.cc)
+  template <FeatureTemplate T> 
+  void FireAlignerTemplate(const AlignerFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures);
+  template <FeatureTemplate T> 
+  void FirePosTemplate(const PosFactor &factor, FeatureId &featureId, FastSparseVector<double> &activeFeatures);
+
+  // fire the features of a list of templates known at compile time
+  template <FeatureTemplate... Templates> 
+  void FireAlignerTemplates(const AlignerFactor &factor, FastSparseVector<double> &activeFeatures);
+  template <FeatureTemplate... Templates> 
+  void FirePosTemplates(const PosFactor &factor, FastSparseVector<double> &activeFeatures);
+
+  // fire the features of learningInfo->featureTemplates
+  void FireAlignerTemplatesGeneric(const AlignerFactor &factor, FastSparseVector<double> &activeFeatures);
+  void FirePosTemplatesGeneric(const PosFactor &factor, FastSparseVector<double> &activeFeatures);
+
+  // sets alignerExtractor and posExtractor according to learningInfo->featureTemplates
+  void ChooseFeatureExtractors();
+
   // for dependency parsing
   void FireFeatures(const ObservationDetails &headDetails, const ObservationDetails &childDetails,
                     const std::vector<ObservationDetails> &sentDetails,
                     FastSparseVector<double> &activeFeatures);
 
-  int AddParams(const std::vector< FeatureId > &paramIds);
+  int AddParams(const std::vector< FeatureKey > &paramIds);
 
   // if the paramId does not exist, add it with weight drawn from gaussian. otherwise, do nothing. 
   bool AddParam(const FeatureId &paramId);
@@ -810,7 +1069,14 @@ class LogLinearParams {
   // if the paramId does not exist, add it. otherwise, do nothing. 
   bool AddParam(const FeatureId &paramId, double paramWeight);
 
-  // side effect: adds zero weights for parameter IDs present in values but not present in paramIndexes and paramWeights
+  // the same, for packed feature ids
+  bool AddParam(const FeatureKey &paramKey);
+  bool AddParam(const FeatureKey &paramKey, double paramWeight);
+
+  // the initial weight of a new parameter (see learningInfo->initializeLambdasWith*)
+  double SampleInitialWeight();
+
+  // side effect: adds zero weights for parameter IDs present in values but not present in paramWeights
   double DotProduct(const unordered_map_featureId_double& values);
 
   double DotProduct(const std::vector<double>& values);
@@ -820,6 +1086,9 @@ class LogLinearParams {
   double DotProduct(const FastSparseVector<double> &values);
 
   double DotProduct(const FastSparseVector<double> &values, const ShmemVectorOfDouble& weights, double weightsMultiplier);
+
+  // the features are given as count parallel (already resolved) parameter indexes and values
+  double DotProduct(const int *indexes, const double *values, unsigned count);
  
   // updates the model parameters given the gradient and an optimization method
   void UpdateParams(const unordered_map_featureId_double &gradient, const OptMethod &optMethod);
@@ -885,11 +1154,16 @@ class LogLinearParams {
   
  public:
   // the actual parameters 
-  unordered_map_featureId_int paramIndexes;
+  // indexes of the parameters discovered before the object is sealed (emptied by Seal())
+  unordered_map_featureKey_int paramIndexes;
+  // maps (*paramIdsPtr)[i] to i once the object is sealed. built by the master in the shared memory 
+  // segment (paramIndexSlotsPtr), and only read by all processes
+  ParamIndex sealedIndex;
+  ShmemVectorOfParamIndexSlot *paramIndexSlotsPtr;
   ShmemVectorOfDouble *paramWeightsPtr; 
   std::vector< double > paramWeightsTemp; 
-  ShmemVectorOfFeatureId *paramIdsPtr; 
-  std::vector< FeatureId > paramIdsTemp; 
+  ShmemVectorOfFeatureKey *paramIdsPtr; 
+  std::vector< FeatureKey > paramIdsTemp; 
   
   // maps a word id into a string
   VocabEncoder &types;
@@ -901,8 +1175,8 @@ class LogLinearParams {
   const set< int > *englishClosedClassTypes;
 
   // for each other aligner, for each sentence pair, for each target position, 
-  // determines the corresponding src position 
-  std::vector< std::vector< std::vector< std::set<int>* >* >* > otherAlignersOutput;
+  // determines the corresponding src positions (in shared memory)
+  OtherAlignersTable otherAlignersOutput;
 
   // for each other POS output, for each sentence, for each token, determines the predicted label
   std::vector< std::vector< std::vector< string > >* > otherPOSOutput;
@@ -910,16 +1184,31 @@ class LogLinearParams {
   // for each word see if it fires a bigram (or unigram if at sentence initial) in a list
   std::vector< std::set<size_t>* > phraseBigrams;
   
-  boost::unordered_map< std::pair<int64_t, int64_t>, OuterMappedType*> cacheWordPairFeatures;
+  // precomputed features of word pairs, in shared memory
+  WordPairFeatureTable wordPairFeatures;
+  bool wordPairFeaturesMapped;
+  // or, with a binary features file, the file mapped read-only
+  WordPairFeatureFile wordPairFeaturesFile;
  
-  boost::unordered_map< PosFactorId, FastSparseVector<double>, PosFactorId::PosFactorHash, PosFactorId::PosFactorEqual > posFactorIdToFeatures;
+  // the extractors used by FireFeatures() (see ChooseFeatureExtractors())
+  void (LogLinearParams::*alignerExtractor)(const AlignerFactor &factor, FastSparseVector<double> &activeFeatures);
+  void (LogLinearParams::*posExtractor)(const PosFactor &factor, FastSparseVector<double> &activeFeatures);
+  std::vector<int> precomputedDisplacements;
+  bool posTemplatesAreSentenceSpecific;
+
+  // active features of pos factors, with learningInfo->cacheActiveFeatures
+  FactorFeaturesCache< PosFactorId, PosFactorId::PosFactorHash, PosFactorId::PosFactorEqual > posFactorIdToFeatures;
   
   boost::unordered_map<std::pair<int64_t, int64_t>, size_t> concatMap;
  
-  unordered_map_featureId_double featureGaussianMeans;
+  unordered_map_featureKey_double featureGaussianMeans;
 
   bool logging;
 
+  // FireFeatures() only fires the enabled templates which belong to this subset. 
+  // defaults to FeatureTemplateSubset::ALL
+  FeatureTemplateSubset::FeatureTemplateSubset firedTemplates;
+
  private:
   bool sealed;
   double weightsMultiplier;
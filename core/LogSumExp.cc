@@ -0,0 +1,382 @@
+#include "LogSumExp.h"
+
+#include <math.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LOG_SUM_EXP_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace LogSumExp {
+
+  // exp(-d) is only evaluated for d in [-MAX_EXPONENT, MAX_EXPONENT], which keeps 2^n a normal double.
+  // larger d (including +inf and nan) gives 0. in the sums below, d is always shifted by the minimum,
+  // so this changes them by less than 1e-300 relative
+  static const double MAX_EXPONENT = 700.0;
+
+  // -log(s) shifted by the minimum m, or +inf if all the summed values are +inf
+  static inline double Finalize(double m, double s) {
+    return std::isinf(m)? m : m - log(s);
+  }
+
+  // portable implementation
+
+  // -log \sum_{j<rows} exp(-(a[j] + M[j*cols+k])) for one column k
+  static inline double ScalarNLogSumColumn(const double *a, const double *M, unsigned rows, unsigned cols, unsigned k) {
+    double m = numeric_limits<double>::infinity();
+    for(unsigned j = 0; j < rows; ++j) {
+      m = min(m, a[j] + M[j * cols + k]);
+    }
+    if(std::isinf(m)) { return m; }
+    double s = 0.0;
+    for(unsigned j = 0; j < rows; ++j) {
+      s += exp(m - a[j] - M[j * cols + k]);
+    }
+    return Finalize(m, s);
+  }
+
+  static void ScalarNLogSumColumns(const double *a, const double *M, unsigned rows, unsigned cols, double *out) {
+    for(unsigned k = 0; k < cols; ++k) {
+      out[k] = ScalarNLogSumColumn(a, M, rows, cols, k);
+    }
+  }
+
+  static double ScalarNLogSumRow(const double *a, const double *b, unsigned n) {
+    double m = numeric_limits<double>::infinity();
+    for(unsigned k = 0; k < n; ++k) {
+      m = min(m, a[k] + b[k]);
+    }
+    if(std::isinf(m)) { return m; }
+    double s = 0.0;
+    for(unsigned k = 0; k < n; ++k) {
+      s += exp(m - a[k] - b[k]);
+    }
+    return Finalize(m, s);
+  }
+
+  static void ScalarNExp(const double *a, double shift, unsigned n, double *out) {
+    for(unsigned k = 0; k < n; ++k) {
+      out[k] = exp(shift - a[k]);
+    }
+  }
+
+  const Kernels& Scalar() {
+    static Kernels kernels = { ScalarNLogSumColumns, ScalarNLogSumRow, ScalarNExp, "scalar" };
+    return kernels;
+  }
+
+#ifdef LOG_SUM_EXP_X86
+
+  // exp(r) on [-ln(2)/2, ln(2)/2] is approximated with its taylor series up to r^11 (relative error < 1e-14),
+  // after the range reduction exp(x) = 2^n exp(r), x = n ln(2) + r
+  static const double LOG2E = 1.4426950408889634;
+  static const double LN2_HI = 0.693145751953125;
+  static const double LN2_LO = 1.42860682030941723212e-6;
+  static const double EXP_COEFFS[] = { 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0,
+                                       1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0,
+                                       1.0 / 6.0, 0.5, 1.0, 1.0 };
+
+  // AVX2 implementation (4 doubles per register)
+
+  __attribute__((target("avx2,fma")))
+  static inline __m256d ExpNeg256(__m256d d) {
+    // false for nan (from inf - inf)
+    __m256d inRange = _mm256_cmp_pd(d, _mm256_set1_pd(MAX_EXPONENT), _CMP_LE_OQ);
+    d = _mm256_max_pd(_mm256_min_pd(d, _mm256_set1_pd(MAX_EXPONENT)), _mm256_set1_pd(-MAX_EXPONENT));
+    __m256d x = _mm256_sub_pd(_mm256_setzero_pd(), d);
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+    __m256d p = _mm256_set1_pd(EXP_COEFFS[0]);
+    for(unsigned c = 1; c < sizeof(EXP_COEFFS) / sizeof(double); ++c) {
+      p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFFS[c]));
+    }
+    // 2^n, built from the exponent bits
+    __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_and_pd(_mm256_mul_pd(p, _mm256_castsi256_pd(e)), inRange);
+  }
+
+  __attribute__((target("avx2,fma")))
+  static inline double HorizontalMin256(__m256d v) {
+    __m128d m = _mm_min_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return min(_mm_cvtsd_f64(m), _mm_cvtsd_f64(_mm_unpackhi_pd(m, m)));
+  }
+
+  __attribute__((target("avx2,fma")))
+  static inline double HorizontalSum256(__m256d v) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void Avx2NLogSumColumns(const double *a, const double *M, unsigned rows, unsigned cols, double *out) {
+    const unsigned W = 4;
+    unsigned k = 0;
+    for(; k + W <= cols; k += W) {
+      __m256d m = _mm256_set1_pd(numeric_limits<double>::infinity());
+      for(unsigned j = 0; j < rows; ++j) {
+        m = _mm256_min_pd(m, _mm256_add_pd(_mm256_set1_pd(a[j]), _mm256_loadu_pd(M + j * cols + k)));
+      }
+      __m256d s = _mm256_setzero_pd();
+      for(unsigned j = 0; j < rows; ++j) {
+        __m256d v = _mm256_add_pd(_mm256_set1_pd(a[j]), _mm256_loadu_pd(M + j * cols + k));
+        s = _mm256_add_pd(s, ExpNeg256(_mm256_sub_pd(v, m)));
+      }
+      double mArray[W], sArray[W];
+      _mm256_storeu_pd(mArray, m);
+      _mm256_storeu_pd(sArray, s);
+      for(unsigned w = 0; w < W; ++w) {
+        out[k + w] = Finalize(mArray[w], sArray[w]);
+      }
+    }
+    // remaining columns
+    for(; k < cols; ++k) {
+      out[k] = ScalarNLogSumColumn(a, M, rows, cols, k);
+    }
+  }
+
+  __attribute__((target("avx2,fma")))
+  static double Avx2NLogSumRow(const double *a, const double *b, unsigned n) {
+    const unsigned W = 4;
+    unsigned vectorized = n - n % W;
+    __m256d mVector = _mm256_set1_pd(numeric_limits<double>::infinity());
+    for(unsigned k = 0; k < vectorized; k += W) {
+      mVector = _mm256_min_pd(mVector, _mm256_add_pd(_mm256_loadu_pd(a + k), _mm256_loadu_pd(b + k)));
+    }
+    double m = HorizontalMin256(mVector);
+    for(unsigned k = vectorized; k < n; ++k) {
+      m = min(m, a[k] + b[k]);
+    }
+    if(std::isinf(m)) { return m; }
+    __m256d sVector = _mm256_setzero_pd();
+    __m256d mBroadcast = _mm256_set1_pd(m);
+    for(unsigned k = 0; k < vectorized; k += W) {
+      __m256d v = _mm256_add_pd(_mm256_loadu_pd(a + k), _mm256_loadu_pd(b + k));
+      sVector = _mm256_add_pd(sVector, ExpNeg256(_mm256_sub_pd(v, mBroadcast)));
+    }
+    double s = HorizontalSum256(sVector);
+    for(unsigned k = vectorized; k < n; ++k) {
+      s += exp(m - a[k] - b[k]);
+    }
+    return Finalize(m, s);
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void Avx2NExp(const double *a, double shift, unsigned n, double *out) {
+    const unsigned W = 4;
+    unsigned k = 0;
+    __m256d shiftBroadcast = _mm256_set1_pd(shift);
+    for(; k + W <= n; k += W) {
+      _mm256_storeu_pd(out + k, ExpNeg256(_mm256_sub_pd(_mm256_loadu_pd(a + k), shiftBroadcast)));
+    }
+    for(; k < n; ++k) {
+      out[k] = exp(shift - a[k]);
+    }
+  }
+
+  // AVX-512 implementation (8 doubles per register).
+  // gcc 12 implements the unmasked min, max, roundscale and extract intrinsics (and the _mm512_reduce_* helpers
+  // built on them) with a deliberately uninitialized source register, which -Wall reports. the merge-masked forms
+  // with all lanes selected compile to the same instructions without it
+  static const __mmask8 ALL_LANES = 0xFF;
+
+  __attribute__((target("avx512f")))
+  static inline __m512d Min512(__m512d a, __m512d b) {
+    return _mm512_mask_min_pd(a, ALL_LANES, a, b);
+  }
+
+  __attribute__((target("avx512f")))
+  static inline __m512d ExpNeg512(__m512d d) {
+    __mmask8 inRange = _mm512_cmp_pd_mask(d, _mm512_set1_pd(MAX_EXPONENT), _CMP_LE_OQ);
+    d = Min512(d, _mm512_set1_pd(MAX_EXPONENT));
+    d = _mm512_mask_max_pd(d, ALL_LANES, d, _mm512_set1_pd(-MAX_EXPONENT));
+    __m512d x = _mm512_sub_pd(_mm512_setzero_pd(), d);
+    __m512d n = _mm512_mul_pd(x, _mm512_set1_pd(LOG2E));
+    n = _mm512_mask_roundscale_pd(n, ALL_LANES, n, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+    __m512d p = _mm512_set1_pd(EXP_COEFFS[0]);
+    for(unsigned c = 1; c < sizeof(EXP_COEFFS) / sizeof(double); ++c) {
+      p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_COEFFS[c]));
+    }
+    // p * 2^n
+    return _mm512_maskz_scalef_pd(inRange, p, n);
+  }
+
+  // the lower (half = 0) or upper (half = 1) 256 bits of v. (gcc 12 implements _mm512_castpd512_pd256 with the
+  // unmasked extract, too)
+  #define HALF_512(v, half) _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, (v), (half))
+
+  // the two 256-bit halves are combined, then reduced as in HorizontalMin256() and HorizontalSum256(). those are
+  // not called, since gcc does not inline avx2 functions into avx512f ones, and the calls are much slower
+  __attribute__((target("avx512f")))
+  static inline double HorizontalMin512(__m512d v) {
+    __m256d h = _mm256_min_pd(HALF_512(v, 0), HALF_512(v, 1));
+    __m128d m = _mm_min_pd(_mm256_castpd256_pd128(h), _mm256_extractf128_pd(h, 1));
+    return min(_mm_cvtsd_f64(m), _mm_cvtsd_f64(_mm_unpackhi_pd(m, m)));
+  }
+
+  __attribute__((target("avx512f")))
+  static inline double HorizontalSum512(__m512d v) {
+    __m256d h = _mm256_add_pd(HALF_512(v, 0), HALF_512(v, 1));
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(h), _mm256_extractf128_pd(h, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+  }
+
+  __attribute__((target("avx512f")))
+  static void Avx512NLogSumColumns(const double *a, const double *M, unsigned rows, unsigned cols, double *out) {
+    const unsigned W = 8;
+    unsigned k = 0;
+    for(; k + W <= cols; k += W) {
+      __m512d m = _mm512_set1_pd(numeric_limits<double>::infinity());
+      for(unsigned j = 0; j < rows; ++j) {
+        m = Min512(m, _mm512_add_pd(_mm512_set1_pd(a[j]), _mm512_loadu_pd(M + j * cols + k)));
+      }
+      __m512d s = _mm512_setzero_pd();
+      for(unsigned j = 0; j < rows; ++j) {
+        __m512d v = _mm512_add_pd(_mm512_set1_pd(a[j]), _mm512_loadu_pd(M + j * cols + k));
+        s = _mm512_add_pd(s, ExpNeg512(_mm512_sub_pd(v, m)));
+      }
+      double mArray[W], sArray[W];
+      _mm512_storeu_pd(mArray, m);
+      _mm512_storeu_pd(sArray, s);
+      for(unsigned w = 0; w < W; ++w) {
+        out[k + w] = Finalize(mArray[w], sArray[w]);
+      }
+    }
+    // remaining columns
+    for(; k < cols; ++k) {
+      out[k] = ScalarNLogSumColumn(a, M, rows, cols, k);
+    }
+  }
+
+  __attribute__((target("avx512f")))
+  static double Avx512NLogSumRow(const double *a, const double *b, unsigned n) {
+    const unsigned W = 8;
+    unsigned vectorized = n - n % W;
+    __m512d mVector = _mm512_set1_pd(numeric_limits<double>::infinity());
+    for(unsigned k = 0; k < vectorized; k += W) {
+      mVector = Min512(mVector, _mm512_add_pd(_mm512_loadu_pd(a + k), _mm512_loadu_pd(b + k)));
+    }
+    double m = HorizontalMin512(mVector);
+    for(unsigned k = vectorized; k < n; ++k) {
+      m = min(m, a[k] + b[k]);
+    }
+    if(std::isinf(m)) { return m; }
+    __m512d sVector = _mm512_setzero_pd();
+    __m512d mBroadcast = _mm512_set1_pd(m);
+    for(unsigned k = 0; k < vectorized; k += W) {
+      __m512d v = _mm512_add_pd(_mm512_loadu_pd(a + k), _mm512_loadu_pd(b + k));
+      sVector = _mm512_add_pd(sVector, ExpNeg512(_mm512_sub_pd(v, mBroadcast)));
+    }
+    double s = HorizontalSum512(sVector);
+    for(unsigned k = vectorized; k < n; ++k) {
+      s += exp(m - a[k] - b[k]);
+    }
+    return Finalize(m, s);
+  }
+
+  __attribute__((target("avx512f")))
+  static void Avx512NExp(const double *a, double shift, unsigned n, double *out) {
+    const unsigned W = 8;
+    unsigned k = 0;
+    __m512d shiftBroadcast = _mm512_set1_pd(shift);
+    for(; k + W <= n; k += W) {
+      _mm512_storeu_pd(out + k, ExpNeg512(_mm512_sub_pd(_mm512_loadu_pd(a + k), shiftBroadcast)));
+    }
+    for(; k < n; ++k) {
+      out[k] = exp(shift - a[k]);
+    }
+  }
+
+  bool Avx2(Kernels &kernels) {
+    __builtin_cpu_init();
+    if(!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+      return false;
+    }
+    kernels.NLogSumColumns = Avx2NLogSumColumns;
+    kernels.NLogSumRow = Avx2NLogSumRow;
+    kernels.NExp = Avx2NExp;
+    kernels.name = "avx2";
+    return true;
+  }
+
+  bool Avx512(Kernels &kernels) {
+    __builtin_cpu_init();
+    if(!__builtin_cpu_supports("avx512f")) {
+      return false;
+    }
+    kernels.NLogSumColumns = Avx512NLogSumColumns;
+    kernels.NLogSumRow = Avx512NLogSumRow;
+    kernels.NExp = Avx512NExp;
+    kernels.name = "avx512";
+    return true;
+  }
+
+#else
+
+  bool Avx2(Kernels &kernels) { return false; }
+  bool Avx512(Kernels &kernels) { return false; }
+
+#endif
+
+  // the vectorized kernels supported by this cpu (detected once)
+  struct SupportedKernels {
+    SupportedKernels() {
+      hasAvx512 = Avx512(avx512);
+      hasAvx2 = Avx2(avx2);
+    }
+    Kernels avx512, avx2;
+    bool hasAvx512, hasAvx2;
+  };
+
+  static const SupportedKernels& Supported() {
+    // initialized once, on first use
+    static SupportedKernels supported;
+    return supported;
+  }
+
+  // set by Force()
+  static const Kernels *forced = 0;
+
+  const Kernels& Best(unsigned K) {
+    if(forced) {
+      return *forced;
+    }
+    // wider vectors only pay off once the rows fill them (8 doubles for AVX-512, 4 for AVX2)
+    const SupportedKernels &supported = Supported();
+    if(supported.hasAvx512 && K >= 8) {
+      return supported.avx512;
+    }
+    if(supported.hasAvx2 && K >= 4) {
+      return supported.avx2;
+    }
+    return Scalar();
+  }
+
+  const Kernels& Best() {
+    return Best(numeric_limits<unsigned>::max());
+  }
+
+  bool Force(const std::string &name) {
+    const SupportedKernels &supported = Supported();
+    if(name == "auto") {
+      forced = 0;
+    } else if(name == Scalar().name) {
+      forced = &Scalar();
+    } else if(name == "avx2" && supported.hasAvx2) {
+      forced = &supported.avx2;
+    } else if(name == "avx512" && supported.hasAvx512) {
+      forced = &supported.avx512;
+    } else {
+      return false;
+    }
+    return true;
+  }
+}
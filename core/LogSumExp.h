@@ -0,0 +1,49 @@
+#ifndef _LOG_SUM_EXP_H_
+#define _LOG_SUM_EXP_H_
+
+#include <string>
+
+// vectorized -log \sum exp(-v) kernels used by the forward/backward passes of DenseLattice.
+// all values are -log values, as in FstUtils::LogWeight. an AVX-512 or AVX2 implementation
+// is picked at runtime depending on the cpu and the number of labels, with a portable scalar fallback.
+namespace LogSumExp {
+
+  // out[k] = -log \sum_{j<rows} exp(-(a[j] + M[j*cols+k])), for k < cols.
+  // this is the forward recursion: alpha_i = a (alpha_{i-1}) combined with the columns of the transition matrix M
+  typedef void (*NLogSumColumnsFunc)(const double *a, const double *M, unsigned rows, unsigned cols, double *out);
+
+  // returns -log \sum_{k<n} exp(-(a[k] + b[k])).
+  // this is the backward recursion: beta_i[j] = row j of the transition matrix combined with beta_{i+1}
+  typedef double (*NLogSumRowFunc)(const double *a, const double *b, unsigned n);
+
+  // out[k] = exp(-(a[k] - shift)), for k < n. used to turn -log marginals into probabilities
+  typedef void (*NExpFunc)(const double *a, double shift, unsigned n, double *out);
+
+  struct Kernels {
+    NLogSumColumnsFunc NLogSumColumns;
+    NLogSumRowFunc NLogSumRow;
+    NExpFunc NExp;
+    std::string name;
+  };
+
+  // the kernels to use for rows of about K values: the widest vectors supported by this cpu which K fills
+  // (AVX-512 from 8 values, AVX2 from 4 values, scalar below), unless Force() was called
+  const Kernels& Best(unsigned K);
+
+  // the widest kernels supported by this cpu, unless Force() was called
+  const Kernels& Best();
+
+  // makes Best() return the named kernels ("scalar", "avx2" or "avx512") for all K. "auto" restores the default.
+  // returns false if the name is unknown or the kernels are not supported by this cpu or this build.
+  // must be called before any lattice is built
+  bool Force(const std::string &name);
+
+  // the portable implementation
+  const Kernels& Scalar();
+
+  // the AVX2/AVX-512 implementations. returns false if not supported by this cpu or this build
+  bool Avx2(Kernels &kernels);
+  bool Avx512(Kernels &kernels);
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef _NODE_REDUCER_H_
+#define _NODE_REDUCER_H_
+
+#include <vector>
+#include <atomic>
+#include <cassert>
+#include <mpi.h>
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/allocators/allocator.hpp>
+
+// sums arrays of doubles across processes in two levels. the processes running on the same node add up their
+// arrays in a buffer of the managed shared memory segment: each one copies its array to its own slot, then adds up
+// one chunk of all slots into the first slot. one leader per node (the lowest rank on that node) then reduces the
+// node sums across nodes with MPI, and the other processes of the node read the result from the buffer.
+// all methods are collective over the communicator passed to Init().
+class NodeReducer {
+
+ public:
+  typedef boost::interprocess::managed_shared_memory::segment_manager SegmentManager;
+  typedef boost::interprocess::allocator<double, SegmentManager> ShmemDoubleAllocator;
+  typedef boost::interprocess::vector<double, ShmemDoubleAllocator> ShmemVectorOfDouble;
+
+  NodeReducer() : segment(0), node(MPI_COMM_NULL), leaders(MPI_COMM_NULL),
+    worldRank(0), nodeRank(0), nodeSize(1) {}
+
+  ~NodeReducer() {
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if(finalized) { return; }
+    if(node != MPI_COMM_NULL) { MPI_Comm_free(&node); }
+    if(leaders != MPI_COMM_NULL) { MPI_Comm_free(&leaders); }
+  }
+
+  bool IsInitialized() const { return segment != 0; }
+
+  // segment must be shared by all processes of each node
+  void Init(MPI_Comm world, boost::interprocess::managed_shared_memory *segment) {
+    assert(!IsInitialized() && segment);
+    this->segment = segment;
+    MPI_Comm_rank(world, &worldRank);
+    MPI_Comm_split_type(world, MPI_COMM_TYPE_SHARED, worldRank, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &nodeRank);
+    MPI_Comm_size(node, &nodeSize);
+    // keyed by world rank, so the master (rank 0) is both the leader of its node and rank 0 among leaders
+    MPI_Comm_split(world, nodeRank == 0? 0 : MPI_UNDEFINED, worldRank, &leaders);
+    assert(worldRank != 0 || nodeRank == 0);
+  }
+
+  int NodeSize() const { return nodeSize; }
+
+  // sums values[0..count) in place. with allProcesses, all processes get the sums. otherwise, only the master does
+  void Reduce(double *values, unsigned count, bool allProcesses) {
+    assert(IsInitialized());
+    if(count == 0) { return; }
+
+    // no process may still be reading the result of the previous call from the buffer when the leader grows
+    // (i.e. reallocates) it
+    MPI_Barrier(node);
+
+    // the leader grows the buffer to one slot per process of the node. the others wait until it is there
+    size_t bufferCount = (size_t)nodeSize * count;
+    if(nodeRank == 0) {
+      ShmemVectorOfDouble *buffer = segment->find_or_construct<ShmemVectorOfDouble>("nodeReduceBuffer")
+        (ShmemDoubleAllocator(segment->get_segment_manager()));
+      if(buffer->size() < bufferCount) {
+        buffer->resize(bufferCount);
+      }
+    }
+    MPI_Barrier(node);
+    ShmemVectorOfDouble *buffer = segment->find<ShmemVectorOfDouble>("nodeReduceBuffer").first;
+    assert(buffer && buffer->size() >= bufferCount);
+    double *slots = &(*buffer)[0];
+
+    // copy my values to my slot
+    std::copy(values, values + count, slots + (size_t)nodeRank * count);
+    Sync();
+
+    // add up my chunk of all slots into the first slot. chunks are summed in node rank order, so the sums do not
+    // depend on timing
+    size_t chunkBegin = (size_t)count * nodeRank / nodeSize, chunkEnd = (size_t)count * (nodeRank + 1) / nodeSize;
+    for(int slotId = 1; slotId < nodeSize; ++slotId) {
+      const double *slot = slots + (size_t)slotId * count;
+      for(size_t i = chunkBegin; i < chunkEnd; ++i) {
+        slots[i] += slot[i];
+      }
+    }
+    Sync();
+
+    // the leaders reduce the node sums across nodes
+    if(nodeRank == 0) {
+      if(allProcesses) {
+        MPI_Allreduce(MPI_IN_PLACE, slots, count, MPI_DOUBLE, MPI_SUM, leaders);
+      } else if(worldRank == 0) {
+        MPI_Reduce(MPI_IN_PLACE, slots, count, MPI_DOUBLE, MPI_SUM, 0, leaders);
+      } else {
+        MPI_Reduce(slots, 0, count, MPI_DOUBLE, MPI_SUM, 0, leaders);
+      }
+    }
+    if(allProcesses) {
+      Sync();
+    }
+
+    // read the result
+    if(allProcesses || worldRank == 0) {
+      std::copy(slots, slots + count, values);
+    }
+  }
+
+ private:
+  // makes my writes to the buffer visible to the other processes of the node, and theirs to me
+  void Sync() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    MPI_Barrier(node);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  boost::interprocess::managed_shared_memory *segment;
+  MPI_Comm node, leaders;
+  int worldRank, nodeRank, nodeSize;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef _OTHER_ALIGNERS_TABLE_H_
+#define _OTHER_ALIGNERS_TABLE_H_
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cassert>
+#include <stdint.h>
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/allocators/allocator.hpp>
+
+#include "../wammar-utils/StringUtils.h"
+
+// the word alignments predicted by other aligners for the training corpus, kept in flat arrays in the managed
+// shared memory segment. each target token has a bitset of the source positions it is aligned to (position 0 is
+// the NULL source word), stored as a range of bits in one bit array:
+// - sentBegin[alignerBegin[alignerId] + sentId] is the first token of a sentence (sentences of all aligners are
+//   concatenated, each aligner with one extra entry at its end),
+// - the bits of token t are bits[tokenBegin[t]..tokenBegin[t+1]).
+// the master builds it once. all processes check alignments directly in the segment.
+class OtherAlignersTable {
+
+ public:
+  typedef boost::interprocess::managed_shared_memory::segment_manager SegmentManager;
+  typedef boost::interprocess::allocator<uint64_t, SegmentManager> ShmemUint64Allocator;
+  typedef boost::interprocess::vector<uint64_t, ShmemUint64Allocator> ShmemVectorOfUint64;
+
+  OtherAlignersTable() : alignerBegin(0), sentBegin(0), tokenBegin(0), bits(0) {}
+
+  // called by the master only. each file has one line per sentence pair, with space-separated srcpos-tgtpos
+  // pairs. with reverse, the pairs are read as tgtpos-srcpos. target positions not mentioned are aligned to NULL
+  void Build(boost::interprocess::managed_shared_memory &segment, const std::vector<std::string> &filenames, bool reverse) {
+    ShmemUint64Allocator allocator(segment.get_segment_manager());
+    alignerBegin = segment.find_or_construct<ShmemVectorOfUint64>("otherAlignersAlignerBegin")(allocator);
+    sentBegin = segment.find_or_construct<ShmemVectorOfUint64>("otherAlignersSentBegin")(allocator);
+    tokenBegin = segment.find_or_construct<ShmemVectorOfUint64>("otherAlignersTokenBegin")(allocator);
+    bits = segment.find_or_construct<ShmemVectorOfUint64>("otherAlignersBits")(allocator);
+    assert(alignerBegin->size() == 0 && sentBegin->size() == 0 && tokenBegin->size() == 0 && bits->size() == 0);
+
+    tokenBegin->push_back(0);
+    for(auto filenameIter = filenames.begin(); filenameIter != filenames.end(); ++filenameIter) {
+      std::cerr << "aligner filename: " << *filenameIter << std::endl;
+      alignerBegin->push_back(sentBegin->size());
+      std::ifstream infile(filenameIter->c_str());
+      std::string line;
+      std::vector< std::vector<int> > sentAlignments;
+      while(std::getline(infile, line)) {
+        sentBegin->push_back(tokenBegin->size() - 1);
+        // each line consists of a number of word-to-word alignments
+        for(unsigned tgtpos = 0; tgtpos < sentAlignments.size(); ++tgtpos) {
+          sentAlignments[tgtpos].clear();
+        }
+        unsigned tokensCount = 0;
+        std::vector<std::string> srcpos_tgtpos_pairs;
+        StringUtils::SplitString(line, ' ', srcpos_tgtpos_pairs);
+        for(auto pairIter = srcpos_tgtpos_pairs.begin(); pairIter != srcpos_tgtpos_pairs.end(); ++pairIter) {
+          int srcpos, tgtpos;
+          char del;
+          std::istringstream ss(*pairIter);
+          ss >> srcpos >> del >> tgtpos;
+          assert(del == '-');
+          if(reverse) {
+            std::swap(srcpos, tgtpos);
+          }
+          // increment srcpos because we insert the NULL src word at the beginning of each sentence
+          srcpos++;
+          assert(tgtpos >= 0 && srcpos >= 0);
+          if(sentAlignments.size() <= (unsigned) tgtpos) {
+            sentAlignments.resize(tgtpos + 1);
+          }
+          tokensCount = std::max(tokensCount, (unsigned) tgtpos + 1);
+          sentAlignments[tgtpos].push_back(srcpos);
+        }
+        // the bitset of each token is as long as its largest source position
+        for(unsigned tgtpos = 0; tgtpos < tokensCount; ++tgtpos) {
+          uint64_t first = tokenBegin->back(), length = 0;
+          for(auto srcpos = sentAlignments[tgtpos].begin(); srcpos != sentAlignments[tgtpos].end(); ++srcpos) {
+            length = std::max(length, (uint64_t) *srcpos + 1);
+          }
+          bits->resize((first + length + 63) / 64, 0);
+          for(auto srcpos = sentAlignments[tgtpos].begin(); srcpos != sentAlignments[tgtpos].end(); ++srcpos) {
+            uint64_t bit = first + *srcpos;
+            (*bits)[bit / 64] |= (uint64_t) 1 << (bit % 64);
+          }
+          tokenBegin->push_back(first + length);
+        }
+      }
+      sentBegin->push_back(tokenBegin->size() - 1);
+    }
+    alignerBegin->push_back(sentBegin->size());
+  }
+
+  // called by the other processes. returns false if the master did not build a table
+  bool Map(boost::interprocess::managed_shared_memory &segment) {
+    alignerBegin = segment.find<ShmemVectorOfUint64>("otherAlignersAlignerBegin").first;
+    sentBegin = segment.find<ShmemVectorOfUint64>("otherAlignersSentBegin").first;
+    tokenBegin = segment.find<ShmemVectorOfUint64>("otherAlignersTokenBegin").first;
+    bits = segment.find<ShmemVectorOfUint64>("otherAlignersBits").first;
+    return alignerBegin != 0 && sentBegin != 0 && tokenBegin != 0 && bits != 0;
+  }
+
+  unsigned AlignersCount() const {
+    return alignerBegin? alignerBegin->size() - 1 : 0;
+  }
+
+  // number of sentences aligned by this aligner
+  unsigned SentsCount(unsigned alignerId) const {
+    return (*alignerBegin)[alignerId + 1] - (*alignerBegin)[alignerId] - 1;
+  }
+
+  // number of target positions in this sentence, up to the last one aligned to a source word
+  unsigned TokensCount(unsigned alignerId, unsigned sentId) const {
+    uint64_t sent = (*alignerBegin)[alignerId] + sentId;
+    return (*sentBegin)[sent + 1] - (*sentBegin)[sent];
+  }
+
+  // true if the aligner aligned tgtPos to srcPos, or if tgtPos is not aligned and srcPos is NULL (i.e. 0).
+  // assumes tgtPos < TokensCount(alignerId, sentId)
+  inline bool IsCompatible(unsigned alignerId, unsigned sentId, unsigned tgtPos, int srcPos) const {
+    uint64_t token = (*sentBegin)[(*alignerBegin)[alignerId] + sentId] + tgtPos;
+    uint64_t first = (*tokenBegin)[token], last = (*tokenBegin)[token + 1];
+    if(first == last) {
+      return srcPos == 0;
+    }
+    if(srcPos < 0 || first + srcPos >= last) {
+      return false;
+    }
+    uint64_t bit = first + srcPos;
+    return ((*bits)[bit / 64] >> (bit % 64)) & 1;
+  }
+
+  size_t Bytes() const {
+    if(!alignerBegin) { return 0; }
+    return sizeof(uint64_t) * (alignerBegin->size() + sentBegin->size() + tokenBegin->size() + bits->size());
+  }
+
+ private:
+  ShmemVectorOfUint64 *alignerBegin, *sentBegin, *tokenBegin, *bits;
+};
+
+#endif
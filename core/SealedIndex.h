@@ -0,0 +1,101 @@
+#ifndef _SEALED_INDEX_H_
+#define _SEALED_INDEX_H_
+
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+// a read-only map from keys[i] to i, built once from an array of distinct keys which must outlive it.
+// open addressing with robin hood insertion: every key is at most a few slots away from its home slot,
+// and a lookup stops as soon as it passes the slot where the key would have been placed.
+// the slots are plain data owned by the caller (e.g. a vector in a shared memory segment, built by one process
+// and attached by the others). Find() does not modify the index, so it can be called concurrently.
+template <class Key, class Hash, class Equal>
+class SealedIndex {
+
+ public:
+  struct Slot {
+    size_t hash;
+    // index < 0 marks empty slots
+    int index;
+    // distance from the home slot (hash & mask)
+    uint32_t distance;
+  };
+
+  SealedIndex() : keys(0), slots(0), mask(0) {}
+
+  // number of slots needed for keysCount keys (a power of 2, with a load factor under 0.8)
+  static size_t SlotsCount(size_t keysCount) {
+    size_t slotsCount = 1;
+    while(slotsCount * 4 < keysCount * 5 + 1) { slotsCount *= 2; }
+    return slotsCount;
+  }
+
+  // populates slots[0..SlotsCount(count)) with keys[0..count)
+  static void Build(const Key *keys, size_t count, Slot *slots) {
+    size_t mask = SlotsCount(count) - 1;
+    Slot emptySlot = {0, -1, 0};
+    for(size_t slotId = 0; slotId <= mask; ++slotId) {
+      slots[slotId] = emptySlot;
+    }
+    Hash hash;
+    Equal equal;
+    for(size_t i = 0; i < count; ++i) {
+      Slot inserted = {hash(keys[i]), (int)i, 0};
+      for(size_t slotId = inserted.hash & mask; ; slotId = (slotId + 1) & mask, ++inserted.distance) {
+        Slot &slot = slots[slotId];
+        if(slot.index < 0) {
+          slot = inserted;
+          break;
+        }
+        assert(!(slot.hash == inserted.hash && equal(keys[slot.index], keys[inserted.index])));
+        // take the slot from keys closer to their home slot
+        if(slot.distance < inserted.distance) {
+          Slot displaced = slot;
+          slot = inserted;
+          inserted = displaced;
+        }
+      }
+    }
+  }
+
+  // use slots populated by Build() with the same keys (possibly mapped at a different address)
+  void Attach(const Key *keys, const Slot *slots, size_t slotsCount) {
+    assert((slotsCount & (slotsCount - 1)) == 0);
+    this->keys = keys;
+    this->slots = slots;
+    mask = slotsCount - 1;
+  }
+
+  void Clear() {
+    keys = 0;
+    slots = 0;
+    mask = 0;
+  }
+
+  // the index of key, or -1
+  inline int Find(const Key &key) const {
+    if(slots == 0) { return -1; }
+    size_t keyHash = hash(key);
+    uint32_t distance = 0;
+    for(size_t slotId = keyHash & mask; ; slotId = (slotId + 1) & mask, ++distance) {
+      const Slot &slot = slots[slotId];
+      if(slot.index < 0 || slot.distance < distance) {
+        return -1;
+      }
+      if(slot.hash == keyHash && equal(keys[slot.index], key)) {
+        return slot.index;
+      }
+    }
+  }
+
+ private:
+  const Key *keys;
+  const Slot *slots;
+  size_t mask;
+  Hash hash;
+  Equal equal;
+};
+
+#endif
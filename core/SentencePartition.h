@@ -0,0 +1,87 @@
+#ifndef _SENTENCE_PARTITION_H_
+#define _SENTENCE_PARTITION_H_
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cassert>
+
+// assigns each sentence to one of ranksCount processes. with costs, sentences are assigned greedily from the most
+// expensive to the least expensive, each to the process with the smallest total cost so far (longest processing
+// time first), which keeps the most loaded process within 4/3 of the optimum. every process computes the same
+// assignment from the same costs, so no communication is needed. sentences beyond the partitioned ones are
+// assigned round-robin.
+class SentencePartition {
+
+ public:
+  SentencePartition() : ranksCount(1) {}
+
+  // round-robin: sentId is assigned to rank sentId % ranksCount
+  void BuildRoundRobin(unsigned sentsCount, unsigned ranksCount) {
+    assert(ranksCount > 0);
+    this->ranksCount = ranksCount;
+    sentRanks.resize(sentsCount);
+    for(unsigned sentId = 0; sentId < sentsCount; ++sentId) {
+      sentRanks[sentId] = sentId % ranksCount;
+    }
+  }
+
+  // longest processing time first, according to costs[sentId]
+  void Build(const std::vector<double> &costs, unsigned ranksCount) {
+    assert(ranksCount > 0);
+    this->ranksCount = ranksCount;
+    sentRanks.resize(costs.size());
+
+    // most expensive first. ties are broken by sentId, so that all processes agree
+    std::vector< std::pair<double, unsigned> > sentsByCost(costs.size());
+    for(unsigned sentId = 0; sentId < costs.size(); ++sentId) {
+      sentsByCost[sentId] = std::make_pair(-costs[sentId], sentId);
+    }
+    std::sort(sentsByCost.begin(), sentsByCost.end());
+
+    // (load, rank) of each process, least loaded (then lowest rank) on top
+    typedef std::pair<double, unsigned> RankLoad;
+    std::priority_queue< RankLoad, std::vector<RankLoad>, std::greater<RankLoad> > ranksByLoad;
+    for(unsigned rank = 0; rank < ranksCount; ++rank) {
+      ranksByLoad.push(RankLoad(0.0, rank));
+    }
+    for(auto sentIter = sentsByCost.begin(); sentIter != sentsByCost.end(); ++sentIter) {
+      RankLoad leastLoaded = ranksByLoad.top();
+      ranksByLoad.pop();
+      sentRanks[sentIter->second] = leastLoaded.second;
+      leastLoaded.first -= sentIter->first;
+      ranksByLoad.push(leastLoaded);
+    }
+  }
+
+  inline unsigned Rank(unsigned sentId) const {
+    return sentId < sentRanks.size()? sentRanks[sentId] : sentId % ranksCount;
+  }
+
+  // the total cost assigned to each rank, according to costs
+  std::vector<double> Loads(const std::vector<double> &costs) const {
+    std::vector<double> loads(ranksCount, 0.0);
+    for(unsigned sentId = 0; sentId < costs.size(); ++sentId) {
+      loads[Rank(sentId)] += costs[sentId];
+    }
+    return loads;
+  }
+
+  // the most loaded rank's cost divided by the average cost per rank (1 = perfectly balanced)
+  static double Imbalance(const std::vector<double> &loads) {
+    double maxLoad = 0.0, totalLoad = 0.0;
+    for(auto load = loads.begin(); load != loads.end(); ++load) {
+      maxLoad = std::max(maxLoad, *load);
+      totalLoad += *load;
+    }
+    return totalLoad > 0.0? maxLoad * loads.size() / totalLoad : 1.0;
+  }
+
+ private:
+  unsigned ranksCount;
+  std::vector<unsigned> sentRanks;
+};
+
+#endif
@@ -6,6 +6,8 @@
 #include <boost/mpi/environment.hpp>
 #include <boost/mpi/communicator.hpp>
 #include <boost/mpi/collectives.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
 
 #include "../wammar-utils/FstUtils.h"
 #include "../wammar-utils/ClustersComparer.h"
@@ -36,28 +38,96 @@ class UnsupervisedSequenceTaggingModel {
     Label(tokensInt, labels);
   }
 
+  // true if Label(tokens, labels) can be called concurrently from several threads,
+  // i.e. it does not modify any state shared between sentences
+  virtual bool LabelIsThreadSafe() { return false; }
+
+  // the contiguous block of sentences [first, last) which this process labels, out of sentencesCount
+  void GetLabelingBlock(unsigned sentencesCount, unsigned &first, unsigned &last) {
+    unsigned size = learningInfo.mpiWorld->size(), rank = learningInfo.mpiWorld->rank();
+    unsigned blockSize = sentencesCount / size, remainder = sentencesCount % size;
+    // the first (sentencesCount % size) processes get one more sentence
+    first = rank * blockSize + min(rank, remainder);
+    last = first + blockSize + (rank < remainder? 1 : 0);
+  }
+
+  // labels tokens[first..last), using learningInfo.threadsPerRank threads if Label() is thread safe
+  void LabelBlock(vector<vector<int64_t> > &tokens, unsigned first, unsigned last, vector<vector<int> > &labels) {
+    assert(labels.size() == tokens.size());
+    unsigned threadsCount = LabelIsThreadSafe()? min(learningInfo.threadsPerRank, last - first) : 1;
+    if(threadsCount <= 1) {
+      for(unsigned i = first; i < last; i++) {
+        Label(tokens[i], labels[i]);
+      }
+      return;
+    }
+    // each thread keeps taking the next unlabeled sentence
+    std::atomic<unsigned> next(first);
+    boost::thread_group threads;
+    for(unsigned t = 0; t < threadsCount; t++) {
+      threads.create_thread([this, &tokens, &labels, &next, last] () {
+          for(unsigned i = next++; i < last; i = next++) {
+            Label(tokens[i], labels[i]);
+          }
+        });
+    }
+    threads.join_all();
+  }
+
+  // each process labels a contiguous block of sentences, then all labels are exchanged 
+  // with two MPI_Allgatherv calls (sentence lengths, then the flattened labels)
   virtual void LabelInParallel(vector<vector<int64_t> > &tokens, vector<vector<int> > &labels) {
     assert(labels.size() == 0);
     labels.resize(tokens.size());
-    for(unsigned i = 0; i < tokens.size(); i++) {
-      if(learningInfo.mpiWorld->rank() % learningInfo.mpiWorld->size() != i) continue;
-      Label(tokens[i], labels[i]);
+    unsigned first, last;
+    GetLabelingBlock(tokens.size(), first, last);
+    LabelBlock(tokens, first, last, labels);
+
+    // flatten the labels of this block
+    vector<int> localLengths, localLabels;
+    for(unsigned i = first; i < last; i++) {
+      localLengths.push_back(labels[i].size());
+      localLabels.insert(localLabels.end(), labels[i].begin(), labels[i].end());
     }
+
+    // how many sentences and labels each process contributes
+    int size = learningInfo.mpiWorld->size();
+    vector<int> sentencesCounts(size), labelsCounts(size);
+    int localSentencesCount = localLengths.size(), localLabelsCount = localLabels.size();
+    MPI_Allgather(&localSentencesCount, 1, MPI_INT, &sentencesCounts[0], 1, MPI_INT, *learningInfo.mpiWorld);
+    MPI_Allgather(&localLabelsCount, 1, MPI_INT, &labelsCounts[0], 1, MPI_INT, *learningInfo.mpiWorld);
+    vector<int> sentencesOffsets(size, 0), labelsOffsets(size, 0);
+    for(int proc = 1; proc < size; proc++) {
+      sentencesOffsets[proc] = sentencesOffsets[proc-1] + sentencesCounts[proc-1];
+      labelsOffsets[proc] = labelsOffsets[proc-1] + labelsCounts[proc-1];
+    }
+    assert(sentencesOffsets[size-1] + sentencesCounts[size-1] == (int)tokens.size());
+
+    // blocks are contiguous and in rank order, so the gathered buffers are in sentence order
+    vector<int> allLengths(tokens.size()), allLabels(labelsOffsets[size-1] + labelsCounts[size-1]);
+    MPI_Allgatherv(localLengths.empty()? 0 : &localLengths[0], localSentencesCount, MPI_INT, 
+                   allLengths.empty()? 0 : &allLengths[0], &sentencesCounts[0], &sentencesOffsets[0], MPI_INT, 
+                   *learningInfo.mpiWorld);
+    MPI_Allgatherv(localLabels.empty()? 0 : &localLabels[0], localLabelsCount, MPI_INT, 
+                   allLabels.empty()? 0 : &allLabels[0], &labelsCounts[0], &labelsOffsets[0], MPI_INT, 
+                   *learningInfo.mpiWorld);
+
+    // unflatten
+    unsigned offset = 0;
     for(unsigned i = 0; i < tokens.size(); i++) {
-      mpi::broadcast< vector<int> >(*learningInfo.mpiWorld, labels[i], i % learningInfo.mpiWorld->size());
+      labels[i].assign(allLabels.begin() + offset, allLabels.begin() + offset + allLengths[i]);
+      offset += allLengths[i];
     }
   }
 
   void LabelInParallel(vector<vector<string> > &tokens, vector<vector<int> > &labels) {
-    assert(labels.size() == 0);
-    labels.resize(tokens.size());
-    for(unsigned i = 0 ; i <tokens.size(); i++) {
-      if(learningInfo.mpiWorld->rank() % learningInfo.mpiWorld->size() != i) continue;
-      Label(tokens[i], labels[i]);
-    }
+    vector<vector<int64_t> > tokensInt(tokens.size());
     for(unsigned i = 0; i < tokens.size(); i++) {
-      mpi::broadcast< vector<int> >(*learningInfo.mpiWorld, labels[i], i % learningInfo.mpiWorld->size());
+      for(unsigned j = 0; j < tokens[i].size(); j++) {
+        tokensInt[i].push_back(vocabEncoder.Encode(tokens[i][j]));
+      }
     }
+    LabelInParallel(tokensInt, labels);
   }
 
   void Label(vector<vector<string> > &tokens, vector<vector<int> > &labels) {
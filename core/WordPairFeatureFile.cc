@@ -0,0 +1,291 @@
+#include "WordPairFeatureFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <boost/unordered_map.hpp>
+
+using namespace std;
+
+const char WordPairFeatureFile::MAGIC[8] = {'W', 'P', 'F', 'E', 'A', 'T', '0', '1'};
+
+bool WordPairFeatureFile::IsBinary(const string &filename) {
+  ifstream file(filename.c_str(), ios::in | ios::binary);
+  char magic[sizeof(MAGIC)];
+  if(!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+namespace {
+
+// interns strings, in order of first appearance
+class StringIds {
+ public:
+  uint64_t Id(const char *begin, const char *end) {
+    string token(begin, end);
+    auto iter = ids.find(token);
+    if(iter != ids.end()) {
+      return iter->second;
+    }
+    ids[token] = strings.size();
+    strings.push_back(token);
+    return strings.size() - 1;
+  }
+
+  // sorts the strings. newIds[old id] is the new id
+  void Sort(vector<uint64_t> &newIds) {
+    vector<uint64_t> order(strings.size());
+    for(uint64_t i = 0; i < order.size(); ++i) { order[i] = i; }
+    sort(order.begin(), order.end(), [this](uint64_t a, uint64_t b) { return strings[a] < strings[b]; });
+    newIds.resize(order.size());
+    vector<string> sorted(order.size());
+    for(uint64_t i = 0; i < order.size(); ++i) {
+      newIds[order[i]] = i;
+      sorted[i].swap(strings[order[i]]);
+    }
+    strings.swap(sorted);
+    ids.clear();
+  }
+
+  vector<string> strings;
+
+ private:
+  boost::unordered_map<string, uint64_t> ids;
+};
+
+struct TextPair {
+  uint64_t src, tgt, firstEntry, lastEntry;
+};
+
+uint64_t Align8(uint64_t offset) {
+  return (offset + 7) & ~(uint64_t)7;
+}
+
+void WritePadding(ofstream &file, uint64_t &offset) {
+  static const char zeros[8] = {0};
+  uint64_t aligned = Align8(offset);
+  file.write(zeros, aligned - offset);
+  offset = aligned;
+}
+
+template <class T> void WriteArray(ofstream &file, uint64_t &offset, const vector<T> &values) {
+  file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  offset += values.size() * sizeof(T);
+}
+
+void WriteStrings(ofstream &file, uint64_t &offset, const vector<string> &strings) {
+  vector<uint64_t> offsets(1, 0);
+  for(auto iter = strings.begin(); iter != strings.end(); ++iter) {
+    offsets.push_back(offsets.back() + iter->size());
+  }
+  WriteArray(file, offset, offsets);
+  for(auto iter = strings.begin(); iter != strings.end(); ++iter) {
+    file.write(iter->data(), iter->size());
+  }
+  offset += offsets.back();
+  WritePadding(file, offset);
+}
+
+uint64_t StringsBytes(const vector<string> &strings) {
+  uint64_t bytes = (strings.size() + 1) * sizeof(uint64_t);
+  for(auto iter = strings.begin(); iter != strings.end(); ++iter) {
+    bytes += iter->size();
+  }
+  return Align8(bytes);
+}
+
+}
+
+// example line in the text format:
+// madrasa ||| school ||| F52:editdistance=7 F53:capitalconsistency=1
+void WordPairFeatureFile::Convert(const string &textFilename, const string &binaryFilename) {
+  ifstream textFile(textFilename.c_str(), ios::in);
+  if(!textFile) {
+    cerr << "could not open " << textFilename << endl;
+    exit(1);
+  }
+  StringIds words, featureNames;
+  vector<TextPair> pairs;
+  vector<WordPairFeature> textEntries;
+  string line;
+  unsigned lineNumber = 0;
+  while(getline(textFile, line)) {
+    ++lineNumber;
+    if(line.size() == 0) {
+      continue;
+    }
+    // split on spaces
+    vector<pair<const char*, const char*> > tokens;
+    const char *cursor = line.data(), *lineEnd = line.data() + line.size();
+    while(cursor < lineEnd) {
+      const char *tokenEnd = (const char*)memchr(cursor, ' ', lineEnd - cursor);
+      if(!tokenEnd) { tokenEnd = lineEnd; }
+      if(tokenEnd > cursor) { tokens.push_back(make_pair(cursor, tokenEnd)); }
+      cursor = tokenEnd + 1;
+    }
+    if(tokens.size() < 5) {
+      cerr << "line " << lineNumber << " of " << textFilename << " is not formatted correctly" << endl;
+      exit(1);
+    }
+    TextPair textPair;
+    textPair.src = words.Id(tokens[0].first, tokens[0].second);
+    textPair.tgt = words.Id(tokens[2].first, tokens[2].second);
+    textPair.firstEntry = textEntries.size();
+    // the remaining tokens are name=value
+    for(unsigned i = 4; i < tokens.size(); ++i) {
+      const char *equals = tokens[i].second - 1;
+      while(equals > tokens[i].first && *equals != '=') { --equals; }
+      if(*equals != '=') {
+        cerr << "line " << lineNumber << " of " << textFilename << " has a feature without a value" << endl;
+        exit(1);
+      }
+      WordPairFeature entry;
+      entry.precomputed = featureNames.Id(tokens[i].first, equals);
+      entry.value = strtod(string(equals + 1, tokens[i].second).c_str(), 0);
+      textEntries.push_back(entry);
+    }
+    textPair.lastEntry = textEntries.size();
+    pairs.push_back(textPair);
+  }
+  textFile.close();
+
+  // sort words and feature names so that words can be found with a binary search
+  vector<uint64_t> newWordIds, newFeatureNameIds;
+  words.Sort(newWordIds);
+  featureNames.Sort(newFeatureNameIds);
+  for(auto pairIter = pairs.begin(); pairIter != pairs.end(); ++pairIter) {
+    pairIter->src = newWordIds[pairIter->src];
+    pairIter->tgt = newWordIds[pairIter->tgt];
+  }
+  stable_sort(pairs.begin(), pairs.end(), [](const TextPair &a, const TextPair &b) {
+      return a.src < b.src || (a.src == b.src && a.tgt < b.tgt);
+    });
+
+  // build the index. the features of repeated pairs are concatenated
+  vector<uint64_t> srcBegin(words.strings.size() + 1, 0), pairTgt, entryBegin(1, 0);
+  vector<WordPairFeature> entries;
+  entries.reserve(textEntries.size());
+  for(uint64_t i = 0; i < pairs.size(); ++i) {
+    bool repeated = i > 0 && pairs[i].src == pairs[i-1].src && pairs[i].tgt == pairs[i-1].tgt;
+    if(!repeated) {
+      pairTgt.push_back(pairs[i].tgt);
+      entryBegin.push_back(entryBegin.back());
+      ++srcBegin[pairs[i].src + 1];
+    }
+    for(uint64_t entry = pairs[i].firstEntry; entry < pairs[i].lastEntry; ++entry) {
+      entries.push_back(textEntries[entry]);
+      entries.back().precomputed = newFeatureNameIds[entries.back().precomputed];
+    }
+    entryBegin.back() = entries.size();
+  }
+  for(uint64_t word = 0; word < words.strings.size(); ++word) {
+    srcBegin[word + 1] += srcBegin[word];
+  }
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.wordsCount = words.strings.size();
+  header.featureNamesCount = featureNames.strings.size();
+  header.pairsCount = pairTgt.size();
+  header.entriesCount = entries.size();
+  header.wordsOffset = Align8(sizeof(Header));
+  header.featureNamesOffset = header.wordsOffset + StringsBytes(words.strings);
+  header.srcBeginOffset = header.featureNamesOffset + StringsBytes(featureNames.strings);
+  header.pairTgtOffset = header.srcBeginOffset + srcBegin.size() * sizeof(uint64_t);
+  header.entryBeginOffset = header.pairTgtOffset + pairTgt.size() * sizeof(uint64_t);
+  header.entriesOffset = header.entryBeginOffset + entryBegin.size() * sizeof(uint64_t);
+
+  ofstream binaryFile(binaryFilename.c_str(), ios::out | ios::binary);
+  uint64_t offset = sizeof(Header);
+  binaryFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  WritePadding(binaryFile, offset);
+  WriteStrings(binaryFile, offset, words.strings);
+  WriteStrings(binaryFile, offset, featureNames.strings);
+  WriteArray(binaryFile, offset, srcBegin);
+  WriteArray(binaryFile, offset, pairTgt);
+  WriteArray(binaryFile, offset, entryBegin);
+  assert(offset == header.entriesOffset);
+  WriteArray(binaryFile, offset, entries);
+  binaryFile.close();
+  if(!binaryFile) {
+    cerr << "failed to write " << binaryFilename << endl;
+    exit(1);
+  }
+  cerr << "wrote " << header.pairsCount << " word pairs, " << header.entriesCount << " features, " <<
+    header.wordsCount << " words and " << header.featureNamesCount << " feature names to " << binaryFilename << endl;
+}
+
+bool WordPairFeatureFile::Map(const string &filename) {
+  if(!IsBinary(filename)) {
+    return false;
+  }
+  file = boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only);
+  region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+  if(region.get_size() < sizeof(Header)) {
+    return false;
+  }
+  header = static_cast<const Header*>(region.get_address());
+  if(region.get_size() < header->entriesOffset + header->entriesCount * sizeof(WordPairFeature)) {
+    cerr << filename << " is truncated" << endl;
+    header = 0;
+    return false;
+  }
+  return true;
+}
+
+string WordPairFeatureFile::String(uint64_t offset, uint64_t count, uint64_t index) const {
+  assert(index < count);
+  const uint64_t *offsets = Section<uint64_t>(offset);
+  const char *characters = Section<char>(offset + (count + 1) * sizeof(uint64_t));
+  return string(characters + offsets[index], characters + offsets[index + 1]);
+}
+
+int64_t WordPairFeatureFile::FindWord(const string &word) const {
+  const uint64_t *offsets = Section<uint64_t>(header->wordsOffset);
+  const char *characters = Section<char>(header->wordsOffset + (header->wordsCount + 1) * sizeof(uint64_t));
+  uint64_t low = 0, high = header->wordsCount;
+  while(low < high) {
+    uint64_t middle = (low + high) / 2;
+    int comparison = word.compare(0, string::npos, characters + offsets[middle], offsets[middle + 1] - offsets[middle]);
+    if(comparison == 0) {
+      return middle;
+    } else if(comparison < 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return -1;
+}
+
+void WordPairFeatureFile::SetFeatureIds(const vector<int64_t> &featureIds) {
+  assert(featureIds.size() == header->featureNamesCount);
+  this->featureIds = featureIds;
+}
+
+WordPairFeatureRange WordPairFeatureFile::Find(int64_t src, int64_t tgt) const {
+  if(src < 0 || tgt < 0 || (uint64_t)src >= vocabToWord.size() || (uint64_t)tgt >= vocabToWord.size()) {
+    return WordPairFeatureRange();
+  }
+  int64_t srcWord = vocabToWord[src], tgtWord = vocabToWord[tgt];
+  if(srcWord < 0 || tgtWord < 0) {
+    return WordPairFeatureRange();
+  }
+  const uint64_t *srcBegin = Section<uint64_t>(header->srcBeginOffset);
+  const uint64_t *pairTgt = Section<uint64_t>(header->pairTgtOffset);
+  const uint64_t *first = pairTgt + srcBegin[srcWord], *last = pairTgt + srcBegin[srcWord + 1];
+  const uint64_t *pairIter = lower_bound(first, last, (uint64_t)tgtWord);
+  if(pairIter == last || *pairIter != (uint64_t)tgtWord) {
+    return WordPairFeatureRange();
+  }
+  uint64_t pairId = pairIter - pairTgt;
+  const uint64_t *entryBegin = Section<uint64_t>(header->entryBeginOffset);
+  const WordPairFeature *entries = Section<WordPairFeature>(header->entriesOffset);
+  return WordPairFeatureRange(entries + entryBegin[pairId], entries + entryBegin[pairId + 1], featureIds.data());
+}
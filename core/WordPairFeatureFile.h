@@ -0,0 +1,80 @@
+#ifndef _WORD_PAIR_FEATURE_FILE_H_
+#define _WORD_PAIR_FEATURE_FILE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "WordPairFeatureTable.h"
+
+// a binary word pair features file, mapped read-only by every process. it is produced from the text format
+// (see LogLinearParams::LoadPrecomputedFeaturesWith2Inputs()) by convert-wordpair-feats. layout:
+// - a Header
+// - the words, sorted, as a string table (offsets[wordsCount + 1], then the characters)
+// - the feature names as a string table
+// - srcBegin[wordsCount + 1]: the pairs of src word w are pairs [srcBegin[w], srcBegin[w+1]), sorted by tgt word
+// - pairTgt[pairsCount]: the tgt word of each pair
+// - entryBegin[pairsCount + 1]: the features of pair p are entries [entryBegin[p], entryBegin[p+1])
+// - entries[entriesCount]: WordPairFeature, where precomputed is the index of the feature name
+// words and feature names are ids local to the file. they are translated to vocab ids with SetWordIds()
+// and SetFeatureIds() before any lookup. all sections start at multiples of 8 bytes.
+class WordPairFeatureFile {
+
+ public:
+
+  struct Header {
+    char magic[8];
+    uint64_t wordsCount, featureNamesCount, pairsCount, entriesCount;
+    uint64_t wordsOffset, featureNamesOffset, srcBeginOffset, pairTgtOffset, entryBeginOffset, entriesOffset;
+  };
+
+  static const char MAGIC[8];
+
+  // does this file start with MAGIC?
+  static bool IsBinary(const std::string &filename);
+
+  // parse a text word pair features file and write it in the binary format
+  static void Convert(const std::string &textFilename, const std::string &binaryFilename);
+
+  WordPairFeatureFile() : header(0) {}
+
+  // returns false if the file is not a valid binary word pair features file
+  bool Map(const std::string &filename);
+
+  bool IsMapped() const { return header != 0; }
+
+  uint64_t WordsCount() const { return header->wordsCount; }
+  uint64_t FeatureNamesCount() const { return header->featureNamesCount; }
+  uint64_t PairsCount() const { return header->pairsCount; }
+  std::string Word(uint64_t word) const { return String(header->wordsOffset, header->wordsCount, word); }
+  std::string FeatureName(uint64_t featureName) const { return String(header->featureNamesOffset, header->featureNamesCount, featureName); }
+
+  // local id of a word, or -1 if the file does not have it
+  int64_t FindWord(const std::string &word) const;
+
+  // vocabToWord[vocab id] is the local id of that word (or -1)
+  void SetWordIds(const std::vector<int64_t> &vocabToWord) { this->vocabToWord = vocabToWord; }
+
+  // featureIds[local feature name id] is the vocab id of the feature name
+  void SetFeatureIds(const std::vector<int64_t> &featureIds);
+
+  WordPairFeatureRange Find(int64_t src, int64_t tgt) const;
+
+ private:
+
+  template <class T> const T* Section(uint64_t offset) const {
+    return reinterpret_cast<const T*>(static_cast<const char*>(region.get_address()) + offset);
+  }
+
+  std::string String(uint64_t offset, uint64_t count, uint64_t index) const;
+
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+  const Header *header;
+  std::vector<int64_t> vocabToWord, featureIds;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef _WORD_PAIR_FEATURE_TABLE_H_
+#define _WORD_PAIR_FEATURE_TABLE_H_
+
+#include <vector>
+#include <utility>
+#include <limits>
+#include <cassert>
+#include <stdint.h>
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+// one precomputed feature of a word pair: the vocab id of the feature name, and its value
+struct WordPairFeature {
+  int64_t precomputed;
+  double value;
+};
+
+// the precomputed features of one word pair (possibly none). when featureIds is set, the entries store
+// a local feature id (see WordPairFeatureFile) which is translated to the vocab id while iterating
+class WordPairFeatureRange {
+ public:
+
+  class const_iterator {
+   public:
+    const_iterator(const WordPairFeature *entry, const int64_t *featureIds) : entry(entry), featureIds(featureIds) {}
+    const WordPairFeature& operator*() {
+      if(!featureIds) { return *entry; }
+      current.precomputed = featureIds[entry->precomputed];
+      current.value = entry->value;
+      return current;
+    }
+    const WordPairFeature* operator->() { return &(**this); }
+    const_iterator& operator++() { ++entry; return *this; }
+    const_iterator operator++(int) { const_iterator temp = *this; ++entry; return temp; }
+    bool operator==(const const_iterator &other) const { return entry == other.entry; }
+    bool operator!=(const const_iterator &other) const { return entry != other.entry; }
+   private:
+    const WordPairFeature *entry;
+    const int64_t *featureIds;
+    WordPairFeature current;
+  };
+
+  WordPairFeatureRange() : first(0), last(0), featureIds(0) {}
+  WordPairFeatureRange(const WordPairFeature *first, const WordPairFeature *last, const int64_t *featureIds = 0) : 
+    first(first), last(last), featureIds(featureIds) {}
+  const_iterator begin() const { return const_iterator(first, featureIds); }
+  const_iterator end() const { return const_iterator(last, featureIds); }
+  size_t size() const { return last - first; }
+  bool empty() const { return first == last; }
+ private:
+  const WordPairFeature *first, *last;
+  const int64_t *featureIds;
+};
+
+// the precomputed features of all word pairs, kept in two flat arrays in the managed shared memory segment:
+// an open-addressing hash table (with linear probing) which maps (src, tgt) to a range of entries, and the entries.
+// the master builds it once. all processes look word pairs up directly in the segment.
+class WordPairFeatureTable {
+
+ public:
+  typedef boost::interprocess::managed_shared_memory::segment_manager SegmentManager;
+
+  // features of the pair (src, tgt) are entries[begin..end). empty slots have begin == end
+  struct Slot {
+    int64_t src, tgt;
+    uint64_t begin, end;
+  };
+
+  typedef boost::interprocess::allocator<Slot, SegmentManager> ShmemSlotAllocator;
+  typedef boost::interprocess::vector<Slot, ShmemSlotAllocator> ShmemVectorOfSlot;
+  typedef boost::interprocess::allocator<WordPairFeature, SegmentManager> ShmemWordPairFeatureAllocator;
+  typedef boost::interprocess::vector<WordPairFeature, ShmemWordPairFeatureAllocator> ShmemVectorOfWordPairFeature;
+  typedef boost::unordered_map< std::pair<int64_t, int64_t>, std::vector<WordPairFeature> > WordPairToFeatures;
+
+  WordPairFeatureTable() : slots(0), entries(0) {}
+
+  // called by the master only. pairs without features are not stored
+  void Build(boost::interprocess::managed_shared_memory &segment, const WordPairToFeatures &wordPairs) {
+    slots = segment.find_or_construct<ShmemVectorOfSlot>("wordPairSlots")(ShmemSlotAllocator(segment.get_segment_manager()));
+    entries = segment.find_or_construct<ShmemVectorOfWordPairFeature>("wordPairFeatures")
+      (ShmemWordPairFeatureAllocator(segment.get_segment_manager()));
+    assert(slots->size() == 0 && entries->size() == 0);
+
+    // at most half the slots are used, so probe sequences stay short
+    size_t slotsCount = 1;
+    while(slotsCount < 2 * wordPairs.size()) { slotsCount *= 2; }
+    Slot emptySlot = {0, 0, 0, 0};
+    slots->assign(slotsCount, emptySlot);
+
+    size_t entriesCount = 0;
+    for(auto pairIter = wordPairs.begin(); pairIter != wordPairs.end(); ++pairIter) {
+      entriesCount += pairIter->second.size();
+    }
+    entries->reserve(entriesCount);
+
+    for(auto pairIter = wordPairs.begin(); pairIter != wordPairs.end(); ++pairIter) {
+      if(pairIter->second.size() == 0) { continue; }
+      Slot &slot = (*slots)[FindSlot(pairIter->first.first, pairIter->first.second)];
+      assert(slot.begin == slot.end);
+      slot.src = pairIter->first.first;
+      slot.tgt = pairIter->first.second;
+      slot.begin = entries->size();
+      entries->insert(entries->end(), pairIter->second.begin(), pairIter->second.end());
+      slot.end = entries->size();
+    }
+  }
+
+  // called by the other processes. returns false if the master did not build a table
+  bool Map(boost::interprocess::managed_shared_memory &segment) {
+    slots = segment.find<ShmemVectorOfSlot>("wordPairSlots").first;
+    entries = segment.find<ShmemVectorOfWordPairFeature>("wordPairFeatures").first;
+    return slots != 0 && entries != 0;
+  }
+
+  bool IsMapped() const {
+    return slots != 0;
+  }
+
+  WordPairFeatureRange Find(int64_t src, int64_t tgt) const {
+    if(slots == 0 || slots->size() == 0) {
+      return WordPairFeatureRange();
+    }
+    const Slot &slot = (*slots)[FindSlot(src, tgt)];
+    if(slot.begin == slot.end) {
+      return WordPairFeatureRange();
+    }
+    const WordPairFeature *data = &(*entries)[0];
+    return WordPairFeatureRange(data + slot.begin, data + slot.end);
+  }
+
+  size_t PairsCount() const {
+    size_t count = 0;
+    for(size_t i = 0; slots && i < slots->size(); ++i) {
+      if((*slots)[i].begin != (*slots)[i].end) { ++count; }
+    }
+    return count;
+  }
+
+ private:
+  // the slot of (src, tgt), or the empty slot where it would be inserted
+  size_t FindSlot(int64_t src, int64_t tgt) const {
+    size_t seed = 0;
+    boost::hash_combine(seed, src);
+    boost::hash_combine(seed, tgt);
+    size_t mask = slots->size() - 1;
+    for(size_t i = seed & mask; ; i = (i + 1) & mask) {
+      const Slot &slot = (*slots)[i];
+      if(slot.begin == slot.end || (slot.src == src && slot.tgt == tgt)) {
+        return i;
+      }
+    }
+  }
+
+  ShmemVectorOfSlot *slots;
+  ShmemVectorOfWordPairFeature *entries;
+};
+
+#endif
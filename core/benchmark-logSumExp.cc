@@ -0,0 +1,65 @@
+// measures the throughput of the forward/backward passes of DenseLattice with each of the
+// log-sum-exp kernels supported by this cpu, for a range of label counts K. the kernels which DenseLattice
+// picks for each K (LogSumExp::Best(K)) are marked with *
+// usage: benchmark-logSumExp [timesteps=40] [repetitions=200]
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+
+#include "DenseLattice.h"
+
+using namespace std;
+
+double Seconds() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  unsigned timesteps = argc > 1? atoi(argv[1]) : 40;
+  unsigned repetitions = argc > 2? atoi(argv[2]) : 200;
+
+  vector<LogSumExp::Kernels> kernelsList;
+  kernelsList.push_back(LogSumExp::Scalar());
+  LogSumExp::Kernels kernels;
+  if(LogSumExp::Avx2(kernels)) { kernelsList.push_back(kernels); }
+  if(LogSumExp::Avx512(kernels)) { kernelsList.push_back(kernels); }
+
+  cout << "timesteps=" << timesteps << " repetitions=" << repetitions << endl;
+  cout << "K\tkernels\tarcs/sec\tspeedup\tnLogZ\tpicked" << endl;
+  unsigned labelsCounts[] = {4, 8, 16, 32, 50, 64, 128, 256};
+  for(unsigned l = 0; l < sizeof(labelsCounts) / sizeof(unsigned); ++l) {
+    unsigned K = labelsCounts[l];
+    vector<int> labels;
+    for(unsigned k = 0; k < K; ++k) { labels.push_back(k); }
+
+    // the same random weights for all kernels
+    DenseLattice lattice;
+    lattice.Resize(timesteps, labels);
+    srand(K);
+    for(unsigned k = 0; k < lattice.arcWeights.size(); ++k) {
+      lattice.arcWeights[k] = 10.0 * rand() / RAND_MAX;
+    }
+
+    double scalarSeconds = 0.0;
+    for(unsigned kernelsIndex = 0; kernelsIndex < kernelsList.size(); ++kernelsIndex) {
+      lattice.kernels = &kernelsList[kernelsIndex];
+      double start = Seconds();
+      for(unsigned r = 0; r < repetitions; ++r) {
+        lattice.ComputePotentials();
+      }
+      double seconds = Seconds() - start;
+      if(kernelsIndex == 0) { scalarSeconds = seconds; }
+      // each arc is visited once in the forward pass and once in the backward pass
+      double arcs = 2.0 * repetitions * timesteps * K * K;
+      cout << K << "\t" << kernelsList[kernelsIndex].name << "\t" << arcs / seconds << "\t"
+           << scalarSeconds / seconds << "\t" << lattice.NLogZ() << "\t" 
+           << (kernelsList[kernelsIndex].name == LogSumExp::Best(K).name? "*" : "") << endl;
+    }
+  }
+  return 0;
+}
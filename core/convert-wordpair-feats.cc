@@ -0,0 +1,18 @@
+// converts a text word pair features file (the format of --wordpair-feats) to the binary format which
+// training maps read-only instead of parsing (see WordPairFeatureFile.h).
+// usage: convert-wordpair-feats <text features file> <binary features file>
+
+#include <iostream>
+
+#include "WordPairFeatureFile.h"
+
+using namespace std;
+
+int main(int argc, char **argv) {
+  if(argc != 3) {
+    cerr << "usage: " << argv[0] << " <text features file> <binary features file>" << endl;
+    return 1;
+  }
+  WordPairFeatureFile::Convert(argv[1], argv[2]);
+  return 0;
+}